@@ -0,0 +1,4 @@
+(define l (let lp ((i 0) (acc '())) (if (= i 1000) acc (lp (+ i 1) (cons i acc)))))
+(define (sum l acc) (if (pair? l) (sum (cdr l) (+ acc (car l))) acc))
+(define (len l n) (if (null? l) n (len (cdr l) (+ n 1))))
+(let lp ((k 0)) (if (< k 5000) (begin (sum l 0) (len l 0) (lp (+ k 1))) 'done))
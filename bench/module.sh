@@ -0,0 +1,20 @@
+#!/bin/sh
+# Print a large machine-generated module for the compile-time benchmark:
+# one toplevel begin that defines N globals, a procedure referring to
+# all of them, and a procedure with N internal definitions.
+
+n=${1:-1000}
+
+awk -v n="$n" 'BEGIN {
+  print "(begin";
+  for (i = 0; i < n; i++) printf " (define g%d %d)\n", i, i;
+  printf " (define (globals)\n  (list";
+  for (i = 0; i < n; i++) printf " g%d", i;
+  print "))";
+  print " (define (locals)";
+  for (i = 0; i < n; i++) printf "  (define x%d %d)\n", i, i;
+  printf "  (list";
+  for (i = 0; i < n; i++) printf " x%d", i;
+  print "))";
+  print " (length (globals)))";
+}'
@@ -0,0 +1,2 @@
+(define (count i j) (if (= i 0) j (count (- i 1) (+ j (- i 1)))))
+(let lp ((k 0)) (if (< k 500) (begin (count 10000 0) (lp (+ k 1))) 'done))
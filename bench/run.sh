@@ -0,0 +1,15 @@
+#!/bin/bash
+# Time each benchmark with the interpreter given as $1 (a host build of
+# the tree). Run it against two builds to compare them.
+
+pic=${1:-./picrin-bench}
+dir=$(dirname "$0")
+
+sh "$dir/module.sh" > "$dir/module.scm"
+
+for f in "$dir"/list.scm "$dir"/numeric.scm "$dir"/module.scm; do
+  echo "$(basename "$f")"
+  time "$pic" < "$f" > /dev/null
+done
+
+rm -f "$dir/module.scm"
@@ -92,6 +92,9 @@ pic_blob_bytevector_u8_ref(pic_state *pic)
 
   pic_get_args(pic, "bi", &bv, &k);
 
+  if (k < 0 || (size_t)k >= bv->len)
+    pic_errorf(pic, "bytevector-u8-ref: index out of range");
+
   return pic_int_value(bv->data[k]);
 }
 
@@ -103,6 +106,8 @@ pic_blob_bytevector_u8_set(pic_state *pic)
 
   pic_get_args(pic, "bii", &bv, &k, &v);
 
+  if (k < 0 || (size_t)k >= bv->len)
+    pic_errorf(pic, "bytevector-u8-set!: index out of range");
   if (v < 0 || v > 255)
     pic_errorf(pic, "byte out of range");
 
@@ -5,11 +5,17 @@
 #include "picrin.h"
 #include "picrin/pair.h"
 #include "picrin/irep.h"
+#include "picrin/read.h"
+#include "picrin/ir.h"
 #include "picrin/proc.h"
 #include "picrin/lib.h"
 #include "picrin/macro.h"
 #include "picrin/dict.h"
+#include "picrin/data.h"
 #include "picrin/symbol.h"
+#include "picrin/string.h"
+#include "picrin/vector.h"
+#include "picrin/error.h"
 
 #if PIC_NONE_IS_FALSE
 # define OP_PUSHNONE OP_PUSHFALSE
@@ -25,11 +31,17 @@ typedef xvect_t(pic_sym *) xvect;
  * scope object
  */
 
+typedef struct defer_entry {
+  pic_value formals, body;
+  pic_ir *lambda;               /* filled in when the scope is done */
+} defer_entry;
+
 typedef struct analyze_scope {
   int depth;
   bool varg;
   xvect args, locals, captures; /* rest args variable is counted as a local */
-  pic_value defer;
+  xhash vars, captured;         /* the same variables for fast lookup */
+  xvect_t(defer_entry) defer;
   struct analyze_scope *up;
 } analyze_scope;
 
@@ -39,11 +51,14 @@ typedef struct analyze_scope {
 
 typedef struct analyze_state {
   pic_state *pic;
+  pic_ir_arena *arena;
   analyze_scope *scope;
   pic_sym *rCONS, *rCAR, *rCDR, *rNILP;
   pic_sym *rSYMBOLP, *rPAIRP;
   pic_sym *rADD, *rSUB, *rMUL, *rDIV;
   pic_sym *rEQ, *rLT, *rLE, *rGT, *rGE, *rNOT;
+  pic_sym *rVECREF, *rVECSET, *rVECLEN, *rSTRREF, *rBLOBREF, *rBLOBSET;
+  pic_sym *rEQP, *rEQVP, *rCHAREQ;
   pic_sym *rVALUES, *rCALL_WITH_VALUES;
 } analyze_state;
 
@@ -64,14 +79,13 @@ static void pop_scope(analyze_state *);
   } while (0)
 
 static analyze_state *
-new_analyze_state(pic_state *pic)
+new_analyze_state(pic_state *pic, pic_ir_arena *arena)
 {
   analyze_state *state;
-  pic_sym *sym;
-  xh_entry *it;
 
   state = pic_alloc(pic, sizeof(analyze_state));
   state->pic = pic;
+  state->arena = arena;
   state->scope = NULL;
 
   /* native VM procedures */
@@ -91,16 +105,21 @@ new_analyze_state(pic_state *pic)
   register_renamed_symbol(pic, state, rGT, pic->PICRIN_BASE, ">");
   register_renamed_symbol(pic, state, rGE, pic->PICRIN_BASE, ">=");
   register_renamed_symbol(pic, state, rNOT, pic->PICRIN_BASE, "not");
+  register_renamed_symbol(pic, state, rVECREF, pic->PICRIN_BASE, "vector-ref");
+  register_renamed_symbol(pic, state, rVECSET, pic->PICRIN_BASE, "vector-set!");
+  register_renamed_symbol(pic, state, rVECLEN, pic->PICRIN_BASE, "vector-length");
+  register_renamed_symbol(pic, state, rSTRREF, pic->PICRIN_BASE, "string-ref");
+  register_renamed_symbol(pic, state, rBLOBREF, pic->PICRIN_BASE, "bytevector-u8-ref");
+  register_renamed_symbol(pic, state, rBLOBSET, pic->PICRIN_BASE, "bytevector-u8-set!");
+  register_renamed_symbol(pic, state, rEQP, pic->PICRIN_BASE, "eq?");
+  register_renamed_symbol(pic, state, rEQVP, pic->PICRIN_BASE, "eqv?");
+  register_renamed_symbol(pic, state, rCHAREQ, pic->PICRIN_BASE, "char=?");
   register_renamed_symbol(pic, state, rVALUES, pic->PICRIN_BASE, "values");
   register_renamed_symbol(pic, state, rCALL_WITH_VALUES, pic->PICRIN_BASE, "call-with-values");
 
   /* push initial scope */
   push_scope(state, pic_nil_value());
 
-  pic_dict_for_each (sym, pic->globals, it) {
-    xv_push_sym(state->scope->locals, sym);
-  }
-
   return state;
 }
 
@@ -146,6 +165,8 @@ push_scope(analyze_state *state, pic_value formals)
   pic_state *pic = state->pic;
   analyze_scope *scope = pic_alloc(pic, sizeof(analyze_scope));
   bool varg;
+  size_t i;
+  int dummy = 0;
 
   xv_init(scope->args);
   xv_init(scope->locals);
@@ -155,7 +176,16 @@ push_scope(analyze_state *state, pic_value formals)
     scope->up = state->scope;
     scope->depth = scope->up ? scope->up->depth + 1 : 0;
     scope->varg = varg;
-    scope->defer = pic_nil_value();
+    xv_init(scope->defer);
+
+    xh_init_ptr(&scope->vars, sizeof(int));
+    xh_init_ptr(&scope->captured, sizeof(int));
+    for (i = 0; i < xv_size(scope->args); ++i) {
+      xh_put_ptr(&scope->vars, xv_A(scope->args, i), &dummy);
+    }
+    for (i = 0; i < xv_size(scope->locals); ++i) {
+      xh_put_ptr(&scope->vars, xv_A(scope->locals, i), &dummy);
+    }
 
     state->scope = scope;
 
@@ -180,6 +210,9 @@ pop_scope(analyze_state *state)
   xv_destroy(scope->args);
   xv_destroy(scope->locals);
   xv_destroy(scope->captures);
+  xv_destroy(scope->defer);
+  xh_destroy(&scope->vars);
+  xh_destroy(&scope->captured);
 
   scope = scope->up;
   pic_free(state->pic, state->scope);
@@ -187,35 +220,24 @@ pop_scope(analyze_state *state)
 }
 
 static bool
-lookup_scope(analyze_scope *scope, pic_sym *sym)
+lookup_scope(analyze_state *state, analyze_scope *scope, pic_sym *sym)
 {
-  size_t i;
-
-  /* args */
-  for (i = 0; i < xv_size(scope->args); ++i) {
-    if (xv_A(scope->args, i) == sym)
-      return true;
-  }
-  /* locals */
-  for (i = 0; i < xv_size(scope->locals); ++i) {
-    if (xv_A(scope->locals, i) == sym)
-      return true;
+  /* the toplevel scope also sees every global defined so far */
+  if (scope->up == NULL && pic_dict_has(state->pic, state->pic->globals, sym)) {
+    return true;
   }
-  return false;
+
+  return xh_get_ptr(&scope->vars, sym) != NULL;
 }
 
 static void
 capture_var(pic_state *pic, analyze_scope *scope, pic_sym *sym)
 {
-  size_t i;
+  int dummy = 0;
 
-  for (i = 0; i < xv_size(scope->captures); ++i) {
-    if (xv_A(scope->captures, i) == sym) {
-      break;
-    }
-  }
-  if (i == xv_size(scope->captures)) {
+  if (xh_get_ptr(&scope->captured, sym) == NULL) {
     xv_push_sym(scope->captures, sym);
+    xh_put_ptr(&scope->captured, sym, &dummy);
   }
 }
 
@@ -226,7 +248,7 @@ find_var(analyze_state *state, pic_sym *sym)
   int depth = 0;
 
   while (scope) {
-    if (lookup_scope(scope, sym)) {
+    if (lookup_scope(state, scope, sym)) {
       if (depth > 0) {
         capture_var(state->pic, scope, sym);
       }
@@ -243,69 +265,93 @@ define_var(analyze_state *state, pic_sym *sym)
 {
   pic_state *pic = state->pic;
   analyze_scope *scope = state->scope;
+  int dummy = 0;
 
-  if (lookup_scope(scope, sym)) {
+  if (lookup_scope(state, scope, sym)) {
     pic_warnf(pic, "redefining variable: ~s", pic_obj_value(sym));
     return;
   }
 
   xv_push_sym(scope->locals, sym);
+  xh_put_ptr(&scope->vars, sym, &dummy);
 }
 
-static pic_value analyze_node(analyze_state *, pic_value, bool);
-static pic_value analyze_procedure(analyze_state *, pic_value, pic_value, pic_value);
+static pic_ir *
+new_node(analyze_state *state, enum pic_ir_kind kind, size_t n)
+{
+  return pic_ir_node(state->pic, state->arena, kind, n);
+}
 
-static pic_value
+static pic_ir *
+new_node1(analyze_state *state, enum pic_ir_kind kind, pic_ir *a)
+{
+  pic_ir *ir = new_node(state, kind, 1);
+
+  pic_ir_elt(ir, 0) = a;
+  return ir;
+}
+
+static pic_ir *
+new_node2(analyze_state *state, enum pic_ir_kind kind, pic_ir *a, pic_ir *b)
+{
+  pic_ir *ir = new_node(state, kind, 2);
+
+  pic_ir_elt(ir, 0) = a;
+  pic_ir_elt(ir, 1) = b;
+  return ir;
+}
+
+static pic_ir *analyze_node(analyze_state *, pic_value, bool);
+static void analyze_procedure(analyze_state *, pic_ir *, pic_value, pic_value);
+
+static pic_ir *
 analyze(analyze_state *state, pic_value obj, bool tailpos)
 {
   pic_state *pic = state->pic;
   size_t ai = pic_gc_arena_preserve(pic);
-  pic_value res;
-  pic_sym *tag;
+  struct pic_loc *loc;
+  pic_ir *res;
 
   res = analyze_node(state, obj, tailpos);
 
-  tag = pic_sym_ptr(pic_car(pic, res));
+  if (res->line == 0 && (loc = pic_loc_ref(pic, obj)) != NULL) {
+    res->line = loc->line;
+  }
+
   if (tailpos) {
-    if (tag == pic->sIF || tag == pic->sBEGIN || tag == pic->sTAILCALL || tag == pic->sTAILCALL_WITH_VALUES || tag == pic->sRETURN) {
+    switch (res->kind) {
+    case PIC_IR_IF: case PIC_IR_BEGIN: case PIC_IR_TAILCALL:
+    case PIC_IR_TAILCALL_WITH_VALUES: case PIC_IR_RETURN:
       /* pass through */
-    }
-    else {
-      res = pic_list2(pic, pic_obj_value(pic->sRETURN), res);
+      break;
+    default:
+      res = new_node1(state, PIC_IR_RETURN, res);
     }
   }
 
   pic_gc_arena_restore(pic, ai);
-  pic_gc_protect(pic, res);
-  pic_gc_protect(pic, state->scope->defer);
   return res;
 }
 
-static pic_value
+static pic_ir *
 analyze_global_var(analyze_state *state, pic_sym *sym)
 {
-  pic_state *pic = state->pic;
-
-  return pic_list2(pic, pic_obj_value(pic->sGREF), pic_obj_value(sym));
+  return pic_ir_ref(state->pic, state->arena, PIC_IR_GREF, sym, 0);
 }
 
-static pic_value
+static pic_ir *
 analyze_local_var(analyze_state *state, pic_sym *sym)
 {
-  pic_state *pic = state->pic;
-
-  return pic_list2(pic, pic_obj_value(pic->sLREF), pic_obj_value(sym));
+  return pic_ir_ref(state->pic, state->arena, PIC_IR_LREF, sym, 0);
 }
 
-static pic_value
+static pic_ir *
 analyze_free_var(analyze_state *state, pic_sym *sym, int depth)
 {
-  pic_state *pic = state->pic;
-
-  return pic_list3(pic, pic_obj_value(pic->sCREF), pic_int_value(depth), pic_obj_value(sym));
+  return pic_ir_ref(state->pic, state->arena, PIC_IR_CREF, sym, depth);
 }
 
-static pic_value
+static pic_ir *
 analyze_var(analyze_state *state, pic_sym *sym)
 {
   pic_state *pic = state->pic;
@@ -324,104 +370,77 @@ analyze_var(analyze_state *state, pic_sym *sym)
   }
 }
 
-static pic_value
-analyze_defer(analyze_state *state, pic_value name, pic_value formal, pic_value body)
+static pic_ir *
+analyze_defer(analyze_state *state, pic_sym *name, pic_value source)
 {
   pic_state *pic = state->pic;
-  pic_sym *sNOWHERE = pic_intern_cstr(pic, "<<nowhere>>");
-  pic_value skel;
+  defer_entry defer;
 
-  skel = pic_list2(pic, pic_obj_value(pic->sGREF), pic_obj_value(sNOWHERE));
+  defer.formals = pic_list_ref(pic, source, 1);
+  defer.body = pic_list_tail(pic, source, 2);
+  defer.lambda = pic_ir_make_lambda(pic, state->arena, name, false);
+  pic_ir_lambda(defer.lambda)->source = source;
 
-  pic_push(pic, pic_list4(pic, name, formal, body, skel), state->scope->defer);
+  xv_push(defer_entry, state->scope->defer, defer);
 
-  return skel;
+  return defer.lambda;
 }
 
 static void
 analyze_deferred(analyze_state *state)
 {
-  pic_state *pic = state->pic;
-  pic_value defer, val, name, formal, body, dst, it;
-
-  pic_for_each (defer, pic_reverse(pic, state->scope->defer), it) {
-    name = pic_list_ref(pic, defer, 0);
-    formal = pic_list_ref(pic, defer, 1);
-    body = pic_list_ref(pic, defer, 2);
-    dst = pic_list_ref(pic, defer, 3);
+  defer_entry defer;
+  size_t i;
 
-    val = analyze_procedure(state, name, formal, body);
+  for (i = 0; i < xv_size(state->scope->defer); ++i) {
+    defer = xv_A(state->scope->defer, i);
 
-    /* copy */
-    pic_pair_ptr(dst)->car = pic_car(pic, val);
-    pic_pair_ptr(dst)->cdr = pic_cdr(pic, val);
+    analyze_procedure(state, defer.lambda, defer.formals, defer.body);
   }
 
-  state->scope->defer = pic_nil_value();
+  state->scope->defer.n = 0;
 }
 
-static pic_value
-analyze_procedure(analyze_state *state, pic_value name, pic_value formals, pic_value body_exprs)
+static void
+analyze_procedure(analyze_state *state, pic_ir *ir, pic_value formals, pic_value body_exprs)
 {
   pic_state *pic = state->pic;
-  pic_value args, locals, varg, captures, body;
-
-  assert(pic_sym_p(name) || pic_false_p(name));
+  struct pic_ir_lambda *lambda = pic_ir_lambda(ir);
 
   if (push_scope(state, formals)) {
     analyze_scope *scope = state->scope;
-    size_t i;
-
-    args = pic_nil_value();
-    for (i = xv_size(scope->args); i > 0; --i) {
-      pic_push(pic, pic_obj_value(xv_A(scope->args, i - 1)), args);
-    }
 
-    varg = scope->varg
-      ? pic_true_value()
-      : pic_false_value();
+    lambda->args = pic_ir_make_vars(pic, state->arena, scope->args.a, xv_size(scope->args));
+    lambda->varg = scope->varg;
 
     /* To know what kind of local variables are defined, analyze body at first. */
-    body = analyze(state, pic_cons(pic, pic_obj_value(pic->rBEGIN), body_exprs), true);
+    lambda->body = analyze(state, pic_cons(pic, pic_obj_value(pic->rBEGIN), body_exprs), true);
 
     analyze_deferred(state);
 
-    locals = pic_nil_value();
-    for (i = xv_size(scope->locals); i > 0; --i) {
-      pic_push(pic, pic_obj_value(xv_A(scope->locals, i - 1)), locals);
-    }
-
-    captures = pic_nil_value();
-    for (i = xv_size(scope->captures); i > 0; --i) {
-      pic_push(pic, pic_obj_value(xv_A(scope->captures, i - 1)), captures);
-    }
+    lambda->locals = pic_ir_make_vars(pic, state->arena, scope->locals.a, xv_size(scope->locals));
+    lambda->captures = pic_ir_make_vars(pic, state->arena, scope->captures.a, xv_size(scope->captures));
 
     pop_scope(state);
   }
   else {
-    pic_errorf(pic, "invalid formal syntax: ~s", args);
+    pic_errorf(pic, "invalid formal syntax: ~s", formals);
   }
-
-  return pic_list7(pic, pic_obj_value(pic->sLAMBDA), name, args, locals, varg, captures, body);
 }
 
-static pic_value
+static pic_ir *
 analyze_lambda(analyze_state *state, pic_value obj)
 {
   pic_state *pic = state->pic;
-  pic_value formals, body_exprs;
 
   if (pic_length(pic, obj) < 2) {
     pic_errorf(pic, "syntax error");
   }
 
-  formals = pic_list_ref(pic, obj, 1);
-  body_exprs = pic_list_tail(pic, obj, 2);
-
-  return analyze_defer(state, pic_false_value(), formals, body_exprs);
+  return analyze_defer(state, NULL, obj);
 }
 
-static pic_value
+static pic_ir *
 analyze_declare(analyze_state *state, pic_sym *var)
 {
   define_var(state, var);
@@ -429,11 +448,12 @@ analyze_declare(analyze_state *state, pic_sym *var)
   return analyze_var(state, var);
 }
 
-static pic_value
+static pic_ir *
 analyze_define(analyze_state *state, pic_value obj)
 {
   pic_state *pic = state->pic;
-  pic_value var, val;
+  pic_value var;
+  pic_ir *ref, *val;
   pic_sym *sym;
 
   if (pic_length(pic, obj) != 3) {
@@ -446,17 +466,12 @@ analyze_define(analyze_state *state, pic_value obj)
   } else {
     sym = pic_sym_ptr(var);
   }
-  var = analyze_declare(state, sym);
+  ref = analyze_declare(state, sym);
 
   if (pic_pair_p(pic_list_ref(pic, obj, 2))
       && pic_sym_p(pic_list_ref(pic, pic_list_ref(pic, obj, 2), 0))
       && pic_sym_ptr(pic_list_ref(pic, pic_list_ref(pic, obj, 2), 0)) == pic->rLAMBDA) {
-    pic_value formals, body_exprs;
-
-    formals = pic_list_ref(pic, pic_list_ref(pic, obj, 2), 1);
-    body_exprs = pic_list_tail(pic, pic_list_ref(pic, obj, 2), 2);
-
-    val = analyze_defer(state, pic_obj_value(sym), formals, body_exprs);
+    val = analyze_defer(state, sym, pic_list_ref(pic, obj, 2));
   } else {
     if (pic_length(pic, obj) != 3) {
       pic_errorf(pic, "syntax error");
@@ -464,14 +479,15 @@ analyze_define(analyze_state *state, pic_value obj)
     val = analyze(state, pic_list_ref(pic, obj, 2), false);
   }
 
-  return pic_list3(pic, pic_obj_value(pic->sSETBANG), var, val);
+  return new_node2(state, PIC_IR_SETBANG, ref, val);
 }
 
-static pic_value
+static pic_ir *
 analyze_if(analyze_state *state, pic_value obj, bool tailpos)
 {
   pic_state *pic = state->pic;
-  pic_value cond, if_true, if_false;
+  pic_value if_true, if_false;
+  pic_ir *ir;
 
   if_false = pic_none_value();
   switch (pic_length(pic, obj)) {
@@ -485,44 +501,47 @@ analyze_if(analyze_state *state, pic_value obj, bool tailpos)
   }
 
   /* analyze in order */
-  cond = analyze(state, pic_list_ref(pic, obj, 1), false);
-  if_true = analyze(state, if_true, tailpos);
-  if_false = analyze(state, if_false, tailpos);
+  ir = new_node(state, PIC_IR_IF, 3);
+  pic_ir_elt(ir, 0) = analyze(state, pic_list_ref(pic, obj, 1), false);
+  pic_ir_elt(ir, 1) = analyze(state, if_true, tailpos);
+  pic_ir_elt(ir, 2) = analyze(state, if_false, tailpos);
 
-  return pic_list4(pic, pic_obj_value(pic->sIF), cond, if_true, if_false);
+  return ir;
 }
 
-static pic_value
+static pic_ir *
 analyze_begin(analyze_state *state, pic_value obj, bool tailpos)
 {
   pic_state *pic = state->pic;
-  pic_value seq;
+  size_t i, len;
+  pic_ir *seq;
   bool tail;
 
-  switch (pic_length(pic, obj)) {
+  switch (len = pic_length(pic, obj)) {
   case 1:
     return analyze(state, pic_none_value(), tailpos);
   case 2:
     return analyze(state, pic_list_ref(pic, obj, 1), tailpos);
   default:
-    seq = pic_list1(pic, pic_obj_value(pic->sBEGIN));
-    for (obj = pic_cdr(pic, obj); ! pic_nil_p(obj); obj = pic_cdr(pic, obj)) {
+    seq = new_node(state, PIC_IR_BEGIN, len - 1);
+    for (i = 0, obj = pic_cdr(pic, obj); ! pic_nil_p(obj); ++i, obj = pic_cdr(pic, obj)) {
       if (pic_nil_p(pic_cdr(pic, obj))) {
         tail = tailpos;
       } else {
         tail = false;
       }
-      seq = pic_cons(pic, analyze(state, pic_car(pic, obj), tail), seq);
+      pic_ir_elt(seq, i) = analyze(state, pic_car(pic, obj), tail);
     }
-    return pic_reverse(pic, seq);
+    return seq;
   }
 }
 
-static pic_value
+static pic_ir *
 analyze_set(analyze_state *state, pic_value obj)
 {
   pic_state *pic = state->pic;
   pic_value var, val;
+  pic_ir *ref;
 
   if (pic_length(pic, obj) != 3) {
     pic_errorf(pic, "syntax error");
@@ -535,13 +554,11 @@ analyze_set(analyze_state *state, pic_value obj)
 
   val = pic_list_ref(pic, obj, 2);
 
-  var = analyze(state, var, false);
-  val = analyze(state, val, false);
-
-  return pic_list3(pic, pic_obj_value(pic->sSETBANG), var, val);
+  ref = analyze(state, var, false);
+  return new_node2(state, PIC_IR_SETBANG, ref, analyze(state, val, false));
 }
 
-static pic_value
+static pic_ir *
 analyze_quote(analyze_state *state, pic_value obj)
 {
   pic_state *pic = state->pic;
@@ -549,7 +566,7 @@ analyze_quote(analyze_state *state, pic_value obj)
   if (pic_length(pic, obj) != 2) {
     pic_errorf(pic, "syntax error");
   }
-  return pic_list2(pic, pic_obj_value(pic->sQUOTE), pic_list_ref(pic, obj, 1));
+  return pic_ir_quote(pic, state->arena, pic_list_ref(pic, obj, 1));
 }
 
 #define ARGC_ASSERT_GE(n) do {				\
@@ -558,75 +575,77 @@ analyze_quote(analyze_state *state, pic_value obj)
     }                                                   \
   } while (0)
 
-#define FOLD_ARGS(sym) do {                             \
-    obj = analyze(state, pic_car(pic, args), false);    \
-    pic_for_each (arg, pic_cdr(pic, args), it) {        \
-      obj = pic_list3(pic, pic_obj_value(sym), obj,     \
-                      analyze(state, arg, false));      \
-    }                                                   \
+#define FOLD_ARGS(kind) do {                                    \
+    ir = analyze(state, pic_car(pic, args), false);             \
+    pic_for_each (arg, pic_cdr(pic, args), it) {                \
+      ir = new_node2(state, kind, ir, analyze(state, arg, false)); \
+    }                                                           \
   } while (0)
 
-static pic_value
+static pic_ir *
 analyze_add(analyze_state *state, pic_value obj, bool tailpos)
 {
   pic_state *pic = state->pic;
   pic_value args, arg, it;
+  pic_ir *ir;
 
   ARGC_ASSERT_GE(0);
   switch (pic_length(pic, obj)) {
   case 1:
-    return pic_list2(pic, pic_obj_value(pic->sQUOTE), pic_int_value(0));
+    return pic_ir_quote(pic, state->arena, pic_int_value(0));
   case 2:
     return analyze(state, pic_car(pic, pic_cdr(pic, obj)), tailpos);
   default:
     args = pic_cdr(pic, obj);
-    FOLD_ARGS(pic->sADD);
-    return obj;
+    FOLD_ARGS(PIC_IR_ADD);
+    return ir;
   }
 }
 
-static pic_value
+static pic_ir *
 analyze_sub(analyze_state *state, pic_value obj)
 {
   pic_state *pic = state->pic;
   pic_value args, arg, it;
+  pic_ir *ir;
 
   ARGC_ASSERT_GE(1);
   switch (pic_length(pic, obj)) {
   case 2:
-    return pic_list2(pic, pic_obj_value(pic->sMINUS),
-                     analyze(state, pic_car(pic, pic_cdr(pic, obj)), false));
+    return new_node1(state, PIC_IR_MINUS, analyze(state, pic_car(pic, pic_cdr(pic, obj)), false));
   default:
     args = pic_cdr(pic, obj);
-    FOLD_ARGS(pic->sSUB);
-    return obj;
+    FOLD_ARGS(PIC_IR_SUB);
+    return ir;
   }
 }
 
-static pic_value
+static pic_ir *
 analyze_mul(analyze_state *state, pic_value obj, bool tailpos)
 {
   pic_state *pic = state->pic;
   pic_value args, arg, it;
+  pic_ir *ir;
 
   ARGC_ASSERT_GE(0);
   switch (pic_length(pic, obj)) {
   case 1:
-    return pic_list2(pic, pic_obj_value(pic->sQUOTE), pic_int_value(1));
+    return pic_ir_quote(pic, state->arena, pic_int_value(1));
   case 2:
     return analyze(state, pic_car(pic, pic_cdr(pic, obj)), tailpos);
   default:
     args = pic_cdr(pic, obj);
-    FOLD_ARGS(pic->sMUL);
-    return obj;
+    FOLD_ARGS(PIC_IR_MUL);
+    return ir;
   }
 }
 
-static pic_value
+static pic_ir *
 analyze_div(analyze_state *state, pic_value obj)
 {
   pic_state *pic = state->pic;
   pic_value args, arg, it;
+  pic_ir *ir;
 
   ARGC_ASSERT_GE(1);
   switch (pic_length(pic, obj)) {
@@ -640,66 +659,58 @@ analyze_div(analyze_state *state, pic_value obj)
     return analyze(state, obj, false);
   default:
     args = pic_cdr(pic, obj);
-    FOLD_ARGS(pic->sDIV);
-    return obj;
+    FOLD_ARGS(PIC_IR_DIV);
+    return ir;
   }
 }
 
-static pic_value
+static pic_ir *
 analyze_call(analyze_state *state, pic_value obj, bool tailpos)
 {
   pic_state *pic = state->pic;
-  pic_value seq, elt, it;
-  pic_sym *call;
+  pic_value elt, it;
+  pic_ir *seq;
+  size_t i = 0;
 
-  if (! tailpos) {
-    call = pic->sCALL;
-  } else {
-    call = pic->sTAILCALL;
-  }
-  seq = pic_list1(pic, pic_obj_value(call));
+  seq = new_node(state, tailpos ? PIC_IR_TAILCALL : PIC_IR_CALL, pic_length(pic, obj));
   pic_for_each (elt, obj, it) {
-    seq = pic_cons(pic, analyze(state, elt, false), seq);
+    pic_ir_elt(seq, i++) = analyze(state, elt, false);
   }
-  return pic_reverse(pic, seq);
+  return seq;
 }
 
-static pic_value
+static pic_ir *
 analyze_values(analyze_state *state, pic_value obj, bool tailpos)
 {
   pic_state *pic = state->pic;
-  pic_value v, seq, it;
+  pic_value v, it;
+  pic_ir *seq;
+  size_t i = 0;
 
   if (! tailpos) {
     return analyze_call(state, obj, false);
   }
 
-  seq = pic_list1(pic, pic_obj_value(pic->sRETURN));
+  seq = new_node(state, PIC_IR_RETURN, pic_length(pic, obj) - 1);
   pic_for_each (v, pic_cdr(pic, obj), it) {
-    seq = pic_cons(pic, analyze(state, v, false), seq);
+    pic_ir_elt(seq, i++) = analyze(state, v, false);
   }
-  return pic_reverse(pic, seq);
+  return seq;
 }
 
-static pic_value
+static pic_ir *
 analyze_call_with_values(analyze_state *state, pic_value obj, bool tailpos)
 {
   pic_state *pic = state->pic;
-  pic_value prod, cnsm;
-  pic_sym *call;
+  pic_ir *prod, *cnsm;
 
   if (pic_length(pic, obj) != 3) {
     pic_errorf(pic, "wrong number of arguments");
   }
 
-  if (! tailpos) {
-    call = pic->sCALL_WITH_VALUES;
-  } else {
-    call = pic->sTAILCALL_WITH_VALUES;
-  }
   prod = analyze(state, pic_list_ref(pic, obj, 1), false);
   cnsm = analyze(state, pic_list_ref(pic, obj, 2), false);
-  return pic_list3(pic, pic_obj_value(call), prod, cnsm);
+  return new_node2(state, tailpos ? PIC_IR_TAILCALL_WITH_VALUES : PIC_IR_CALL_WITH_VALUES, prod, cnsm);
 }
 
 #define ARGC_ASSERT(n) do {				\
@@ -714,18 +725,39 @@ analyze_call_with_values(analyze_state *state, pic_value obj, bool tailpos)
     }						\
   } while (0)
 
-#define CONSTRUCT_OP1(op)                                       \
-  pic_list2(pic,                                                \
-            pic_obj_value(op),                                  \
+#define CONSTRUCT_OP1(kind)                                     \
+  new_node1(state, kind,                                        \
             analyze(state, pic_list_ref(pic, obj, 1), false))
 
-#define CONSTRUCT_OP2(op)                                       \
-  pic_list3(pic,                                                \
-            pic_obj_value(op),                                  \
-            analyze(state, pic_list_ref(pic, obj, 1), false),   \
-            analyze(state, pic_list_ref(pic, obj, 2), false))
+static pic_ir *
+construct_op2(analyze_state *state, enum pic_ir_kind kind, pic_value obj)
+{
+  pic_state *pic = state->pic;
+  pic_ir *a;
 
-static pic_value
+  /* analyze in order */
+  a = analyze(state, pic_list_ref(pic, obj, 1), false);
+  return new_node2(state, kind, a, analyze(state, pic_list_ref(pic, obj, 2), false));
+}
+
+#define CONSTRUCT_OP2(kind) construct_op2(state, kind, obj)
+
+static pic_ir *
+construct_op3(analyze_state *state, enum pic_ir_kind kind, pic_value obj)
+{
+  pic_state *pic = state->pic;
+  pic_ir *ir = new_node(state, kind, 3);
+
+  /* analyze in order */
+  pic_ir_elt(ir, 0) = analyze(state, pic_list_ref(pic, obj, 1), false);
+  pic_ir_elt(ir, 1) = analyze(state, pic_list_ref(pic, obj, 2), false);
+  pic_ir_elt(ir, 2) = analyze(state, pic_list_ref(pic, obj, 3), false);
+  return ir;
+}
+
+#define CONSTRUCT_OP3(kind) construct_op3(state, kind, obj)
+
+static pic_ir *
 analyze_node(analyze_state *state, pic_value obj, bool tailpos)
 {
   pic_state *pic = state->pic;
@@ -765,27 +797,27 @@ analyze_node(analyze_state *state, pic_value obj, bool tailpos)
       }
       else if (sym == state->rCONS) {
 	ARGC_ASSERT(2);
-        return CONSTRUCT_OP2(pic->sCONS);
+        return CONSTRUCT_OP2(PIC_IR_CONS);
       }
       else if (sym == state->rCAR) {
 	ARGC_ASSERT(1);
-        return CONSTRUCT_OP1(pic->sCAR);
+        return CONSTRUCT_OP1(PIC_IR_CAR);
       }
       else if (sym == state->rCDR) {
 	ARGC_ASSERT(1);
-        return CONSTRUCT_OP1(pic->sCDR);
+        return CONSTRUCT_OP1(PIC_IR_CDR);
       }
       else if (sym == state->rNILP) {
 	ARGC_ASSERT(1);
-        return CONSTRUCT_OP1(pic->sNILP);
+        return CONSTRUCT_OP1(PIC_IR_NILP);
       }
       else if (sym == state->rSYMBOLP) {
         ARGC_ASSERT(1);
-        return CONSTRUCT_OP1(pic->sSYMBOLP);
+        return CONSTRUCT_OP1(PIC_IR_SYMBOLP);
       }
       else if (sym == state->rPAIRP) {
         ARGC_ASSERT(1);
-        return CONSTRUCT_OP1(pic->sPAIRP);
+        return CONSTRUCT_OP1(PIC_IR_PAIRP);
       }
       else if (sym == state->rADD) {
         return analyze_add(state, obj, tailpos);
@@ -801,27 +833,63 @@ analyze_node(analyze_state *state, pic_value obj, bool tailpos)
       }
       else if (sym == state->rEQ) {
 	ARGC_ASSERT_WITH_FALLBACK(2);
-        return CONSTRUCT_OP2(pic->sEQ);
+        return CONSTRUCT_OP2(PIC_IR_EQ);
       }
       else if (sym == state->rLT) {
 	ARGC_ASSERT_WITH_FALLBACK(2);
-        return CONSTRUCT_OP2(pic->sLT);
+        return CONSTRUCT_OP2(PIC_IR_LT);
       }
       else if (sym == state->rLE) {
 	ARGC_ASSERT_WITH_FALLBACK(2);
-        return CONSTRUCT_OP2(pic->sLE);
+        return CONSTRUCT_OP2(PIC_IR_LE);
       }
       else if (sym == state->rGT) {
 	ARGC_ASSERT_WITH_FALLBACK(2);
-        return CONSTRUCT_OP2(pic->sGT);
+        return CONSTRUCT_OP2(PIC_IR_GT);
       }
       else if (sym == state->rGE) {
 	ARGC_ASSERT_WITH_FALLBACK(2);
-        return CONSTRUCT_OP2(pic->sGE);
+        return CONSTRUCT_OP2(PIC_IR_GE);
       }
       else if (sym == state->rNOT) {
         ARGC_ASSERT(1);
-        return CONSTRUCT_OP1(pic->sNOT);
+        return CONSTRUCT_OP1(PIC_IR_NOT);
+      }
+      else if (sym == state->rVECREF) {
+        ARGC_ASSERT(2);
+        return CONSTRUCT_OP2(PIC_IR_VECREF);
+      }
+      else if (sym == state->rVECSET) {
+        ARGC_ASSERT(3);
+        return CONSTRUCT_OP3(PIC_IR_VECSET);
+      }
+      else if (sym == state->rVECLEN) {
+        ARGC_ASSERT(1);
+        return CONSTRUCT_OP1(PIC_IR_VECLEN);
+      }
+      else if (sym == state->rSTRREF) {
+        ARGC_ASSERT(2);
+        return CONSTRUCT_OP2(PIC_IR_STRREF);
+      }
+      else if (sym == state->rBLOBREF) {
+        ARGC_ASSERT(2);
+        return CONSTRUCT_OP2(PIC_IR_BLOBREF);
+      }
+      else if (sym == state->rBLOBSET) {
+        ARGC_ASSERT(3);
+        return CONSTRUCT_OP3(PIC_IR_BLOBSET);
+      }
+      else if (sym == state->rEQP) {
+        ARGC_ASSERT(2);
+        return CONSTRUCT_OP2(PIC_IR_EQP);
+      }
+      else if (sym == state->rEQVP) {
+        ARGC_ASSERT(2);
+        return CONSTRUCT_OP2(PIC_IR_EQVP);
+      }
+      else if (sym == state->rCHAREQ) {
+        ARGC_ASSERT_WITH_FALLBACK(2);
+        return CONSTRUCT_OP2(PIC_IR_CHAREQ);
       }
       else if (sym == state->rVALUES) {
         return analyze_values(state, obj, tailpos);
@@ -835,23 +903,31 @@ analyze_node(analyze_state *state, pic_value obj, bool tailpos)
     return analyze_call(state, obj, tailpos);
   }
   default:
-    return pic_list2(pic, pic_obj_value(pic->sQUOTE), obj);
+    return pic_ir_quote(pic, state->arena, obj);
   }
 }
 
-pic_value
-pic_analyze(pic_state *pic, pic_value obj)
+pic_ir *
+pic_analyze(pic_state *pic, pic_ir_arena *arena, pic_value obj)
 {
   analyze_state *state;
+  pic_ir *body, *ir;
 
-  state = new_analyze_state(pic);
+  /* symbols and constants in the tree are taken from the expanded form */
+  pic_ir_protect(pic, arena, obj);
 
-  obj = analyze(state, obj, true);
+  state = new_analyze_state(pic, arena);
+
+  body = analyze(state, obj, true);
 
   analyze_deferred(state);
 
   destroy_analyze_state(state);
-  return obj;
+
+  /* a toplevel expression is compiled as the body of a nullary procedure */
+  ir = pic_ir_make_lambda(pic, arena, NULL, false);
+  pic_ir_lambda(ir)->body = body;
+  return ir;
 }
 
 /**
@@ -859,13 +935,19 @@ pic_analyze(pic_state *pic, pic_value obj)
  */
 
 typedef struct codegen_context {
+  struct pic_ir_lambda *lambda;
   pic_sym *name;
   /* rest args variable is counted as a local */
   bool varg;
-  xvect args, locals, captures;
+  pic_ir_vars args, locals, captures;
+  /* register index of args and locals, index of captures */
+  xhash regs, caps;
   /* actual bit code sequence */
   pic_code *code;
   size_t clen, ccapa;
+  /* source line of each instruction, and of the node being compiled */
+  int *lines;
+  int line;
   /* child ireps */
   struct pic_irep **irep;
   size_t ilen, icapa;
@@ -875,6 +957,9 @@ typedef struct codegen_context {
   /* symbol pool */
   pic_sym **syms;
   size_t slen, scapa;
+  xhash symidx;
+  /* refers to variables of an enclosing lambda */
+  bool freevars;
 
   struct codegen_context *up;
 } codegen_context;
@@ -886,9 +971,14 @@ typedef struct codegen_context {
 typedef struct codegen_state {
   pic_state *pic;
   codegen_context *cxt;
+  struct pic_data *arena;       /* where inner lambdas are left for later, or NULL */
+  bool lazy;                    /* some lambda was left for later */
+  int tier;                     /* of the code generated */
+  struct pic_ir_lambda *wanted; /* lambda whose irep is to be kept in found, or NULL */
+  struct pic_irep *found;
 } codegen_state;
 
-static void push_codegen_context(codegen_state *, pic_value, pic_value, pic_value, bool, pic_value);
+static void push_codegen_context(codegen_state *, struct pic_ir_lambda *);
 static struct pic_irep *pop_codegen_context(codegen_state *);
 
 static codegen_state *
@@ -899,26 +989,24 @@ new_codegen_state(pic_state *pic)
   state = pic_alloc(pic, sizeof(codegen_state));
   state->pic = pic;
   state->cxt = NULL;
-
-  push_codegen_context(state, pic_false_value(), pic_nil_value(), pic_nil_value(), false, pic_nil_value());
+  state->arena = NULL;
+  state->lazy = false;
+  state->tier = 1;
+  state->wanted = NULL;
+  state->found = NULL;
 
   return state;
 }
 
-static struct pic_irep *
+static void
 destroy_codegen_state(codegen_state *state)
 {
-  pic_state *pic = state->pic;
-  struct pic_irep *irep;
-
-  irep = pop_codegen_context(state);
-  pic_free(pic, state);
-
-  return irep;
+  pic_free(state->pic, state);
 }
 
-static void
-emit_n(codegen_state *state, enum pic_opcode insn)
+/* appends an instruction, of the source line being compiled */
+static pic_code *
+emit(codegen_state *state, enum pic_opcode insn)
 {
   pic_state *pic = state->pic;
   codegen_context *cxt = state->cxt;
@@ -926,82 +1014,70 @@ emit_n(codegen_state *state, enum pic_opcode insn)
   if (cxt->clen >= cxt->ccapa) {
     cxt->ccapa *= 2;
     cxt->code = pic_realloc(pic, cxt->code, sizeof(pic_code) * cxt->ccapa);
+    cxt->lines = pic_realloc(pic, cxt->lines, sizeof(int) * cxt->ccapa);
   }
   cxt->code[cxt->clen].insn = insn;
-  cxt->clen++;
+  cxt->lines[cxt->clen] = cxt->line;
+  return &cxt->code[cxt->clen++];
 }
 
 static void
-emit_i(codegen_state *state, enum pic_opcode insn, int i)
+emit_n(codegen_state *state, enum pic_opcode insn)
 {
-  pic_state *pic = state->pic;
-  codegen_context *cxt = state->cxt;
+  emit(state, insn)->u.i = 0;
+}
 
-  if (cxt->clen >= cxt->ccapa) {
-    cxt->ccapa *= 2;
-    cxt->code = pic_realloc(pic, cxt->code, sizeof(pic_code) * cxt->ccapa);
-  }
-  cxt->code[cxt->clen].insn = insn;
-  cxt->code[cxt->clen].u.i = i;
-  cxt->clen++;
+static void
+emit_i(codegen_state *state, enum pic_opcode insn, int i)
+{
+  emit(state, insn)->u.i = i;
 }
 
 static void
 emit_c(codegen_state *state, enum pic_opcode insn, char c)
 {
-  pic_state *pic = state->pic;
-  codegen_context *cxt = state->cxt;
-
-  if (cxt->clen >= cxt->ccapa) {
-    cxt->ccapa *= 2;
-    cxt->code = pic_realloc(pic, cxt->code, sizeof(pic_code) * cxt->ccapa);
-  }
-  cxt->code[cxt->clen].insn = insn;
-  cxt->code[cxt->clen].u.c = c;
-  cxt->clen++;
+  emit(state, insn)->u.c = c;
 }
 
 static void
 emit_r(codegen_state *state, enum pic_opcode insn, int d, int i)
 {
-  pic_state *pic = state->pic;
-  codegen_context *cxt = state->cxt;
+  pic_code *code = emit(state, insn);
 
-  if (cxt->clen >= cxt->ccapa) {
-    cxt->ccapa *= 2;
-    cxt->code = pic_realloc(pic, cxt->code, sizeof(pic_code) * cxt->ccapa);
+  code->u.r.depth = d;
+  code->u.r.idx = i;
+}
+
+/* the first occurrence of a variable wins, as in a linear search */
+static void
+put_index(xhash *h, pic_sym *sym, size_t i)
+{
+  if (xh_get_ptr(h, sym) == NULL) {
+    xh_put_ptr(h, sym, &i);
   }
-  cxt->code[cxt->clen].insn = insn;
-  cxt->code[cxt->clen].u.r.depth = d;
-  cxt->code[cxt->clen].u.r.idx = i;
-  cxt->clen++;
 }
 
 static void
 create_activation(codegen_state *state)
 {
-  pic_state *pic = state->pic;
   codegen_context *cxt = state->cxt;
   size_t i, n;
-  xhash regs;
   size_t offset;
 
-  xh_init_ptr(&regs, sizeof(size_t));
-
   offset = 1;
-  for (i = 0; i < xv_size(cxt->args); ++i) {
-    n = i + offset;
-    xh_put_ptr(&regs, xv_A(cxt->args, i), &n);
+  for (i = 0; i < cxt->args.n; ++i) {
+    put_index(&cxt->regs, cxt->args.v[i], i + offset);
   }
   offset += i;
-  for (i = 0; i < xv_size(cxt->locals); ++i) {
-    n = i + offset;
-    xh_put_ptr(&regs, xv_A(cxt->locals, i), &n);
+  for (i = 0; i < cxt->locals.n; ++i) {
+    put_index(&cxt->regs, cxt->locals.v[i], i + offset);
   }
 
-  for (i = 0; i < xv_size(cxt->captures); ++i) {
-    n = xh_val(xh_get_ptr(&regs, xv_A(cxt->captures, i)), size_t);
-    if (n <= xv_size(cxt->args) || (cxt->varg && n == xv_size(cxt->args) + 1)) {
+  for (i = 0; i < cxt->captures.n; ++i) {
+    put_index(&cxt->caps, cxt->captures.v[i], i);
+
+    n = xh_val(xh_get_ptr(&cxt->regs, cxt->captures.v[i]), size_t);
+    if (n <= cxt->args.n || (cxt->varg && n == cxt->args.n + 1)) {
       /* copy arguments to capture variable area */
       emit_i(state, OP_LREF, (int)n);
     } else {
@@ -1009,43 +1085,32 @@ create_activation(codegen_state *state)
       emit_n(state, OP_PUSHNONE);
     }
   }
-
-  xh_destroy(&regs);
 }
 
 static void
-push_codegen_context(codegen_state *state, pic_value name, pic_value args, pic_value locals, bool varg, pic_value captures)
+push_codegen_context(codegen_state *state, struct pic_ir_lambda *lambda)
 {
   pic_state *pic = state->pic;
   codegen_context *cxt;
-  pic_value var, it;
-
-  assert(pic_sym_p(name) || pic_false_p(name));
 
   cxt = pic_alloc(pic, sizeof(codegen_context));
   cxt->up = state->cxt;
-  cxt->name = pic_false_p(name)
+  cxt->lambda = lambda;
+  cxt->name = lambda->name == NULL
     ? pic_intern_cstr(pic, "(anonymous lambda)")
-    : pic_sym_ptr(name);
-  cxt->varg = varg;
-
-  xv_init(cxt->args);
-  xv_init(cxt->locals);
-  xv_init(cxt->captures);
+    : lambda->name;
+  cxt->varg = lambda->varg;
 
-  pic_for_each (var, args, it) {
-    xv_push_sym(cxt->args, pic_sym_ptr(var));
-  }
-  pic_for_each (var, locals, it) {
-    xv_push_sym(cxt->locals, pic_sym_ptr(var));
-  }
-  pic_for_each (var, captures, it) {
-    xv_push_sym(cxt->captures, pic_sym_ptr(var));
-  }
+  /* the variable lists live in the ir arena until codegen is over */
+  cxt->args = lambda->args;
+  cxt->locals = lambda->locals;
+  cxt->captures = lambda->captures;
 
   cxt->code = pic_calloc(pic, PIC_ISEQ_SIZE, sizeof(pic_code));
   cxt->clen = 0;
   cxt->ccapa = PIC_ISEQ_SIZE;
+  cxt->lines = pic_calloc(pic, PIC_ISEQ_SIZE, sizeof(int));
+  cxt->line = cxt->up != NULL ? cxt->up->line : 0;
 
   cxt->irep = pic_calloc(pic, PIC_IREP_SIZE, sizeof(struct pic_irep *));
   cxt->ilen = 0;
@@ -1059,11 +1124,189 @@ push_codegen_context(codegen_state *state, pic_value name, pic_value args, pic_v
   cxt->slen = 0;
   cxt->scapa = PIC_SYMS_SIZE;
 
+  xh_init_ptr(&cxt->regs, sizeof(size_t));
+  xh_init_ptr(&cxt->caps, sizeof(size_t));
+  xh_init_ptr(&cxt->symidx, sizeof(size_t));
+
+  cxt->freevars = false;
+
   state->cxt = cxt;
 
   create_activation(state);
 }
 
+/**
+ * peephole optimization
+ */
+
+static bool
+jump_p(pic_code c)
+{
+  return c.insn == OP_JMP || c.insn == OP_JMPIF || c.insn == OP_JMPIFNOT;
+}
+
+/* instructions that push a value and have no other effect */
+static bool
+push_p(pic_code c)
+{
+  switch (c.insn) {
+  case OP_PUSHNIL: case OP_PUSHTRUE: case OP_PUSHFALSE: case OP_PUSHINT:
+  case OP_PUSHCHAR: case OP_PUSHCONST: case OP_LREF: case OP_CREF:
+    return true;
+  default:
+    return false;
+  }
+}
+
+/* final destination of a jump chain starting at i */
+static size_t
+jump_dest(codegen_context *cxt, size_t i)
+{
+  size_t t = i + cxt->code[i].u.i, n;
+
+  for (n = 0; t < cxt->clen && cxt->code[t].insn == OP_JMP && n < cxt->clen; ++n) {
+    t += cxt->code[t].u.i;
+  }
+  return t;
+}
+
+/* returns true if the code got shorter */
+static bool
+peephole(codegen_state *state)
+{
+  pic_state *pic = state->pic;
+  codegen_context *cxt = state->cxt;
+  size_t i, j, t, *pos, *work, wlen;
+  char *target, *live;
+  pic_code *code = cxt->code;
+  size_t clen = cxt->clen;
+
+  if (clen == 0) {
+    return false;
+  }
+
+  target = pic_calloc(pic, clen + 1, sizeof(char));
+  live = pic_calloc(pic, clen, sizeof(char));
+  pos = pic_calloc(pic, clen + 1, sizeof(size_t));
+  work = pic_calloc(pic, clen, sizeof(size_t));
+
+  /* thread jump chains, returning directly instead of jumping to a return */
+  for (i = 0; i < clen; ++i) {
+    if (! jump_p(code[i])) {
+      continue;
+    }
+    t = jump_dest(cxt, i);
+    if (code[i].insn == OP_JMP && t < clen && code[t].insn == OP_RET) {
+      code[i] = code[t];
+      continue;
+    }
+    code[i].u.i = (int)t - (int)i;
+  }
+
+  for (i = 0; i < clen; ++i) {
+    if (jump_p(code[i])) {
+      target[i + code[i].u.i] = 1;
+    }
+  }
+
+  for (i = 0; i + 1 < clen; ++i) {
+    if (target[i + 1]) {
+      continue;
+    }
+    /* NOT; JMPIF -> JMPIFNOT */
+    if (code[i].insn == OP_NOT && (code[i + 1].insn == OP_JMPIF || code[i + 1].insn == OP_JMPIFNOT)) {
+      code[i + 1].insn = code[i + 1].insn == OP_JMPIF ? OP_JMPIFNOT : OP_JMPIF;
+      code[i].insn = OP_NOP;
+    }
+    /* a value pushed only to be discarded */
+    else if (push_p(code[i]) && code[i + 1].insn == OP_POP) {
+      code[i].insn = OP_NOP;
+      code[i + 1].insn = OP_NOP;
+    }
+  }
+
+  /* find reachable instructions */
+  wlen = 0;
+  work[wlen++] = 0;
+  live[0] = 1;
+  while (wlen > 0) {
+    i = work[--wlen];
+    t = jump_p(code[i]) ? i + code[i].u.i : clen;
+    if (t < clen && ! live[t]) {
+      live[t] = 1;
+      work[wlen++] = t;
+    }
+    switch (code[i].insn) {
+    case OP_JMP: case OP_RET: case OP_TAILCALL: case OP_STOP:
+      break;
+    default:
+      if (i + 1 < clen && ! live[i + 1]) {
+        live[i + 1] = 1;
+        work[wlen++] = i + 1;
+      }
+    }
+  }
+
+  /* drop nops, unreachable code and jumps to the next instruction */
+  for (i = 0; i < clen; ++i) {
+    if (code[i].insn == OP_NOP || (code[i].insn == OP_JMP && code[i].u.i == 1)) {
+      live[i] = 0;
+    }
+  }
+  for (i = 0, j = 0; i < clen; ++i) {
+    pos[i] = j;
+    j += live[i];
+  }
+  pos[clen] = j;
+
+  for (i = 0, j = 0; i < clen; ++i) {
+    if (! live[i]) {
+      continue;
+    }
+    if (jump_p(code[i])) {
+      code[i].u.i = (int)pos[i + code[i].u.i] - (int)j;
+    }
+    cxt->lines[j] = cxt->lines[i];
+    code[j++] = code[i];
+  }
+  cxt->clen = j;
+
+  pic_free(pic, target);
+  pic_free(pic, live);
+  pic_free(pic, pos);
+  pic_free(pic, work);
+
+  return cxt->clen < clen;
+}
+
+/* an entry wherever the line changes */
+static void
+create_lines(codegen_state *state, struct pic_irep *irep)
+{
+  codegen_context *cxt = state->cxt;
+  size_t i, n;
+  int line;
+
+  n = 0;
+  for (i = 0, line = 0; i < cxt->clen; line = cxt->lines[i++]) {
+    n += cxt->lines[i] != line;
+  }
+
+  irep->lines = n == 0 ? NULL : pic_alloc(state->pic, sizeof(struct pic_line) * n);
+  irep->llen = n;
+
+  n = 0;
+  for (i = 0, line = 0; i < cxt->clen; line = cxt->lines[i++]) {
+    if (cxt->lines[i] != line) {
+      irep->lines[n].pc = (int)i;
+      irep->lines[n].line = cxt->lines[i];
+      n++;
+    }
+  }
+
+  pic_free(state->pic, cxt->lines);
+}
+
 static struct pic_irep *
 pop_codegen_context(codegen_state *state)
 {
@@ -1071,13 +1314,17 @@ pop_codegen_context(codegen_state *state)
   codegen_context *cxt = state->cxt;
   struct pic_irep *irep;
 
+  /* removing code may turn jumps into ones to the next instruction */
+  while (peephole(state))
+    ;
+
   /* create irep */
   irep = (struct pic_irep *)pic_obj_alloc(pic, sizeof(struct pic_irep), PIC_TT_IREP);
   irep->name = state->cxt->name;
   irep->varg = state->cxt->varg;
-  irep->argc = (int)xv_size(state->cxt->args) + 1;
-  irep->localc = (int)xv_size(state->cxt->locals);
-  irep->capturec = (int)xv_size(state->cxt->captures);
+  irep->argc = (int)state->cxt->args.n + 1;
+  irep->localc = (int)state->cxt->locals.n;
+  irep->capturec = (int)state->cxt->captures.n;
   irep->code = pic_realloc(pic, state->cxt->code, sizeof(pic_code) * state->cxt->clen);
   irep->clen = state->cxt->clen;
   irep->irep = pic_realloc(pic, state->cxt->irep, sizeof(struct pic_irep *) * state->cxt->ilen);
@@ -1086,11 +1333,22 @@ pop_codegen_context(codegen_state *state)
   irep->plen = state->cxt->plen;
   irep->syms = pic_realloc(pic, state->cxt->syms, sizeof(pic_sym *) * state->cxt->slen);
   irep->slen = state->cxt->slen;
+  create_lines(state, irep);
+#if PIC_LAZY_CODEGEN
+  irep->ir = NULL;
+  irep->lazy = NULL;
+#endif
+  irep->tier = state->tier;
+  irep->calls = irep->loops = 0;
+  irep->source = pic_undef_value();
+  irep->tiered = NULL;
+  irep->jit = NULL;
+  irep->jit_failed = false;
 
   /* finalize */
-  xv_destroy(cxt->args);
-  xv_destroy(cxt->locals);
-  xv_destroy(cxt->captures);
+  xh_destroy(&cxt->regs);
+  xh_destroy(&cxt->caps);
+  xh_destroy(&cxt->symidx);
 
   /* destroy context */
   cxt = cxt->up;
@@ -1104,36 +1362,28 @@ static int
 index_capture(codegen_state *state, pic_sym *sym, int depth)
 {
   codegen_context *cxt = state->cxt;
-  size_t i;
+  xh_entry *e;
 
   while (depth-- > 0) {
     cxt = cxt->up;
   }
 
-  for (i = 0; i < xv_size(cxt->captures); ++i) {
-    if (xv_A(cxt->captures, i) == sym)
-      return (int)i;
+  if ((e = xh_get_ptr(&cxt->caps, sym)) == NULL) {
+    return -1;
   }
-  return -1;
+  return (int)xh_val(e, size_t);
 }
 
 static int
 index_local(codegen_state *state, pic_sym *sym)
 {
   codegen_context *cxt = state->cxt;
-  size_t i, offset;
+  xh_entry *e;
 
-  offset = 1;
-  for (i = 0; i < xv_size(cxt->args); ++i) {
-    if (xv_A(cxt->args, i) == sym)
-      return (int)(i + offset);
+  if ((e = xh_get_ptr(&cxt->regs, sym)) == NULL) {
+    return -1;
   }
-  offset += i;
-  for (i = 0; i < xv_size(cxt->locals); ++i) {
-    if (xv_A(cxt->locals, i) == sym)
-      return (int)(i + offset);
-  }
-  return -1;
+  return (int)xh_val(e, size_t);
 }
 
 static int
@@ -1141,95 +1391,222 @@ index_symbol(codegen_state *state, pic_sym *sym)
 {
   pic_state *pic = state->pic;
   codegen_context *cxt = state->cxt;
-  size_t i;
+  xh_entry *e;
 
-  for (i = 0; i < cxt->slen; ++i) {
-    if (cxt->syms[i] == sym) {
-      return i;
-    }
+  if ((e = xh_get_ptr(&cxt->symidx, sym)) != NULL) {
+    return (int)xh_val(e, size_t);
   }
   if (cxt->slen >= cxt->scapa) {
     cxt->scapa *= 2;
     cxt->syms = pic_realloc(pic, cxt->syms, sizeof(pic_sym *) * cxt->scapa);
   }
-  cxt->syms[cxt->slen++] = sym;
-  return i;
+  put_index(&cxt->symidx, sym, cxt->slen);
+  cxt->syms[cxt->slen] = sym;
+  return (int)cxt->slen++;
 }
 
-static struct pic_irep *codegen_lambda(codegen_state *, pic_value);
-
 static void
-codegen(codegen_state *state, pic_value obj)
+mark_freevars(codegen_state *state, int depth)
 {
-  pic_state *pic = state->pic;
   codegen_context *cxt = state->cxt;
-  pic_sym *sym;
-
-  sym = pic_sym_ptr(pic_car(pic, obj));
-  if (sym == pic->sGREF) {
-    emit_i(state, OP_GREF, index_symbol(state, pic_sym_ptr(pic_list_ref(pic, obj, 1))));
-    return;
-  } else if (sym == pic->sCREF) {
-    pic_sym *name;
-    int depth;
-
-    depth = pic_int(pic_list_ref(pic, obj, 1));
-    name  = pic_sym_ptr(pic_list_ref(pic, obj, 2));
-    emit_r(state, OP_CREF, depth, index_capture(state, name, depth));
-    return;
-  } else if (sym == pic->sLREF) {
-    pic_sym *name;
-    int i;
 
-    name = pic_sym_ptr(pic_list_ref(pic, obj, 1));
-    if ((i = index_capture(state, name, 0)) != -1) {
-      emit_i(state, OP_LREF, i + (int)xv_size(cxt->args) + (int)xv_size(cxt->locals) + 1);
+  while (depth-- > 0) {
+    cxt->freevars = true;
+    cxt = cxt->up;
+  }
+}
+
+static int
+push_const(codegen_state *state, pic_value obj)
+{
+  pic_state *pic = state->pic;
+  codegen_context *cxt = state->cxt;
+
+  if (cxt->plen >= cxt->pcapa) {
+    cxt->pcapa *= 2;
+    cxt->pool = pic_realloc(pic, cxt->pool, sizeof(pic_value) * cxt->pcapa);
+  }
+  cxt->pool[cxt->plen] = obj;
+  return (int)cxt->plen++;
+}
+
+static struct pic_irep *codegen_lambda(codegen_state *, pic_ir *, bool *);
+#if PIC_LAZY_CODEGEN
+static struct pic_irep *codegen_stub(codegen_state *, pic_ir *, bool *);
+#endif
+
+static void codegen(codegen_state *, pic_ir *);
+
+/* operations whose operands are known to have the right type */
+static void
+codegen_unsafe(codegen_state *state, pic_ir *ir)
+{
+  pic_state *pic = state->pic;
+
+  switch (ir->kind) {
+  case PIC_IR_CAR:
+  case PIC_IR_CDR:
+    codegen(state, pic_ir_elt(ir, 0));
+    emit_n(state, (ir->kind == PIC_IR_CAR ? OP_CAR_UNSAFE : OP_CDR_UNSAFE));
+    return;
+  case PIC_IR_GT:
+  case PIC_IR_GE:
+    codegen(state, pic_ir_elt(ir, 1));
+    codegen(state, pic_ir_elt(ir, 0));
+    emit_n(state, (ir->kind == PIC_IR_GT ? OP_LT_FX : OP_LE_FX));
+    return;
+  default:
+    break;
+  }
+  codegen(state, pic_ir_elt(ir, 0));
+  codegen(state, pic_ir_elt(ir, 1));
+  switch (ir->kind) {
+  case PIC_IR_ADD:
+    emit_n(state, OP_ADD_FX);
+    return;
+  case PIC_IR_SUB:
+    emit_n(state, OP_SUB_FX);
+    return;
+  case PIC_IR_MUL:
+    emit_n(state, OP_MUL_FX);
+    return;
+  case PIC_IR_EQ:
+    emit_n(state, OP_EQ_FX);
+    return;
+  case PIC_IR_LT:
+    emit_n(state, OP_LT_FX);
+    return;
+  case PIC_IR_LE:
+    emit_n(state, OP_LE_FX);
+    return;
+  default:
+    pic_errorf(pic, "codegen: unknown unsafe operation ~s", pic_ir_to_list(pic, ir));
+  }
+}
+
+static void
+codegen_op1(codegen_state *state, pic_ir *ir, enum pic_opcode insn)
+{
+  codegen(state, pic_ir_elt(ir, 0));
+  emit_n(state, insn);
+}
+
+static void
+codegen_op2(codegen_state *state, pic_ir *ir, enum pic_opcode insn)
+{
+  codegen(state, pic_ir_elt(ir, 0));
+  codegen(state, pic_ir_elt(ir, 1));
+  emit_n(state, insn);
+}
+
+static void
+codegen_op3(codegen_state *state, pic_ir *ir, enum pic_opcode insn)
+{
+  codegen(state, pic_ir_elt(ir, 0));
+  codegen(state, pic_ir_elt(ir, 1));
+  codegen(state, pic_ir_elt(ir, 2));
+  emit_n(state, insn);
+}
+
+static void
+codegen_node(codegen_state *state, pic_ir *ir)
+{
+  pic_state *pic = state->pic;
+  codegen_context *cxt = state->cxt;
+  size_t i;
+
+  if (ir->unsafe) {
+    codegen_unsafe(state, ir);
+    return;
+  }
+
+  switch (ir->kind) {
+  case PIC_IR_GREF: {
+    emit_i(state, OP_GREF, index_symbol(state, pic_ir_sym(ir)));
+    return;
+  }
+  case PIC_IR_CREF: {
+    int depth = pic_ir_depth(ir);
+
+    emit_r(state, OP_CREF, depth, index_capture(state, pic_ir_sym(ir), depth));
+    mark_freevars(state, depth);
+    return;
+  }
+  case PIC_IR_LREF: {
+    int k;
+
+    if ((k = index_capture(state, pic_ir_sym(ir), 0)) != -1) {
+      emit_i(state, OP_LREF, k + (int)cxt->args.n + (int)cxt->locals.n + 1);
       return;
     }
-    emit_i(state, OP_LREF, index_local(state, name));
+    emit_i(state, OP_LREF, index_local(state, pic_ir_sym(ir)));
     return;
-  } else if (sym == pic->sSETBANG) {
-    pic_value var, val;
-    pic_sym *type;
+  }
+  case PIC_IR_SETBANG: {
+    pic_ir *var;
 
-    val = pic_list_ref(pic, obj, 2);
-    codegen(state, val);
+    codegen(state, pic_ir_elt(ir, 1));
 
-    var = pic_list_ref(pic, obj, 1);
-    type = pic_sym_ptr(pic_list_ref(pic, var, 0));
-    if (type == pic->sGREF) {
-      emit_i(state, OP_GSET, index_symbol(state, pic_sym_ptr(pic_list_ref(pic, var, 1))));
+    var = pic_ir_elt(ir, 0);
+    switch (var->kind) {
+    case PIC_IR_GREF: {
+      emit_i(state, OP_GSET, index_symbol(state, pic_ir_sym(var)));
       emit_n(state, OP_PUSHNONE);
       return;
     }
-    else if (type == pic->sCREF) {
-      pic_sym *name;
-      int depth;
+    case PIC_IR_CREF: {
+      int depth = pic_ir_depth(var);
 
-      depth = pic_int(pic_list_ref(pic, var, 1));
-      name  = pic_sym_ptr(pic_list_ref(pic, var, 2));
-      emit_r(state, OP_CSET, depth, index_capture(state, name, depth));
+      emit_r(state, OP_CSET, depth, index_capture(state, pic_ir_sym(var), depth));
       emit_n(state, OP_PUSHNONE);
+      mark_freevars(state, depth);
       return;
     }
-    else if (type == pic->sLREF) {
-      pic_sym *name;
-      int i;
+    case PIC_IR_LREF: {
+      int k;
 
-      name = pic_sym_ptr(pic_list_ref(pic, var, 1));
-      if ((i = index_capture(state, name, 0)) != -1) {
-        emit_i(state, OP_LSET, i + (int)xv_size(cxt->args) + (int)xv_size(cxt->locals) + 1);
+      if ((k = index_capture(state, pic_ir_sym(var), 0)) != -1) {
+        emit_i(state, OP_LSET, k + (int)cxt->args.n + (int)cxt->locals.n + 1);
         emit_n(state, OP_PUSHNONE);
         return;
       }
-      emit_i(state, OP_LSET, index_local(state, name));
+      emit_i(state, OP_LSET, index_local(state, pic_ir_sym(var)));
       emit_n(state, OP_PUSHNONE);
       return;
     }
+    default:
+      break;
+    }
+    break;
   }
-  else if (sym == pic->sLAMBDA) {
+  case PIC_IR_LAMBDA: {
+    struct pic_irep *irep;
+    bool closed;
     int k;
 
+#if PIC_LAZY_CODEGEN
+    if (state->arena != NULL) {
+      irep = codegen_stub(state, ir, &closed);
+    } else
+#endif
+      irep = codegen_lambda(state, ir, &closed);
+
+    if (pic_ir_lambda(ir) == state->wanted) {
+      state->found = irep;
+    }
+
+    /* a procedure without free variables is created once and for all */
+    if (closed) {
+#if PIC_TIER_THRESHOLD
+      /* and can be optimized on its own later */
+      if (state->tier == 0) {
+        irep->source = pic_ir_lambda(ir)->source;
+      }
+#endif
+      emit_i(state, OP_PUSHCONST, push_const(state, pic_obj_value(pic_make_proc_irep(pic, irep, NULL))));
+      return;
+    }
+
     if (cxt->ilen >= cxt->icapa) {
       cxt->icapa *= 2;
       cxt->irep = pic_realloc(pic, cxt->irep, sizeof(struct pic_irep *) * cxt->icapa);
@@ -1237,20 +1614,20 @@ codegen(codegen_state *state, pic_value obj)
     k = (int)cxt->ilen++;
     emit_i(state, OP_LAMBDA, k);
 
-    cxt->irep[k] = codegen_lambda(state, obj);
+    cxt->irep[k] = irep;
     return;
   }
-  else if (sym == pic->sIF) {
+  case PIC_IR_IF: {
     int s, t;
 
-    codegen(state, pic_list_ref(pic, obj, 1));
+    codegen(state, pic_ir_elt(ir, 0));
 
     s = (int)cxt->clen;
 
     emit_n(state, OP_JMPIF);
 
     /* if false branch */
-    codegen(state, pic_list_ref(pic, obj, 3));
+    codegen(state, pic_ir_elt(ir, 2));
 
     t = (int)cxt->clen;
 
@@ -1259,26 +1636,22 @@ codegen(codegen_state *state, pic_value obj)
     cxt->code[s].u.i = (int)cxt->clen - s;
 
     /* if true branch */
-    codegen(state, pic_list_ref(pic, obj, 2));
+    codegen(state, pic_ir_elt(ir, 1));
     cxt->code[t].u.i = (int)cxt->clen - t;
     return;
   }
-  else if (sym == pic->sBEGIN) {
-    pic_value elt, it;
-    int i = 0;
-
-    pic_for_each (elt, pic_cdr(pic, obj), it) {
-      if (i++ != 0) {
+  case PIC_IR_BEGIN: {
+    for (i = 0; i < pic_ir_len(ir); ++i) {
+      if (i != 0) {
         emit_n(state, OP_POP);
       }
-      codegen(state, elt);
+      codegen(state, pic_ir_elt(ir, i));
     }
     return;
   }
-  else if (sym == pic->sQUOTE) {
-    int pidx;
+  case PIC_IR_QUOTE: {
+    pic_value obj = ir->u.quote;
 
-    obj = pic_list_ref(pic, obj, 1);
     switch (pic_type(obj)) {
     case PIC_TT_BOOL:
       emit_n(state, (pic_true_p(obj) ? OP_PUSHTRUE : OP_PUSHFALSE));
@@ -1293,185 +1666,548 @@ codegen(codegen_state *state, pic_value obj)
       emit_c(state, OP_PUSHCHAR, pic_char(obj));
       return;
     default:
-      if (cxt->plen >= cxt->pcapa) {
-        cxt->pcapa *= 2;
-        cxt->pool = pic_realloc(pic, cxt->pool, sizeof(pic_value) * cxt->pcapa);
-      }
-      pidx = (int)cxt->plen++;
-      cxt->pool[pidx] = obj;
-      emit_i(state, OP_PUSHCONST, pidx);
+      emit_i(state, OP_PUSHCONST, push_const(state, obj));
       return;
     }
   }
-  else if (sym == pic->sCONS) {
-    codegen(state, pic_list_ref(pic, obj, 1));
-    codegen(state, pic_list_ref(pic, obj, 2));
-    emit_n(state, OP_CONS);
+  case PIC_IR_CONS:
+    codegen_op2(state, ir, OP_CONS);
     return;
-  }
-  else if (sym == pic->sCAR) {
-    codegen(state, pic_list_ref(pic, obj, 1));
-    emit_n(state, OP_CAR);
+  case PIC_IR_CAR:
+    codegen_op1(state, ir, OP_CAR);
     return;
-  }
-  else if (sym == pic->sCDR) {
-    codegen(state, pic_list_ref(pic, obj, 1));
-    emit_n(state, OP_CDR);
+  case PIC_IR_CDR:
+    codegen_op1(state, ir, OP_CDR);
     return;
-  }
-  else if (sym == pic->sNILP) {
-    codegen(state, pic_list_ref(pic, obj, 1));
-    emit_n(state, OP_NILP);
+  case PIC_IR_NILP:
+    codegen_op1(state, ir, OP_NILP);
     return;
-  }
-  else if (sym == pic->sSYMBOLP) {
-    codegen(state, pic_list_ref(pic, obj, 1));
-    emit_n(state, OP_SYMBOLP);
+  case PIC_IR_SYMBOLP:
+    codegen_op1(state, ir, OP_SYMBOLP);
     return;
-  }
-  else if (sym == pic->sPAIRP) {
-    codegen(state, pic_list_ref(pic, obj, 1));
-    emit_n(state, OP_PAIRP);
+  case PIC_IR_PAIRP:
+    codegen_op1(state, ir, OP_PAIRP);
     return;
-  }
-  else if (sym == pic->sADD) {
-    codegen(state, pic_list_ref(pic, obj, 1));
-    codegen(state, pic_list_ref(pic, obj, 2));
-    emit_n(state, OP_ADD);
+  case PIC_IR_ADD:
+    codegen_op2(state, ir, OP_ADD);
     return;
-  }
-  else if (sym == pic->sSUB) {
-    codegen(state, pic_list_ref(pic, obj, 1));
-    codegen(state, pic_list_ref(pic, obj, 2));
-    emit_n(state, OP_SUB);
+  case PIC_IR_SUB:
+    codegen_op2(state, ir, OP_SUB);
     return;
-  }
-  else if (sym == pic->sMUL) {
-    codegen(state, pic_list_ref(pic, obj, 1));
-    codegen(state, pic_list_ref(pic, obj, 2));
-    emit_n(state, OP_MUL);
+  case PIC_IR_MUL:
+    codegen_op2(state, ir, OP_MUL);
     return;
-  }
-  else if (sym == pic->sDIV) {
-    codegen(state, pic_list_ref(pic, obj, 1));
-    codegen(state, pic_list_ref(pic, obj, 2));
-    emit_n(state, OP_DIV);
+  case PIC_IR_DIV:
+    codegen_op2(state, ir, OP_DIV);
     return;
-  }
-  else if (sym == pic->sMINUS) {
-    codegen(state, pic_list_ref(pic, obj, 1));
-    emit_n(state, OP_MINUS);
+  case PIC_IR_MINUS:
+    codegen_op1(state, ir, OP_MINUS);
     return;
-  }
-  else if (sym == pic->sEQ) {
-    codegen(state, pic_list_ref(pic, obj, 1));
-    codegen(state, pic_list_ref(pic, obj, 2));
-    emit_n(state, OP_EQ);
+  case PIC_IR_EQ:
+    codegen_op2(state, ir, OP_EQ);
     return;
-  }
-  else if (sym == pic->sLT) {
-    codegen(state, pic_list_ref(pic, obj, 1));
-    codegen(state, pic_list_ref(pic, obj, 2));
-    emit_n(state, OP_LT);
+  case PIC_IR_LT:
+    codegen_op2(state, ir, OP_LT);
     return;
-  }
-  else if (sym == pic->sLE) {
-    codegen(state, pic_list_ref(pic, obj, 1));
-    codegen(state, pic_list_ref(pic, obj, 2));
-    emit_n(state, OP_LE);
+  case PIC_IR_LE:
+    codegen_op2(state, ir, OP_LE);
     return;
-  }
-  else if (sym == pic->sGT) {
-    codegen(state, pic_list_ref(pic, obj, 2));
-    codegen(state, pic_list_ref(pic, obj, 1));
+  case PIC_IR_GT:
+    codegen(state, pic_ir_elt(ir, 1));
+    codegen(state, pic_ir_elt(ir, 0));
     emit_n(state, OP_LT);
     return;
-  }
-  else if (sym == pic->sGE) {
-    codegen(state, pic_list_ref(pic, obj, 2));
-    codegen(state, pic_list_ref(pic, obj, 1));
+  case PIC_IR_GE:
+    codegen(state, pic_ir_elt(ir, 1));
+    codegen(state, pic_ir_elt(ir, 0));
     emit_n(state, OP_LE);
     return;
-  }
-  else if (sym == pic->sNOT) {
-    codegen(state, pic_list_ref(pic, obj, 1));
-    emit_n(state, OP_NOT);
+  case PIC_IR_NOT:
+    codegen_op1(state, ir, OP_NOT);
     return;
-  }
-  else if (sym == pic->sCALL || sym == pic->sTAILCALL) {
-    int len = (int)pic_length(pic, obj);
-    pic_value elt, it;
-
-    pic_for_each (elt, pic_cdr(pic, obj), it) {
-      codegen(state, elt);
+  case PIC_IR_VECREF:
+    codegen_op2(state, ir, OP_VECREF);
+    return;
+  case PIC_IR_VECSET:
+    codegen_op3(state, ir, OP_VECSET);
+    return;
+  case PIC_IR_VECLEN:
+    codegen_op1(state, ir, OP_VECLEN);
+    return;
+  case PIC_IR_STRREF:
+    codegen_op2(state, ir, OP_STRREF);
+    return;
+  case PIC_IR_BLOBREF:
+    codegen_op2(state, ir, OP_BLOBREF);
+    return;
+  case PIC_IR_BLOBSET:
+    codegen_op3(state, ir, OP_BLOBSET);
+    return;
+  case PIC_IR_EQP:
+    codegen_op2(state, ir, OP_EQP);
+    return;
+  case PIC_IR_EQVP:
+    codegen_op2(state, ir, OP_EQVP);
+    return;
+  case PIC_IR_CHAREQ:
+    codegen_op2(state, ir, OP_CHAREQ);
+    return;
+  case PIC_IR_CALL:
+  case PIC_IR_TAILCALL: {
+    for (i = 0; i < pic_ir_len(ir); ++i) {
+      codegen(state, pic_ir_elt(ir, i));
     }
-    emit_i(state, (sym == pic->sCALL ? OP_CALL : OP_TAILCALL), len - 1);
+    emit_i(state, (ir->kind == PIC_IR_CALL ? OP_CALL : OP_TAILCALL), (int)pic_ir_len(ir));
     return;
   }
-  else if (sym == pic->sCALL_WITH_VALUES || sym == pic->sTAILCALL_WITH_VALUES) {
+  case PIC_IR_CALL_WITH_VALUES:
+  case PIC_IR_TAILCALL_WITH_VALUES: {
     /* stack consumer at first */
-    codegen(state, pic_list_ref(pic, obj, 2));
-    codegen(state, pic_list_ref(pic, obj, 1));
+    codegen(state, pic_ir_elt(ir, 1));
+    codegen(state, pic_ir_elt(ir, 0));
     /* call producer */
     emit_i(state, OP_CALL, 1);
     /* call consumer */
-    emit_i(state, (sym == pic->sCALL_WITH_VALUES ? OP_CALL : OP_TAILCALL), -1);
+    emit_i(state, (ir->kind == PIC_IR_CALL_WITH_VALUES ? OP_CALL : OP_TAILCALL), -1);
     return;
   }
-  else if (sym == pic->sRETURN) {
-    int len = (int)pic_length(pic, obj);
-    pic_value elt, it;
-
-    pic_for_each (elt, pic_cdr(pic, obj), it) {
-      codegen(state, elt);
+  case PIC_IR_RETURN: {
+    for (i = 0; i < pic_ir_len(ir); ++i) {
+      codegen(state, pic_ir_elt(ir, i));
     }
-    emit_i(state, OP_RET, len - 1);
+    emit_i(state, OP_RET, (int)pic_ir_len(ir));
     return;
   }
-  pic_errorf(pic, "codegen: unknown AST type ~s", obj);
+  }
+  pic_errorf(pic, "codegen: unknown AST type ~s", pic_ir_to_list(pic, ir));
 }
 
-static struct pic_irep *
-codegen_lambda(codegen_state *state, pic_value obj)
+/* the instructions of a node are of its line, the ones left to its parent of the parent's */
+static void
+codegen(codegen_state *state, pic_ir *ir)
 {
-  pic_state *pic = state->pic;
-  pic_value name, args, locals, closes, body;
-  bool varg;
+  codegen_context *cxt = state->cxt;
+  int line = cxt->line;
+
+  if (ir->line != 0) {
+    cxt->line = ir->line;
+  }
+  codegen_node(state, ir);
+  cxt->line = line;
+}
 
-  name = pic_list_ref(pic, obj, 1);
-  args = pic_list_ref(pic, obj, 2);
-  locals = pic_list_ref(pic, obj, 3);
-  varg = pic_true_p(pic_list_ref(pic, obj, 4));
-  closes = pic_list_ref(pic, obj, 5);
-  body = pic_list_ref(pic, obj, 6);
+static struct pic_irep *
+codegen_lambda(codegen_state *state, pic_ir *ir, bool *closed)
+{
+  struct pic_ir_lambda *lambda = pic_ir_lambda(ir);
 
   /* inner environment */
-  push_codegen_context(state, name, args, locals, varg, closes);
+  push_codegen_context(state, lambda);
   {
     /* body */
-    codegen(state, body);
+    codegen(state, lambda->body);
   }
+  *closed = ! state->cxt->freevars;
   return pop_codegen_context(state);
 }
 
 struct pic_irep *
-pic_codegen(pic_state *pic, pic_value obj)
+pic_codegen(pic_state *pic, pic_ir *ir, struct pic_data *arena, int tier)
+{
+  codegen_state *state;
+  struct pic_irep *irep;
+  bool closed;
+
+  state = new_codegen_state(pic);
+  state->tier = tier;
+#if PIC_LAZY_CODEGEN
+  state->arena = arena;
+#else
+  (void)arena;
+#endif
+
+  irep = codegen_lambda(state, ir, &closed);
+
+#if PIC_LAZY_CODEGEN
+  /* the stubs need the nodes after the compilation is over */
+  if (state->lazy) {
+    pic_ir_keep(pic, pic_ir_arena_ptr(arena), ir);
+  }
+#endif
+
+  destroy_codegen_state(state);
+
+  return irep;
+}
+
+#if PIC_LAZY_CODEGEN
+
+/**
+ * lazy code generation
+ */
+
+/*
+ * An inner lambda is not compiled together with the procedure that
+ * creates it. Its irep starts as a stub that knows the arity of the
+ * lambda and points to its nodes, which stay in the arena of the
+ * toplevel form. The code is generated on the first call, when the
+ * captured variables of the enclosing lambdas are still known from
+ * their nodes. Procedures that are never called cost no code at all.
+ */
+
+/* how many levels up the farthest variable referred to by ir lives, counted from the lambda at level */
+static int
+escape_depth(pic_ir *ir, int level)
+{
+  int d, max = 0;
+  size_t i;
+
+  switch (ir->kind) {
+  case PIC_IR_QUOTE:
+  case PIC_IR_GREF:
+  case PIC_IR_LREF:
+    return 0;
+  case PIC_IR_CREF:
+    return pic_ir_depth(ir) - level;
+  case PIC_IR_LAMBDA:
+    return escape_depth(pic_ir_lambda(ir)->body, level + 1);
+  default:
+    for (i = 0; i < pic_ir_len(ir); ++i) {
+      if ((d = escape_depth(pic_ir_elt(ir, i), level)) > max) {
+        max = d;
+      }
+    }
+    return max;
+  }
+}
+
+static struct pic_irep *
+codegen_stub(codegen_state *state, pic_ir *ir, bool *closed)
+{
+  pic_state *pic = state->pic;
+  pic_ir_arena *arena = pic_ir_arena_ptr(state->arena);
+  struct pic_ir_lambda *lambda = pic_ir_lambda(ir);
+  struct pic_ir_lazy *lazy;
+  struct pic_irep *irep;
+  codegen_context *cxt;
+  pic_sym *name;
+  int depth;
+  size_t i;
+
+  lazy = pic_ir_alloc(pic, arena, sizeof(struct pic_ir_lazy));
+  lazy->lambda = lambda;
+  lazy->depth = 0;
+  for (cxt = state->cxt; cxt != NULL; cxt = cxt->up) {
+    lazy->depth++;
+  }
+  lazy->up = pic_ir_alloc(pic, arena, sizeof(struct pic_ir_lambda *) * lazy->depth);
+  for (i = 0, cxt = state->cxt; cxt != NULL; cxt = cxt->up) {
+    lazy->up[i++] = cxt->lambda;
+  }
+
+  /* what mark_freevars would have recorded had the body been compiled now */
+  depth = escape_depth(lambda->body, 0);
+  *closed = depth == 0;
+  mark_freevars(state, depth - 1);
+
+  name = lambda->name == NULL
+    ? pic_intern_cstr(pic, "(anonymous lambda)")
+    : lambda->name;
+
+  irep = (struct pic_irep *)pic_obj_alloc(pic, sizeof(struct pic_irep), PIC_TT_IREP);
+  irep->name = name;
+  irep->varg = lambda->varg;
+  irep->argc = (int)lambda->args.n + 1;
+  irep->localc = (int)lambda->locals.n;
+  irep->capturec = (int)lambda->captures.n;
+  irep->code = NULL;
+  irep->irep = NULL;
+  irep->pool = NULL;
+  irep->syms = NULL;
+  irep->clen = irep->ilen = irep->plen = irep->slen = 0;
+  irep->lines = NULL;
+  irep->llen = 0;
+  irep->ir = state->arena;
+  irep->lazy = lazy;
+  irep->tier = state->tier;
+  irep->calls = irep->loops = 0;
+  irep->source = pic_undef_value();
+  irep->tiered = NULL;
+  irep->jit = NULL;
+  irep->jit_failed = false;
+
+  arena->pending++;
+  state->lazy = true;
+
+  return irep;
+}
+
+/* only the captured variables of an enclosing lambda are looked at */
+static void
+push_outer_context(codegen_state *state, struct pic_ir_lambda *lambda)
+{
+  pic_state *pic = state->pic;
+  codegen_context *cxt;
+  size_t i;
+
+  cxt = pic_alloc(pic, sizeof(codegen_context));
+  cxt->up = state->cxt;
+  cxt->lambda = lambda;
+  cxt->line = 0;
+  cxt->freevars = false;
+  xh_init_ptr(&cxt->regs, sizeof(size_t));
+  xh_init_ptr(&cxt->caps, sizeof(size_t));
+  xh_init_ptr(&cxt->symidx, sizeof(size_t));
+
+  for (i = 0; i < lambda->captures.n; ++i) {
+    put_index(&cxt->caps, lambda->captures.v[i], i);
+  }
+
+  state->cxt = cxt;
+}
+
+static void
+pop_outer_context(codegen_state *state)
+{
+  codegen_context *cxt = state->cxt;
+
+  xh_destroy(&cxt->regs);
+  xh_destroy(&cxt->caps);
+  xh_destroy(&cxt->symidx);
+
+  state->cxt = cxt->up;
+  pic_free(state->pic, cxt);
+}
+
+void
+pic_codegen_lazy(pic_state *pic, struct pic_irep *irep)
 {
+  struct pic_ir_lazy *lazy = irep->lazy;
   codegen_state *state;
+  struct pic_irep *code;
+  size_t i, ai = pic_gc_arena_preserve(pic);
 
   state = new_codegen_state(pic);
+  state->arena = irep->ir;
+  state->tier = irep->tier;
+
+  for (i = lazy->depth; i > 0; --i) {
+    push_outer_context(state, lazy->up[i - 1]);
+  }
+  push_codegen_context(state, lazy->lambda);
+  codegen(state, lazy->lambda->body);
+  code = pop_codegen_context(state);
+  for (i = 0; i < lazy->depth; ++i) {
+    pop_outer_context(state);
+  }
+
+  destroy_codegen_state(state);
+
+  /* move the code into the stub, which the callers already refer to */
+  irep->code = code->code;
+  irep->clen = code->clen;
+  irep->irep = code->irep;
+  irep->ilen = code->ilen;
+  irep->pool = code->pool;
+  irep->plen = code->plen;
+  irep->syms = code->syms;
+  irep->slen = code->slen;
+  irep->lines = code->lines;
+  irep->llen = code->llen;
+  code->code = NULL;
+  code->irep = NULL;
+  code->pool = NULL;
+  code->syms = NULL;
+  code->lines = NULL;
+  code->clen = code->ilen = code->plen = code->slen = code->llen = 0;
+
+  /* the nodes are dropped once every lambda in them is compiled */
+  if (--pic_ir_arena_ptr(irep->ir)->pending == 0) {
+    pic_ir_arena_release(pic, pic_ir_arena_ptr(irep->ir));
+  }
+  irep->ir = NULL;
+  irep->lazy = NULL;
+
+  pic_gc_arena_restore(pic, ai);
+}
+
+#endif
+
+/**
+ * compile cache
+ */
+
+/*
+ * pic_eval is often given the same forms again and again. The code compiled
+ * for a form is remembered together with its library, and found again by
+ * comparing the structure of the form. Forms that quote a pair are compiled
+ * every time. Macro transformers are not run again on a hit, so constants
+ * they build are shared between the hits.
+ */
+
+#if PIC_COMPILE_CACHE_SIZE
+
+/* bigger forms are compiled every time */
+#define CACHE_MAX_NODES 256
+
+static size_t
+cache_hash(pic_state *pic, pic_value obj, int *budget)
+{
+  size_t h = pic_type(obj);
+
+  if (--*budget < 0) {
+    return 0;
+  }
+
+  switch (pic_type(obj)) {
+  case PIC_TT_PAIR:
+    h = h * 31 + cache_hash(pic, pic_car(pic, obj), budget);
+    return h * 31 + cache_hash(pic, pic_cdr(pic, obj), budget);
+  case PIC_TT_INT:
+    return h * 31 + (size_t)pic_int(obj);
+  case PIC_TT_CHAR:
+    return h * 31 + (size_t)pic_char(obj);
+  case PIC_TT_BOOL:
+    return h * 31 + pic_true_p(obj);
+  default:
+    return pic_obj_p(obj) ? h * 31 + (size_t)pic_ptr(obj) / sizeof(void *) : h;
+  }
+}
+
+static struct pic_cache_entry *
+cache_slot(pic_state *pic, pic_value form, struct pic_lib *lib, size_t *hash)
+{
+  int budget = CACHE_MAX_NODES;
+
+  if (pic->cache == NULL) {
+    return NULL;
+  }
+
+  *hash = cache_hash(pic, form, &budget) * 31 + (size_t)lib / sizeof(void *);
+  if (budget < 0) {
+    return NULL;
+  }
+  return &pic->cache[*hash % PIC_COMPILE_CACHE_SIZE];
+}
+
+#else
+
+static struct pic_cache_entry *
+cache_slot(pic_state *pic, pic_value form, struct pic_lib *lib, size_t *hash)
+{
+  PIC_UNUSED(pic);
+  PIC_UNUSED(form);
+  PIC_UNUSED(lib);
+  PIC_UNUSED(hash);
+
+  return NULL;
+}
+
+#endif
+
+/*
+ * Only pairs are compared by structure. Any other object is compared by
+ * identity, because the code of a hit refers to the literals of the form
+ * it was compiled from.
+ */
+static bool
+cache_equal_p(pic_state *pic, pic_value x, pic_value y)
+{
+  if (pic_pair_p(x) && pic_pair_p(y)) {
+    return cache_equal_p(pic, pic_car(pic, x), pic_car(pic, y))
+      && cache_equal_p(pic, pic_cdr(pic, x), pic_cdr(pic, y));
+  }
+  return pic_eqv_p(x, y);
+}
+
+/* the caller may mutate the form afterwards, so the key is a copy of its spine */
+static pic_value
+cache_copy(pic_state *pic, pic_value obj)
+{
+  pic_value car, cdr;
+
+  if (! pic_pair_p(obj)) {
+    return obj;
+  }
+  car = cache_copy(pic, pic_car(pic, obj));
+  cdr = cache_copy(pic, pic_cdr(pic, obj));
+  return pic_cons(pic, car, cdr);
+}
+
+/* a quoted pair of one form would be returned for another form equal to it */
+static bool
+cache_quotes_pair_p(pic_ir *ir)
+{
+  size_t i;
+
+  switch (ir->kind) {
+  case PIC_IR_QUOTE:
+    return pic_pair_p(ir->u.quote);
+  case PIC_IR_GREF:
+  case PIC_IR_LREF:
+  case PIC_IR_CREF:
+    return false;
+  case PIC_IR_LAMBDA:
+    return cache_quotes_pair_p(pic_ir_lambda(ir)->body);
+  default:
+    for (i = 0; i < pic_ir_len(ir); ++i) {
+      if (cache_quotes_pair_p(pic_ir_elt(ir, i))) {
+        return true;
+      }
+    }
+    return false;
+  }
+}
+
+static bool
+cache_hit_p(pic_state *pic, struct pic_cache_entry *slot, size_t hash, pic_value form, struct pic_lib *lib)
+{
+  return slot->irep != NULL
+    && slot->hash == hash
+    && slot->lib == lib
+    && slot->nglobals == pic_dict_size(pic, pic->globals)
+    && cache_equal_p(pic, slot->form, form);
+}
+
+/* called whenever macros or top-level bindings change */
+void
+pic_cache_invalidate(pic_state *pic)
+{
+  size_t i;
 
-  codegen(state, obj);
+  pic->cache_epoch++;
 
-  return destroy_codegen_state(state);
+  if (pic->cache == NULL) {
+    return;
+  }
+  for (i = 0; i < PIC_COMPILE_CACHE_SIZE; ++i) {
+    pic->cache[i].form = pic_nil_value();
+    pic->cache[i].lib = NULL;
+    pic->cache[i].irep = NULL;
+  }
 }
 
 struct pic_proc *
 pic_compile(pic_state *pic, pic_value obj, struct pic_lib *lib)
 {
   struct pic_irep *irep;
+  struct pic_cache_entry *slot;
+  struct pic_data *data;
+  pic_ir_arena *arena;
+  pic_ir *ir;
+  pic_value form = obj, key;
+  size_t hash = 0, epoch;
+  int tier = pic->tiering ? 0 : 1;
   size_t ai = pic_gc_arena_preserve(pic);
 
+  slot = cache_slot(pic, form, lib, &hash);
+  if (slot != NULL && cache_hit_p(pic, slot, hash, form, lib)) {
+    pic->cache_hits++;
+    return pic_make_proc_irep(pic, slot->irep, NULL);
+  }
+  pic->cache_misses++;
+  epoch = pic->cache_epoch;
+
 #if DEBUG
   fprintf(stdout, "ai = %zu\n", pic_gc_arena_preserve(pic));
 
@@ -1491,17 +2227,35 @@ pic_compile(pic_state *pic, pic_value obj, struct pic_lib *lib)
   fprintf(stdout, "ai = %zu\n", pic_gc_arena_preserve(pic));
 #endif
 
+  /* stays in the gc arena until the end, or is collected if compilation fails */
+  data = pic_ir_arena_new(pic);
+  arena = pic_ir_arena_ptr(data);
+
   /* analyze */
-  obj = pic_analyze(pic, obj);
+  ir = pic_analyze(pic, arena, obj);
+  if (slot != NULL && cache_quotes_pair_p(ir)) {
+    slot = NULL;
+  }
 #if DEBUG
   fprintf(stdout, "## analyzer completed\n");
-  pic_debug(pic, obj);
+  pic_debug(pic, pic_ir_to_list(pic, ir));
+  fprintf(stdout, "\n");
+  fprintf(stdout, "ai = %zu\n", pic_gc_arena_preserve(pic));
+#endif
+
+  /* optimize, unless hot procedures are optimized later on their own */
+  if (tier > 0) {
+    ir = pic_optimize(pic, arena, ir);
+  }
+#if DEBUG
+  fprintf(stdout, "## optimizer completed\n");
+  pic_debug(pic, pic_ir_to_list(pic, ir));
   fprintf(stdout, "\n");
   fprintf(stdout, "ai = %zu\n", pic_gc_arena_preserve(pic));
 #endif
 
   /* codegen */
-  irep = pic_codegen(pic, obj);
+  irep = pic_codegen(pic, ir, data, tier);
 #if DEBUG
   fprintf(stdout, "## codegen completed\n");
   pic_dump_irep(irep);
@@ -1512,8 +2266,114 @@ pic_compile(pic_state *pic, pic_value obj, struct pic_lib *lib)
   puts("");
 #endif
 
+  /* unless some lambda was left to be compiled later */
+  if (arena->root == NULL) {
+    pic_ir_arena_release(pic, arena);
+  }
+
+  /* a form whose expansion defined macros or bindings is not worth keeping */
+  if (slot != NULL && epoch == pic->cache_epoch) {
+    key = cache_copy(pic, form);
+    slot->hash = hash;
+    slot->form = key;
+    slot->lib = lib;
+    slot->nglobals = pic_dict_size(pic, pic->globals);
+    slot->irep = irep;
+  }
+
   pic_gc_arena_restore(pic, ai);
   pic_gc_protect(pic, pic_obj_value(irep));
 
   return pic_make_proc_irep(pic, irep, NULL);
 }
+
+/**
+ * tiered compilation
+ */
+
+/*
+ * With PIC_TIER_THRESHOLD set, forms evaluated after the libraries are
+ * loaded (see pic->tiering) are compiled without optimization.
+ * Each closed procedure remembers its expanded lambda expression, and
+ * the VM counts its calls and the tail calls it makes to itself. Once
+ * they reach the threshold the expression is compiled again through the
+ * optimizer, and calls made from then on run the new code. Activations
+ * already running stay on the old code, which is not modified.
+ */
+
+/* the first lambda in the analyzed thunk is the lambda expression itself */
+static struct pic_ir_lambda *
+tier_find_lambda(pic_ir *ir)
+{
+  struct pic_ir_lambda *lambda;
+  size_t i;
+
+  switch (ir->kind) {
+  case PIC_IR_QUOTE:
+  case PIC_IR_GREF:
+  case PIC_IR_LREF:
+  case PIC_IR_CREF:
+    return NULL;
+  case PIC_IR_LAMBDA:
+    return pic_ir_lambda(ir);
+  default:
+    for (i = 0; i < pic_ir_len(ir); ++i) {
+      if ((lambda = tier_find_lambda(pic_ir_elt(ir, i))) != NULL) {
+        return lambda;
+      }
+    }
+    return NULL;
+  }
+}
+
+/* compiles the thunk, and returns the irep of the given lambda in it */
+static struct pic_irep *
+tier_codegen(pic_state *pic, pic_ir *ir, struct pic_ir_lambda *lambda)
+{
+  codegen_state *state;
+  struct pic_irep *irep;
+  bool closed;
+
+  state = new_codegen_state(pic);
+  state->wanted = lambda;
+
+  codegen_lambda(state, ir, &closed);
+  irep = state->found;
+
+  destroy_codegen_state(state);
+
+  return irep;
+}
+
+void
+pic_tier_up(pic_state *pic, struct pic_irep *irep)
+{
+  struct pic_data *data;
+  struct pic_ir_lambda *lambda;
+  struct pic_irep *code;
+  pic_ir *ir;
+  size_t ai = pic_gc_arena_preserve(pic);
+
+  data = pic_ir_arena_new(pic);
+
+  pic_try {
+    ir = pic_analyze(pic, pic_ir_arena_ptr(data), irep->source);
+    lambda = tier_find_lambda(pic_ir_lambda(ir)->body);
+    ir = pic_optimize(pic, pic_ir_arena_ptr(data), ir);
+    code = tier_codegen(pic, ir, lambda);
+  }
+  pic_catch {
+    code = NULL;
+  }
+  pic_ir_arena_release(pic, pic_ir_arena_ptr(data));
+
+  /* not tried again either way */
+  irep->source = pic_undef_value();
+
+  if (code != NULL && code->argc == irep->argc && code->varg == irep->varg) {
+    code->name = irep->name;
+    irep->tiered = code;
+  }
+
+  pic_gc_arena_restore(pic, ai);
+}
@@ -6,8 +6,28 @@
 #include "picrin/proc.h"
 #include "picrin/cont.h"
 #include "picrin/pair.h"
+#include "picrin/vector.h"
 #include "picrin/data.h"
 #include "picrin/error.h"
+#include "picrin/var.h"
+
+/* exchange the values bound by parameterize with the current ones */
+static void
+wind_swap(struct pic_winder *wind)
+{
+  pic_value *binds, tmp;
+  size_t i;
+
+  if (wind->binds == NULL)
+    return;
+
+  binds = wind->binds->data;
+  for (i = 0; i < wind->binds->len; i += 2) {
+    tmp = pic_var_ptr(binds[i])->value;
+    pic_var_ptr(binds[i])->value = binds[i + 1];
+    binds[i + 1] = tmp;
+  }
+}
 
 void
 pic_wind(pic_state *pic, struct pic_winder *here, struct pic_winder *there)
@@ -17,10 +37,18 @@ pic_wind(pic_state *pic, struct pic_winder *here, struct pic_winder *there)
 
   if (here->depth < there->depth) {
     pic_wind(pic, here, there->prev);
-    pic_apply0(pic, there->in);
+    if (there->in != NULL) {
+      pic_apply0(pic, there->in);
+    }
+    wind_swap(there);
+    pic->wind = there;
   }
   else {
-    pic_apply0(pic, there->out);
+    pic->wind = here->prev;
+    wind_swap(here);
+    if (here->out != NULL) {
+      pic_apply0(pic, here->out);
+    }
     pic_wind(pic, here->prev, there);
   }
 }
@@ -29,7 +57,8 @@ pic_value
 pic_dynamic_wind(pic_state *pic, struct pic_proc *in, struct pic_proc *thunk, struct pic_proc *out)
 {
   struct pic_winder *here;
-  pic_value val;
+  ptrdiff_t vals;
+  int retc;
 
   if (in != NULL) {
     pic_apply0(pic, in);        /* enter */
@@ -41,16 +70,50 @@ pic_dynamic_wind(pic_state *pic, struct pic_proc *in, struct pic_proc *thunk, st
   pic->wind->depth = here->depth + 1;
   pic->wind->in = in;
   pic->wind->out = out;
+  pic->wind->binds = NULL;
 
-  val = pic_apply0(pic, thunk);
+  pic_apply0(pic, thunk);
 
   pic->wind = here;
 
+  /* the values of thunk stay on the stack while out runs above them */
+  retc = pic->ci[1].retc;
+  vals = pic->ci[1].fp - pic->stbase;
+  pic->sp = pic->ci[1].fp + retc;
+
   if (out != NULL) {
     pic_apply0(pic, out);       /* exit */
   }
 
-  return val;
+  pic->sp = pic->stbase + vals;
+
+  return pic_values_by_array(pic, (size_t)retc, pic->sp);
+}
+
+pic_value
+pic_dynamic_bind(pic_state *pic, struct pic_vector *binds, struct pic_proc *thunk)
+{
+  struct pic_winder *here, *wind;
+
+  here = pic->wind;
+  wind = pic_alloc(pic, sizeof(struct pic_winder));
+  wind->prev = here;
+  wind->depth = here->depth + 1;
+  wind->in = wind->out = NULL;
+  wind->binds = binds;
+
+  wind_swap(wind);
+  pic->wind = wind;
+
+  pic_apply0(pic, thunk);
+
+  pic->wind = here;
+  wind_swap(wind);
+
+  /* no escape point can refer to the winder once its extent is over */
+  pic_free(pic, wind);
+
+  return pic_values_by_array(pic, (size_t)pic->ci[1].retc, pic->ci[1].fp);
 }
 
 void
@@ -63,10 +126,12 @@ pic_save_point(pic_state *pic, struct pic_escape *escape)
   escape->sp_offset = pic->sp - pic->stbase;
   escape->ci_offset = pic->ci - pic->cibase;
   escape->xp_offset = pic->xp - pic->xpbase;
+  escape->tp_offset = pic->tp - pic->tpbase;
   escape->arena_idx = pic->arena_idx;
   escape->ip = pic->ip;
 
-  escape->results = pic_undef_value();
+  escape->results_offset = 0;
+  escape->resultc = 0;
 }
 
 void
@@ -80,9 +145,9 @@ pic_load_point(pic_state *pic, struct pic_escape *escape)
 
   /* load runtime context */
   pic->wind = escape->wind;
-  pic->sp = pic->stbase + escape->sp_offset;
-  pic->ci = pic->cibase + escape->ci_offset;
+  pic_vm_escape(pic, escape->sp_offset, escape->ci_offset);
   pic->xp = pic->xpbase + escape->xp_offset;
+  pic->tp = pic->tpbase + escape->tp_offset;
   pic->arena_idx = escape->arena_idx;
   pic->ip = escape->ip;
 
@@ -99,7 +164,10 @@ escape_call(pic_state *pic)
   pic_get_args(pic, "*", &argc, &argv);
 
   e = pic_data_ptr(pic_attr_ref(pic, pic_obj_value(pic_get_proc(pic)), "@@escape"));
-  ((struct pic_escape *)e->data)->results = pic_list_by_array(pic, argc, argv);
+
+  /* the values stay on the stack, above the point to go back to */
+  ((struct pic_escape *)e->data)->results_offset = argv - pic->stbase;
+  ((struct pic_escape *)e->data)->resultc = argc;
 
   pic_load_point(pic, e->data);
 
@@ -133,53 +201,74 @@ pic_escape(pic_state *pic, struct pic_proc *proc)
   pic_save_point(pic, escape);
 
   if (PIC_SETJMP(pic, (void *)escape->jmp)) {
-    return pic_values_by_list(pic, escape->results);
+    return pic_values_by_array(pic, escape->resultc, pic->stbase + escape->results_offset);
   }
   else {
-    pic_value val;
-
-    val = pic_apply1(pic, proc, pic_obj_value(pic_make_econt(pic, escape)));
+    pic_apply1(pic, proc, pic_obj_value(pic_make_econt(pic, escape)));
 
     escape->valid = false;
 
-    return val;
+    /* pass on every value proc returned, still sitting in its frame */
+    return pic_values_by_array(pic, (size_t)pic->ci[1].retc, pic->ci[1].fp);
   }
 }
 
 pic_value
 pic_values0(pic_state *pic)
 {
-  return pic_values_by_list(pic, pic_nil_value());
+  return pic_values_by_array(pic, 0, NULL);
 }
 
 pic_value
 pic_values1(pic_state *pic, pic_value arg1)
 {
-  return pic_values_by_list(pic, pic_list1(pic, arg1));
+  return pic_values_by_array(pic, 1, &arg1);
 }
 
 pic_value
 pic_values2(pic_state *pic, pic_value arg1, pic_value arg2)
 {
-  return pic_values_by_list(pic, pic_list2(pic, arg1, arg2));
+  pic_value argv[2];
+
+  argv[0] = arg1;
+  argv[1] = arg2;
+  return pic_values_by_array(pic, 2, argv);
 }
 
 pic_value
 pic_values3(pic_state *pic, pic_value arg1, pic_value arg2, pic_value arg3)
 {
-  return pic_values_by_list(pic, pic_list3(pic, arg1, arg2, arg3));
+  pic_value argv[3];
+
+  argv[0] = arg1;
+  argv[1] = arg2;
+  argv[2] = arg3;
+  return pic_values_by_array(pic, 3, argv);
 }
 
 pic_value
 pic_values4(pic_state *pic, pic_value arg1, pic_value arg2, pic_value arg3, pic_value arg4)
 {
-  return pic_values_by_list(pic, pic_list4(pic, arg1, arg2, arg3, arg4));
+  pic_value argv[4];
+
+  argv[0] = arg1;
+  argv[1] = arg2;
+  argv[2] = arg3;
+  argv[3] = arg4;
+  return pic_values_by_array(pic, 4, argv);
 }
 
 pic_value
 pic_values5(pic_state *pic, pic_value arg1, pic_value arg2, pic_value arg3, pic_value arg4, pic_value arg5)
 {
-  return pic_values_by_list(pic, pic_list5(pic, arg1, arg2, arg3, arg4, arg5));
+  pic_value argv[5];
+
+  argv[0] = arg1;
+  argv[1] = arg2;
+  argv[2] = arg3;
+  argv[3] = arg4;
+  argv[4] = arg5;
+  return pic_values_by_array(pic, 5, argv);
 }
 
 pic_value
@@ -187,6 +276,8 @@ pic_values_by_array(pic_state *pic, size_t argc, pic_value *argv)
 {
   size_t i;
 
+  pic_vm_reserve(pic, argc);
+
   for (i = 0; i < argc; ++i) {
     pic->sp[i] = argv[i];
   }
@@ -201,6 +292,8 @@ pic_values_by_list(pic_state *pic, pic_value list)
   pic_value v, it;
   int i;
 
+  pic_vm_reserve(pic, pic_length(pic, list));
+
   i = 0;
   pic_for_each (v, list, it) {
     pic->sp[i++] = v;
@@ -262,16 +355,13 @@ static pic_value
 pic_cont_call_with_values(pic_state *pic)
 {
   struct pic_proc *producer, *consumer;
-  size_t argc;
-  pic_value args[256];
 
   pic_get_args(pic, "ll", &producer, &consumer);
 
-  pic_apply(pic, producer, pic_nil_value());
-
-  argc = pic_receive(pic, 256, args);
+  pic_apply0(pic, producer);
 
-  return pic_apply_trampoline(pic, consumer, pic_list_by_array(pic, argc, args));
+  /* the values are left where the producer was called */
+  return pic_apply_trampolinev(pic, consumer, (size_t)pic->ci[1].retc, pic->ci[1].fp);
 }
 
 void
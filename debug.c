@@ -6,33 +6,106 @@
 #include "picrin/string.h"
 #include "picrin/error.h"
 #include "picrin/proc.h"
+#include "picrin/irep.h"
 
-pic_str *
-pic_get_backtrace(pic_state *pic)
+int
+pic_irep_line(struct pic_irep *irep, pic_code *ip)
+{
+  size_t lo = 0, hi = irep->llen, mid;
+  int pc;
+
+  if (ip < irep->code || ip >= irep->code + irep->clen) {
+    return 0;
+  }
+  pc = (int)(ip - irep->code);
+
+  /* the last entry at or before pc */
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (irep->lines[mid].pc <= pc) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo == 0 ? 0 : irep->lines[lo - 1].line;
+}
+
+struct pic_trace *
+pic_capture_backtrace(pic_state *pic, size_t *n)
 {
-  size_t ai = pic_gc_arena_preserve(pic);
   pic_callinfo *ci;
-  pic_str *trace;
+  struct pic_trace *trace;
+  size_t i = 0;
 
-  trace = pic_make_str(pic, NULL, 0);
+  *n = (size_t)(pic->ci - pic->cibase);
+  if (*n == 0) {
+    return NULL;
+  }
+
+  trace = pic_alloc(pic, sizeof(struct pic_trace) * *n);
 
   for (ci = pic->ci; ci != pic->cibase; --ci) {
-    struct pic_proc *proc = pic_proc_ptr(ci->fp[0]);
+    trace[i].proc = pic_proc_ptr(ci->fp[0]);
+    /* a frame below the top one is at the call that made the frame above it */
+    trace[i].line = ci->irep == NULL ? 0 : pic_irep_line(ci->irep, ci == pic->ci ? pic->ip : ci[1].ip);
+    i++;
+  }
 
-    trace = pic_str_cat(pic, trace, pic_make_str_cstr(pic, "  at "));
-    trace = pic_str_cat(pic, trace, pic_make_str_cstr(pic, pic_symbol_name(pic, pic_proc_name(proc))));
+  return trace;
+}
+
+static pic_str *
+render_backtrace(pic_state *pic, struct pic_trace *trace, size_t n)
+{
+  size_t ai = pic_gc_arena_preserve(pic);
+  pic_str *str;
+  size_t i;
+
+  str = pic_make_str(pic, NULL, 0);
+
+  for (i = 0; i < n; ++i) {
+    struct pic_proc *proc = trace[i].proc;
+
+    str = pic_str_cat(pic, str, pic_make_str_cstr(pic, "  at "));
+    str = pic_str_cat(pic, str, pic_make_str_cstr(pic, pic_symbol_name(pic, pic_proc_name(proc))));
 
     if (pic_proc_func_p(proc)) {
-      trace = pic_str_cat(pic, trace, pic_make_str_cstr(pic, " (native function)\n"));
-    } else if (pic_proc_irep_p(proc)) {
-      trace = pic_str_cat(pic, trace, pic_make_str_cstr(pic, " (unknown location)\n")); /* TODO */
+      str = pic_str_cat(pic, str, pic_make_str_cstr(pic, " (native function)\n"));
+    } else if (trace[i].line != 0) {
+      str = pic_str_cat(pic, str, pic_format(pic, " (line %d)\n", trace[i].line));
+    } else {
+      str = pic_str_cat(pic, str, pic_make_str_cstr(pic, " (unknown location)\n"));
     }
   }
 
   pic_gc_arena_restore(pic, ai);
-  pic_gc_protect(pic, pic_obj_value(trace));
+  pic_gc_protect(pic, pic_obj_value(str));
 
-  return trace;
+  return str;
+}
+
+pic_str *
+pic_get_backtrace(pic_state *pic)
+{
+  struct pic_trace *trace;
+  size_t n;
+  pic_str *str;
+
+  trace = pic_capture_backtrace(pic, &n);
+  str = render_backtrace(pic, trace, n);
+  pic_free(pic, trace);
+
+  return str;
+}
+
+pic_str *
+pic_error_backtrace(pic_state *pic, struct pic_error *e)
+{
+  if (e->stack == NULL) {
+    e->stack = render_backtrace(pic, e->trace, e->tracec);
+  }
+  return e->stack;
 }
 
 void
@@ -57,6 +130,6 @@ pic_print_backtrace(pic_state *pic, xFILE *file)
 
     /* TODO: print error irritants */
 
-    xfputs(pic_str_cstr(pic, e->stack), file);
+    xfputs(pic_str_cstr(pic, pic_error_backtrace(pic, e)), file);
   }
 }
@@ -0,0 +1,872 @@
+/**
+ * See Copyright Notice in picrin.h
+ */
+
+#include "picrin.h"
+#include "picrin/pair.h"
+#include "picrin/string.h"
+#include "picrin/vector.h"
+#include "picrin/blob.h"
+#include "picrin/proc.h"
+#include "picrin/irep.h"
+#include "picrin/lib.h"
+#include "picrin/macro.h"
+#include "picrin/dict.h"
+#include "picrin/symbol.h"
+#include "picrin/port.h"
+#include "picrin/error.h"
+
+/*
+ * Serialized irep format
+ *
+ * A record is the magic "PICB", a version byte and one irep tree.
+ * Integers are written as LEB128 varints, signed ones zigzag encoded,
+ * so the format does not depend on the word size or the byte order.
+ *
+ *   irep   name:value argc localc capturec varg:byte
+ *          clen code... llen line... ilen irep... plen value... slen global...
+ *   code   insn operand, where the operand is a char for OP_PUSHCHAR,
+ *          depth and index for OP_CREF/OP_CSET and an int otherwise
+ *   value  tag byte followed by its contents, see enum below
+ *   line   pc and source line of an entry of the line table
+ *   global name of the library and the symbol it is bound to there
+ *
+ * Global variables are compiled into renamed symbols that only exist in
+ * the state that compiled them, so they are written as the binding that
+ * led to them and looked up again when loaded. A binding that is not
+ * found is created, as the toplevel define that made it did at compile
+ * time. Other uninterned symbols keep their identity within a record.
+ */
+
+#define DUMP_MAGIC "PICB"
+#define DUMP_VERSION 3
+
+enum {
+  DUMP_NIL,
+  DUMP_TRUE,
+  DUMP_FALSE,
+  DUMP_UNDEF,
+  DUMP_EOF,
+  DUMP_INT,
+  DUMP_FLOAT,
+  DUMP_CHAR,
+  DUMP_SYMBOL,                  /* interned: name */
+  DUMP_GENSYM,                  /* uninterned: index, then name if new */
+  DUMP_GLOBAL,                  /* library name value, symbol */
+  DUMP_PAIR,
+  DUMP_VECTOR,
+  DUMP_STRING,
+  DUMP_BLOB,
+  DUMP_PROC,                    /* procedure without environment: irep */
+  DUMP_NONE                     /* absent irep name */
+};
+
+/**
+ * writer
+ */
+
+typedef struct {
+  pic_state *pic;
+  xFILE *file;
+  xhash gensyms;                /* uninterned symbol to index */
+  xhash globals;                /* global symbol to its binding */
+} dump_state;
+
+typedef struct {
+  struct pic_lib *lib;
+  pic_sym *name;
+} dump_binding;
+
+/* xfputc and xfgetc give bytes over 0x7f back as negative chars, so go through xfwrite and xfread */
+static void
+dump_byte(dump_state *state, int c)
+{
+  unsigned char b = (unsigned char)c;
+
+  if (xfwrite(&b, 1, 1, state->file) != 1) {
+    pic_errorf(state->pic, "dump: write error");
+  }
+}
+
+static void
+dump_uint(dump_state *state, unsigned long n)
+{
+  while (n >= 0x80) {
+    dump_byte(state, (int)(n & 0x7f) | 0x80);
+    n >>= 7;
+  }
+  dump_byte(state, (int)n);
+}
+
+static void
+dump_int(dump_state *state, long n)
+{
+  dump_uint(state, n < 0 ? ((unsigned long)~n << 1) | 1 : (unsigned long)n << 1);
+}
+
+static void
+dump_bytes(dump_state *state, const void *ptr, size_t len)
+{
+  dump_uint(state, len);
+  if (len > 0 && xfwrite(ptr, 1, len, state->file) != len) {
+    pic_errorf(state->pic, "dump: write error");
+  }
+}
+
+static void
+dump_name(dump_state *state, pic_sym *sym)
+{
+  const char *name = pic_symbol_name(state->pic, sym);
+
+  dump_bytes(state, name, strlen(name));
+}
+
+static void dump_value(dump_state *, pic_value);
+static void dump_irep(dump_state *, struct pic_irep *);
+
+static void
+dump_symbol(dump_state *state, pic_sym *sym)
+{
+  xh_entry *e;
+  int idx;
+
+  if (pic_interned_p(state->pic, sym)) {
+    dump_byte(state, DUMP_SYMBOL);
+    dump_name(state, sym);
+    return;
+  }
+
+  dump_byte(state, DUMP_GENSYM);
+  if ((e = xh_get_ptr(&state->gensyms, sym)) != NULL) {
+    dump_uint(state, (unsigned long)xh_val(e, int));
+    return;
+  }
+  idx = (int)xh_size(&state->gensyms);
+  xh_put_ptr(&state->gensyms, sym, &idx);
+  dump_uint(state, (unsigned long)idx);
+  dump_name(state, sym);
+}
+
+static void
+dump_global(dump_state *state, pic_sym *sym)
+{
+  xh_entry *e;
+  dump_binding *b;
+
+  if ((e = xh_get_ptr(&state->globals, sym)) == NULL) {
+    dump_symbol(state, sym);
+    return;
+  }
+  b = &xh_val(e, dump_binding);
+
+  dump_byte(state, DUMP_GLOBAL);
+  dump_value(state, b->lib->name);
+  dump_name(state, b->name);
+}
+
+static void
+dump_value(dump_state *state, pic_value obj)
+{
+  pic_state *pic = state->pic;
+  struct pic_vector *vec;
+  struct pic_blob *blob;
+  struct pic_proc *proc;
+  const char *str;
+  size_t i;
+
+  switch (pic_type(obj)) {
+  case PIC_TT_NIL:
+    dump_byte(state, DUMP_NIL);
+    break;
+  case PIC_TT_BOOL:
+    dump_byte(state, pic_true_p(obj) ? DUMP_TRUE : DUMP_FALSE);
+    break;
+  case PIC_TT_UNDEF:
+    dump_byte(state, DUMP_UNDEF);
+    break;
+  case PIC_TT_EOF:
+    dump_byte(state, DUMP_EOF);
+    break;
+  case PIC_TT_INT:
+    dump_byte(state, DUMP_INT);
+    dump_int(state, pic_int(obj));
+    break;
+#if PIC_ENABLE_FLOAT
+  case PIC_TT_FLOAT: {
+    double f = pic_float(obj);
+
+    dump_byte(state, DUMP_FLOAT);
+    dump_bytes(state, &f, sizeof f);
+    break;
+  }
+#endif
+  case PIC_TT_CHAR:
+    dump_byte(state, DUMP_CHAR);
+    dump_byte(state, (unsigned char)pic_char(obj));
+    break;
+  case PIC_TT_SYMBOL:
+    dump_symbol(state, pic_sym_ptr(obj));
+    break;
+  case PIC_TT_PAIR:
+    dump_byte(state, DUMP_PAIR);
+    dump_value(state, pic_car(pic, obj));
+    dump_value(state, pic_cdr(pic, obj));
+    break;
+  case PIC_TT_VECTOR:
+    vec = pic_vec_ptr(obj);
+    dump_byte(state, DUMP_VECTOR);
+    dump_uint(state, vec->len);
+    for (i = 0; i < vec->len; ++i) {
+      dump_value(state, vec->data[i]);
+    }
+    break;
+  case PIC_TT_STRING:
+    str = pic_str_cstr(pic, pic_str_ptr(obj));
+    dump_byte(state, DUMP_STRING);
+    dump_bytes(state, str, pic_str_len(pic_str_ptr(obj)));
+    break;
+  case PIC_TT_BLOB:
+    blob = pic_blob_ptr(obj);
+    dump_byte(state, DUMP_BLOB);
+    dump_bytes(state, blob->data, blob->len);
+    break;
+  case PIC_TT_PROC:
+    proc = pic_proc_ptr(obj);
+    if (pic_proc_irep_p(proc) && proc->env == NULL) {
+      dump_byte(state, DUMP_PROC);
+      dump_irep(state, proc->u.irep);
+      break;
+    }
+    /* fall through */
+  default:
+    pic_errorf(pic, "dump: cannot serialize ~s", obj);
+  }
+}
+
+static void
+dump_irep(dump_state *state, struct pic_irep *irep)
+{
+  pic_code c;
+  size_t i;
+
+#if PIC_LAZY_CODEGEN
+  pic_irep_prepare(state->pic, irep);
+#endif
+
+  if (irep->name != NULL) {
+    dump_symbol(state, irep->name);
+  } else {
+    dump_byte(state, DUMP_NONE);
+  }
+  dump_uint(state, (unsigned long)irep->argc);
+  dump_uint(state, (unsigned long)irep->localc);
+  dump_uint(state, (unsigned long)irep->capturec);
+  dump_byte(state, irep->varg);
+
+  dump_uint(state, irep->clen);
+  for (i = 0; i < irep->clen; ++i) {
+    c = irep->code[i];
+    dump_uint(state, (unsigned long)c.insn);
+    switch (c.insn) {
+    case OP_PUSHCHAR:
+      dump_byte(state, (unsigned char)c.u.c);
+      break;
+    case OP_CREF:
+    case OP_CSET:
+      dump_int(state, c.u.r.depth);
+      dump_int(state, c.u.r.idx);
+      break;
+    default:
+      dump_int(state, c.u.i);
+      break;
+    }
+  }
+
+  dump_uint(state, irep->llen);
+  for (i = 0; i < irep->llen; ++i) {
+    dump_uint(state, (unsigned long)irep->lines[i].pc);
+    dump_uint(state, (unsigned long)irep->lines[i].line);
+  }
+
+  dump_uint(state, irep->ilen);
+  for (i = 0; i < irep->ilen; ++i) {
+    dump_irep(state, irep->irep[i]);
+  }
+
+  dump_uint(state, irep->plen);
+  for (i = 0; i < irep->plen; ++i) {
+    dump_value(state, irep->pool[i]);
+  }
+
+  dump_uint(state, irep->slen);
+  for (i = 0; i < irep->slen; ++i) {
+    dump_global(state, irep->syms[i]);
+  }
+}
+
+/* libraries are listed newest first, so the oldest binding of a symbol wins */
+static void
+collect_globals(dump_state *state)
+{
+  pic_state *pic = state->pic;
+  pic_value libs;
+  dump_binding b;
+  pic_sym *sym;
+  xh_entry *it;
+
+  for (libs = pic->libs; pic_pair_p(libs); libs = pic_cdr(pic, libs)) {
+    b.lib = pic_lib_ptr(pic_cdr(pic, pic_car(pic, libs)));
+    pic_dict_for_each (sym, b.lib->env->map, it) {
+      b.name = sym;
+      xh_put_ptr(&state->globals, pic_sym_ptr(pic_dict_ref(pic, b.lib->env->map, sym)), &b);
+    }
+  }
+}
+
+static void
+dump_open(dump_state *state, pic_state *pic, xFILE *file)
+{
+  state->pic = pic;
+  state->file = file;
+  xh_init_ptr(&state->gensyms, sizeof(int));
+  xh_init_ptr(&state->globals, sizeof(dump_binding));
+}
+
+static void
+dump_close(dump_state *state)
+{
+  xh_destroy(&state->gensyms);
+  xh_destroy(&state->globals);
+}
+
+void
+pic_dump_irep_file(pic_state *pic, struct pic_irep *irep, xFILE *file)
+{
+  dump_state state;
+
+  dump_open(&state, pic, file);
+
+  pic_try {
+    collect_globals(&state);
+
+    if (xfwrite(DUMP_MAGIC, 1, 4, file) != 4) {
+      pic_errorf(pic, "dump: write error");
+    }
+    dump_byte(&state, DUMP_VERSION);
+    dump_irep(&state, irep);
+  }
+  pic_catch {
+    dump_close(&state);
+    pic_raise(pic, pic->err);
+  }
+
+  dump_close(&state);
+}
+
+/**
+ * reader
+ */
+
+typedef struct {
+  pic_state *pic;
+  xFILE *file;
+  xvect_t(pic_sym *) gensyms;
+} load_state;
+
+static void
+load_open(load_state *state, pic_state *pic, xFILE *file)
+{
+  state->pic = pic;
+  state->file = file;
+  xv_init(state->gensyms);
+}
+
+static void
+load_close(load_state *state)
+{
+  pic_state *pic = state->pic;
+
+  xv_destroy(state->gensyms);
+}
+
+static int
+load_byte(load_state *state)
+{
+  unsigned char b;
+
+  if (xfread(&b, 1, 1, state->file) != 1) {
+    pic_errorf(state->pic, "load: unexpected end of bytecode");
+  }
+  return b;
+}
+
+static unsigned long
+load_uint(load_state *state)
+{
+  unsigned long n = 0;
+  int c, shift = 0;
+
+  do {
+    c = load_byte(state);
+    n |= (unsigned long)(c & 0x7f) << shift;
+    shift += 7;
+  } while (c & 0x80);
+
+  return n;
+}
+
+static long
+load_int(load_state *state)
+{
+  unsigned long n = load_uint(state);
+
+  return n & 1 ? ~(long)(n >> 1) : (long)(n >> 1);
+}
+
+/* the result is owned by the caller */
+static char *
+load_bytes(load_state *state, size_t *len)
+{
+  char *buf;
+
+  *len = load_uint(state);
+  buf = pic_alloc(state->pic, *len + 1);
+  if (*len > 0 && xfread(buf, 1, *len, state->file) != *len) {
+    pic_free(state->pic, buf);
+    pic_errorf(state->pic, "load: unexpected end of bytecode");
+  }
+  buf[*len] = '\0';
+  return buf;
+}
+
+static pic_str *
+load_str(load_state *state)
+{
+  pic_str *str;
+  size_t len;
+  char *buf;
+
+  buf = load_bytes(state, &len);
+  str = pic_make_str(state->pic, buf, len);
+  pic_free(state->pic, buf);
+  return str;
+}
+
+static struct pic_irep *load_irep(load_state *);
+
+static pic_sym *
+load_gensym(load_state *state)
+{
+  pic_state *pic = state->pic;
+  size_t idx;
+  pic_sym *sym;
+
+  idx = load_uint(state);
+  if (idx < xv_size(state->gensyms)) {
+    return xv_A(state->gensyms, idx);
+  }
+  if (idx != xv_size(state->gensyms)) {
+    pic_errorf(pic, "load: broken symbol table");
+  }
+  sym = pic_make_symbol(pic, load_str(state));
+  xv_push(pic_sym *, state->gensyms, sym);
+  return sym;
+}
+
+static pic_value load_value(load_state *);
+
+static pic_sym *
+load_symbol(load_state *state, int tag)
+{
+  pic_state *pic = state->pic;
+  struct pic_lib *lib;
+  pic_value spec;
+  pic_sym *sym, *rename;
+
+  switch (tag) {
+  case DUMP_SYMBOL:
+    return pic_intern(pic, load_str(state));
+  case DUMP_GENSYM:
+    return load_gensym(state);
+  case DUMP_GLOBAL:
+    spec = load_value(state);
+    sym = pic_intern(pic, load_str(state));
+    if ((lib = pic_find_library(pic, spec)) == NULL) {
+      pic_errorf(pic, "load: library not found: ~s", spec);
+    }
+    if (! pic_find_rename(pic, lib->env, sym, &rename)) {
+      rename = pic_add_rename(pic, lib->env, sym);
+    }
+    return rename;
+  default:
+    pic_errorf(pic, "load: symbol expected");
+  }
+}
+
+static pic_value
+load_value(load_state *state)
+{
+  pic_state *pic = state->pic;
+  struct pic_vector *vec;
+  struct pic_blob *blob;
+  pic_value car, cdr;
+  size_t i, len;
+  char *buf;
+  int tag;
+
+  switch (tag = load_byte(state)) {
+  case DUMP_NIL:
+    return pic_nil_value();
+  case DUMP_TRUE:
+    return pic_true_value();
+  case DUMP_FALSE:
+    return pic_false_value();
+  case DUMP_UNDEF:
+    return pic_undef_value();
+  case DUMP_EOF:
+    return pic_eof_object();
+  case DUMP_INT:
+    return pic_int_value((int)load_int(state));
+#if PIC_ENABLE_FLOAT
+  case DUMP_FLOAT: {
+    double f;
+
+    buf = load_bytes(state, &len);
+    if (len != sizeof f) {
+      pic_free(pic, buf);
+      pic_errorf(pic, "load: broken float constant");
+    }
+    memcpy(&f, buf, sizeof f);
+    pic_free(pic, buf);
+    return pic_float_value(f);
+  }
+#endif
+  case DUMP_CHAR:
+    return pic_char_value((char)load_byte(state));
+  case DUMP_SYMBOL:
+  case DUMP_GENSYM:
+  case DUMP_GLOBAL:
+    return pic_obj_value(load_symbol(state, tag));
+  case DUMP_PAIR:
+    car = load_value(state);
+    cdr = load_value(state);
+    return pic_cons(pic, car, cdr);
+  case DUMP_VECTOR:
+    len = load_uint(state);
+    vec = pic_make_vec(pic, len);
+    for (i = 0; i < len; ++i) {
+      vec->data[i] = load_value(state);
+    }
+    return pic_obj_value(vec);
+  case DUMP_STRING:
+    return pic_obj_value(load_str(state));
+  case DUMP_BLOB:
+    buf = load_bytes(state, &len);
+    blob = pic_make_blob(pic, len);
+    memcpy(blob->data, buf, len);
+    pic_free(pic, buf);
+    return pic_obj_value(blob);
+  case DUMP_PROC:
+    return pic_obj_value(pic_make_proc_irep(pic, load_irep(state), NULL));
+  default:
+    pic_errorf(pic, "load: unknown constant tag %d", tag);
+  }
+}
+
+/* lengths are raised as the arrays are filled, so that gc only sees what is loaded */
+static struct pic_irep *
+load_irep(load_state *state)
+{
+  pic_state *pic = state->pic;
+  struct pic_irep *irep;
+  size_t ai, i, n;
+  pic_code *c;
+  int tag;
+
+  irep = (struct pic_irep *)pic_obj_alloc(pic, sizeof(struct pic_irep), PIC_TT_IREP);
+  irep->name = NULL;
+  irep->code = NULL;
+  irep->irep = NULL;
+  irep->pool = NULL;
+  irep->syms = NULL;
+  irep->clen = irep->ilen = irep->plen = irep->slen = 0;
+  irep->lines = NULL;
+  irep->llen = 0;
+#if PIC_LAZY_CODEGEN
+  irep->ir = NULL;
+  irep->lazy = NULL;
+#endif
+  irep->tier = 1;
+  irep->calls = irep->loops = 0;
+  irep->source = pic_undef_value();
+  irep->tiered = NULL;
+  irep->jit = NULL;
+  irep->jit_failed = false;
+
+  ai = pic_gc_arena_preserve(pic);
+
+  if ((tag = load_byte(state)) != DUMP_NONE) {
+    irep->name = load_symbol(state, tag);
+  }
+  irep->argc = (int)load_uint(state);
+  irep->localc = (int)load_uint(state);
+  irep->capturec = (int)load_uint(state);
+  irep->varg = load_byte(state) != 0;
+
+  n = load_uint(state);
+  irep->code = pic_calloc(pic, n, sizeof(pic_code));
+  for (i = 0; i < n; ++i) {
+    c = &irep->code[i];
+    c->insn = (enum pic_opcode)load_uint(state);
+    if (c->insn > OP_STOP) {
+      pic_errorf(pic, "load: unknown instruction %d", (int)c->insn);
+    }
+    switch (c->insn) {
+    case OP_PUSHCHAR:
+      c->u.c = (char)load_byte(state);
+      break;
+    case OP_CREF:
+    case OP_CSET:
+      c->u.r.depth = (int)load_int(state);
+      c->u.r.idx = (int)load_int(state);
+      break;
+    default:
+      c->u.i = (int)load_int(state);
+      break;
+    }
+  }
+  irep->clen = n;
+
+  n = load_uint(state);
+  irep->lines = n == 0 ? NULL : pic_calloc(pic, n, sizeof(struct pic_line));
+  for (i = 0; i < n; ++i) {
+    irep->lines[i].pc = (int)load_uint(state);
+    irep->lines[i].line = (int)load_uint(state);
+  }
+  irep->llen = n;
+
+  n = load_uint(state);
+  irep->irep = pic_calloc(pic, n, sizeof(struct pic_irep *));
+  for (i = 0; i < n; ++i) {
+    irep->irep[i] = load_irep(state);
+    irep->ilen++;
+    pic_gc_arena_restore(pic, ai);
+  }
+
+  n = load_uint(state);
+  irep->pool = pic_calloc(pic, n, sizeof(pic_value));
+  for (i = 0; i < n; ++i) {
+    irep->pool[i] = load_value(state);
+    irep->plen++;
+    pic_gc_arena_restore(pic, ai);
+  }
+
+  n = load_uint(state);
+  irep->syms = pic_calloc(pic, n, sizeof(pic_sym *));
+  for (i = 0; i < n; ++i) {
+    irep->syms[i] = load_symbol(state, load_byte(state));
+    irep->slen++;
+    pic_gc_arena_restore(pic, ai);
+  }
+
+  return irep;
+}
+
+struct pic_irep *
+pic_load_irep_file(pic_state *pic, xFILE *file)
+{
+  load_state state;
+  struct pic_irep *irep;
+  char magic[4];
+  size_t n;
+
+  if ((n = xfread(magic, 1, 4, file)) == 0) {
+    return NULL;                /* no more records */
+  }
+  if (n != 4 || magic[0] != 'P' || magic[1] != 'I' || magic[2] != 'C' || magic[3] != 'B') {
+    pic_errorf(pic, "load: not a bytecode file");
+  }
+
+  load_open(&state, pic, file);
+
+  pic_try {
+    if (load_byte(&state) != DUMP_VERSION) {
+      pic_errorf(pic, "load: unsupported bytecode version");
+    }
+    irep = load_irep(&state);
+  }
+  pic_catch {
+    load_close(&state);
+    pic_raise(pic, pic->err);
+  }
+
+  load_close(&state);
+
+  return irep;
+}
+
+/**
+ * boot snapshot
+ */
+
+/*
+ * A snapshot records what loading the boot library did, as a sequence of
+ * events after the magic "PICS" and a version byte:
+ *
+ *   code    irep of a toplevel form, to be run
+ *   macro   library, name and the irep of the transformer expression
+ *   export  library, exported name and the global it refers to
+ *
+ * Replaying them on a state where only the C side is initialized gives
+ * the same library without reading, expanding or compiling any source.
+ * C functions are reached through the globals they are bound to, so they
+ * are relinked by name.
+ */
+
+#define SNAPSHOT_MAGIC "PICS"
+
+enum {
+  SNAPSHOT_CODE,
+  SNAPSHOT_MACRO,
+  SNAPSHOT_EXPORT
+};
+
+static void
+snapshot_event(pic_state *pic, int tag, struct pic_lib *lib, pic_sym *name, pic_sym *rename, struct pic_irep *irep)
+{
+  dump_state state;
+
+  dump_open(&state, pic, pic->snapshot);
+
+  pic_try {
+    collect_globals(&state);
+
+    dump_byte(&state, tag);
+    if (lib != NULL) {
+      dump_value(&state, lib->name);
+      dump_name(&state, name);
+    }
+    if (rename != NULL) {
+      dump_global(&state, rename);
+    }
+    if (irep != NULL) {
+      dump_irep(&state, irep);
+    }
+  }
+  pic_catch {
+    dump_close(&state);
+    pic_raise(pic, pic->err);
+  }
+
+  dump_close(&state);
+}
+
+void
+pic_snapshot_start(pic_state *pic, xFILE *file)
+{
+  unsigned char version = DUMP_VERSION;
+
+  if (xfwrite(SNAPSHOT_MAGIC, 1, 4, file) != 4 || xfwrite(&version, 1, 1, file) != 1) {
+    pic_errorf(pic, "dump: write error");
+  }
+  pic->snapshot = file;
+}
+
+void
+pic_snapshot_code(pic_state *pic, struct pic_irep *irep)
+{
+  snapshot_event(pic, SNAPSHOT_CODE, NULL, NULL, NULL, irep);
+}
+
+void
+pic_snapshot_macro(pic_state *pic, struct pic_lib *lib, pic_sym *name, struct pic_irep *irep)
+{
+  snapshot_event(pic, SNAPSHOT_MACRO, lib, name, NULL, irep);
+}
+
+void
+pic_snapshot_export(pic_state *pic, struct pic_lib *lib, pic_sym *name, pic_sym *rename)
+{
+  snapshot_event(pic, SNAPSHOT_EXPORT, lib, name, rename, NULL);
+}
+
+static struct pic_lib *
+load_library(load_state *state)
+{
+  pic_value spec;
+  struct pic_lib *lib;
+
+  spec = load_value(state);
+  if ((lib = pic_find_library(state->pic, spec)) == NULL) {
+    pic_errorf(state->pic, "load: library not found: ~s", spec);
+  }
+  return lib;
+}
+
+static void
+load_event(load_state *state, int tag)
+{
+  pic_state *pic = state->pic;
+  struct pic_lib *lib;
+  struct pic_irep *irep;
+  pic_sym *name, *rename;
+  pic_value val;
+
+  switch (tag) {
+  case SNAPSHOT_CODE:
+    irep = load_irep(state);
+    pic_apply(pic, pic_make_proc_irep(pic, irep, NULL), pic_nil_value());
+    break;
+  case SNAPSHOT_MACRO:
+    lib = load_library(state);
+    name = pic_intern(pic, load_str(state));
+    irep = load_irep(state);
+    if (! pic_find_rename(pic, lib->env, name, &rename)) {
+      rename = pic_add_rename(pic, lib->env, name);
+    }
+    val = pic_apply(pic, pic_make_proc_irep(pic, irep, NULL), pic_nil_value());
+    pic_define_syntax(pic, lib->env, name, rename, val);
+    break;
+  case SNAPSHOT_EXPORT:
+    lib = load_library(state);
+    name = pic_intern(pic, load_str(state));
+    rename = load_symbol(state, load_byte(state));
+    pic_dict_set(pic, lib->exports, name, pic_obj_value(rename));
+    break;
+  default:
+    pic_errorf(pic, "load: unknown snapshot event %d", tag);
+  }
+}
+
+void
+pic_load_snapshot(pic_state *pic, xFILE *file)
+{
+  load_state state;
+  unsigned char head[5];
+  size_t ai;
+
+  if (xfread(head, 1, 5, file) != 5
+      || head[0] != 'P' || head[1] != 'I' || head[2] != 'C' || head[3] != 'S') {
+    pic_errorf(pic, "load: not a snapshot file");
+  }
+  if (head[4] != DUMP_VERSION) {
+    pic_errorf(pic, "load: unsupported snapshot version");
+  }
+
+  ai = pic_gc_arena_preserve(pic);
+
+  while (xfread(head, 1, 1, file) == 1) {
+    load_open(&state, pic, file);
+
+    pic_try {
+      load_event(&state, head[0]);
+    }
+    pic_catch {
+      load_close(&state);
+      pic_raise(pic, pic->err);
+    }
+
+    load_close(&state);
+    pic_gc_arena_restore(pic, ai);
+  }
+}
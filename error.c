@@ -6,7 +6,6 @@
 #include "picrin/pair.h"
 #include "picrin/proc.h"
 #include "picrin/cont.h"
-#include "picrin/data.h"
 #include "picrin/string.h"
 #include "picrin/error.h"
 #include "picrin/port.h"
@@ -72,36 +71,12 @@ pic_errmsg(pic_state *pic)
   return pic_str_cstr(pic, str);
 }
 
-static pic_value
-native_exception_handler(pic_state *pic)
-{
-  pic_value err;
-  struct pic_proc *cont;
-
-  pic_get_args(pic, "o", &err);
-
-  pic->err = err;
-
-  cont = pic_proc_ptr(pic_attr_ref(pic, pic_obj_value(pic_get_proc(pic)), "@@escape"));
-
-  pic_apply1(pic, cont, pic_false_value());
-
-  PIC_UNREACHABLE();
-}
-
-void
-pic_push_try(pic_state *pic, struct pic_escape *escape)
+static void
+push_handler(pic_state *pic, struct pic_proc *handler)
 {
-  struct pic_proc *cont, *handler;
   size_t xp_len;
   ptrdiff_t xp_offset;
 
-  cont = pic_make_econt(pic, escape);
-
-  handler = pic_make_proc(pic, native_exception_handler, "(native-exception-handler)");
-
-  pic_attr_set(pic, pic_obj_value(handler), "@@escape", pic_obj_value(cont));
-
   if (pic->xp >= pic->xpend) {
     xp_len = (size_t)(pic->xpend - pic->xpbase) * 2;
     xp_offset = pic->xp - pic->xpbase;
@@ -113,37 +88,70 @@ pic_push_try(pic_state *pic, struct pic_escape *escape)
   *pic->xp++ = handler;
 }
 
-void
-pic_pop_try(pic_state *pic)
+/*
+ * A pic_try frame is a NULL entry in the handler stack, paired with
+ * the escape on top of the try stack. The escapes are allocated once
+ * per slot and reused, so entering a try block costs a setjmp only.
+ */
+struct pic_escape *
+pic_push_try(pic_state *pic)
 {
-  pic_value cont, escape;
+  struct pic_escape *escape;
+  size_t tp_len;
+  ptrdiff_t tp_offset;
+
+  if (pic->tp >= pic->tpend) {
+    tp_len = (size_t)(pic->tpend - pic->tpbase) * 2;
+    tp_offset = pic->tp - pic->tpbase;
+    pic->tpbase = pic_realloc(pic, pic->tpbase, sizeof(struct pic_escape *) * tp_len);
+    pic->tp = pic->tpbase + tp_offset;
+    pic->tpend = pic->tpbase + tp_len;
+    memset(pic->tp, 0, sizeof(struct pic_escape *) * (size_t)(pic->tpend - pic->tp));
+  }
 
-  assert(pic->xp > pic->xpbase);
+  if (*pic->tp == NULL) {
+    *pic->tp = pic_alloc(pic, sizeof(struct pic_escape) + pic->jmpbuf_size);
+  }
+  escape = *pic->tp;
 
-  cont = pic_attr_ref(pic, pic_obj_value(*--pic->xp), "@@escape");
+  pic_save_point(pic, escape);
 
-  assert(pic_proc_p(cont));
+  push_handler(pic, NULL);
+  pic->tp++;
 
-  escape = pic_attr_ref(pic, cont, "@@escape");
+  return escape;
+}
 
-  assert(pic_data_p(escape));
+void
+pic_pop_try(pic_state *pic)
+{
+  assert(pic->xp > pic->xpbase && pic->xp[-1] == NULL);
+  assert(pic->tp > pic->tpbase);
 
-  ((struct pic_escape *)pic_data_ptr(escape)->data)->valid = false;
+  --pic->xp;
+  (*--pic->tp)->valid = false;
 }
 
 struct pic_error *
 pic_make_error(pic_state *pic, pic_sym *type, const char *msg, pic_value irrs)
 {
   struct pic_error *e;
-  pic_str *stack;
+  pic_str *str;
+  struct pic_trace *trace;
+  size_t tracec;
 
-  stack = pic_get_backtrace(pic);
+  str = pic_make_str_cstr(pic, msg);
+
+  /* the trace is rendered only when someone prints it */
+  trace = pic_capture_backtrace(pic, &tracec);
 
   e = (struct pic_error *)pic_obj_alloc(pic, sizeof(struct pic_error), PIC_TT_ERROR);
   e->type = type;
-  e->msg = pic_make_str_cstr(pic, msg);
+  e->msg = str;
   e->irrs = irrs;
-  e->stack = stack;
+  e->trace = trace;
+  e->tracec = tracec;
+  e->stack = NULL;
 
   return e;
 }
@@ -160,6 +168,17 @@ pic_raise_continuable(pic_state *pic, pic_value err)
 
   handler = *--pic->xp;
 
+  if (handler == NULL) {
+    struct pic_escape *escape = pic->tp[-1];
+
+    pic->err = err;
+
+    /* brings xp and tp back to below the frame */
+    pic_load_point(pic, escape);
+
+    PIC_LONGJMP(pic, (void *)escape->jmp, 1);
+  }
+
   pic_gc_protect(pic, pic_obj_value(handler));
 
   v = pic_apply1(pic, handler, err);
@@ -176,7 +195,8 @@ pic_raise(pic_state *pic, pic_value err)
 
   val = pic_raise_continuable(pic, err);
 
-  pic_pop_try(pic);
+  /* the secondary error goes to the outer handler */
+  --pic->xp;
 
   pic_errorf(pic, "error handler returned with ~s on error ~s", val, err);
 }
@@ -202,20 +222,10 @@ pic_error_with_exception_handler(pic_state *pic)
 {
   struct pic_proc *handler, *thunk;
   pic_value val;
-  size_t xp_len;
-  ptrdiff_t xp_offset;
 
   pic_get_args(pic, "ll", &handler, &thunk);
 
-  if (pic->xp >= pic->xpend) {
-    xp_len = (size_t)(pic->xpend - pic->xpbase) * 2;
-    xp_offset = pic->xp - pic->xpbase;
-    pic->xpbase = pic_realloc(pic, pic->xpbase, sizeof(struct pic_proc *) * xp_len);
-    pic->xp = pic->xpbase + xp_offset;
-    pic->xpend = pic->xpbase + xp_len;
-  }
-
-  *pic->xp++ = handler;
+  push_handler(pic, handler);
 
   val = pic_apply0(pic, thunk);
 
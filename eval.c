@@ -4,14 +4,24 @@
 
 #include "picrin.h"
 #include "picrin/macro.h"
+#include "picrin/proc.h"
+#include "picrin/irep.h"
+#include "picrin/cont.h"
 
 pic_value
 pic_eval(pic_state *pic, pic_value program, struct pic_lib *lib)
 {
   struct pic_proc *proc;
 
+  /* an error may have escaped a deep recursion before the stack was released */
+  pic_vm_release(pic);
+
   proc = pic_compile(pic, program, lib);
 
+  if (pic->snapshot != NULL) {
+    pic_snapshot_code(pic, proc->u.irep);
+  }
+
   return pic_apply(pic, proc, pic_nil_value());
 }
 
@@ -18,6 +18,7 @@
 #include "picrin/data.h"
 #include "picrin/dict.h"
 #include "picrin/record.h"
+#include "picrin/var.h"
 #include "picrin/read.h"
 #include "picrin/symbol.h"
 
@@ -328,7 +329,7 @@ static void
 gc_mark_winder(pic_state *pic, struct pic_winder *wind)
 {
   if (wind->prev) {
-    gc_mark_object(pic, (struct pic_object *)wind->prev);
+    gc_mark_winder(pic, wind->prev);
   }
   if (wind->in) {
     gc_mark_object(pic, (struct pic_object *)wind->in);
@@ -336,6 +337,9 @@ gc_mark_winder(pic_state *pic, struct pic_winder *wind)
   if (wind->out) {
     gc_mark_object(pic, (struct pic_object *)wind->out);
   }
+  if (wind->binds) {
+    gc_mark_object(pic, (struct pic_object *)wind->binds);
+  }
 }
 
 static void
@@ -376,6 +380,9 @@ gc_mark_object(pic_state *pic, struct pic_object *obj)
       gc_mark_object(pic, (struct pic_object *)proc->u.irep);
     } else {
       gc_mark_object(pic, (struct pic_object *)proc->u.func.name);
+      if (proc->u.func.var) {
+        gc_mark_object(pic, (struct pic_object *)proc->u.func.var);
+      }
     }
     break;
   }
@@ -384,10 +391,17 @@ gc_mark_object(pic_state *pic, struct pic_object *obj)
   }
   case PIC_TT_ERROR: {
     struct pic_error *err = (struct pic_error *)obj;
+    size_t i;
+
     gc_mark_object(pic, (struct pic_object *)err->type);
     gc_mark_object(pic, (struct pic_object *)err->msg);
     gc_mark(pic, err->irrs);
-    gc_mark_object(pic, (struct pic_object *)err->stack);
+    for (i = 0; i < err->tracec; ++i) {
+      gc_mark_object(pic, (struct pic_object *)err->trace[i].proc);
+    }
+    if (err->stack) {
+      gc_mark_object(pic, (struct pic_object *)err->stack);
+    }
     break;
   }
   case PIC_TT_STRING: {
@@ -435,6 +449,15 @@ gc_mark_object(pic_state *pic, struct pic_object *obj)
     for (i = 0; i < irep->slen; ++i) {
       gc_mark_object(pic, (struct pic_object *)irep->syms[i]);
     }
+#if PIC_LAZY_CODEGEN
+    if (irep->ir != NULL) {
+      gc_mark_object(pic, (struct pic_object *)irep->ir);
+    }
+#endif
+    gc_mark(pic, irep->source);
+    if (irep->tiered != NULL) {
+      gc_mark_object(pic, (struct pic_object *)irep->tiered);
+    }
     break;
   }
   case PIC_TT_DATA: {
@@ -465,6 +488,15 @@ gc_mark_object(pic_state *pic, struct pic_object *obj)
     gc_mark_object(pic, (struct pic_object *)rec->data);
     break;
   }
+  case PIC_TT_VAR: {
+    struct pic_var *var = (struct pic_var *)obj;
+
+    gc_mark(pic, var->value);
+    if (var->conv) {
+      gc_mark_object(pic, (struct pic_object *)var->conv);
+    }
+    break;
+  }
   case PIC_TT_SYMBOL: {
     struct pic_symbol *sym = (struct pic_symbol *)obj;
 
@@ -546,11 +578,16 @@ gc_mark_phase(pic_state *pic)
     if (ci->env) {
       gc_mark_object(pic, (struct pic_object *)ci->env);
     }
+    if (ci->irep) {
+      gc_mark_object(pic, (struct pic_object *)ci->irep);
+    }
   }
 
   /* exception handlers */
   for (xhandler = pic->xpbase; xhandler != pic->xp; ++xhandler) {
-    gc_mark_object(pic, (struct pic_object *)*xhandler);
+    if (*xhandler) {            /* NULL for a pic_try frame */
+      gc_mark_object(pic, (struct pic_object *)*xhandler);
+    }
   }
 
   /* arena */
@@ -571,6 +608,22 @@ gc_mark_phase(pic_state *pic)
     gc_mark_object(pic, (struct pic_object *)pic->macros);
   }
 
+  /* procedures known to the inliner */
+  if (pic->inlinables) {
+    gc_mark_object(pic, (struct pic_object *)pic->inlinables);
+  }
+
+  /* compile cache */
+  if (pic->cache) {
+    for (j = 0; j < PIC_COMPILE_CACHE_SIZE; ++j) {
+      if (pic->cache[j].irep) {
+        gc_mark(pic, pic->cache[j].form);
+        gc_mark_object(pic, (struct pic_object *)pic->cache[j].lib);
+        gc_mark_object(pic, (struct pic_object *)pic->cache[j].irep);
+      }
+    }
+  }
+
   /* error object */
   gc_mark(pic, pic->err);
 
@@ -624,6 +677,10 @@ gc_finalize_object(pic_state *pic, struct pic_object *obj)
     break;
   }
   case PIC_TT_PROC: {
+    struct pic_proc *proc = (struct pic_proc *)obj;
+    if (pic_proc_func_p(proc) && proc->u.func.sig != NULL) {
+      pic_free(pic, proc->u.func.sig);
+    }
     break;
   }
   case PIC_TT_VECTOR: {
@@ -642,6 +699,7 @@ gc_finalize_object(pic_state *pic, struct pic_object *obj)
     break;
   }
   case PIC_TT_ERROR: {
+    pic_free(pic, ((struct pic_error *)obj)->trace);
     break;
   }
   case PIC_TT_SENV: {
@@ -652,10 +710,12 @@ gc_finalize_object(pic_state *pic, struct pic_object *obj)
   }
   case PIC_TT_IREP: {
     struct pic_irep *irep = (struct pic_irep *)obj;
+    pic_jit_free(pic, irep);
     pic_free(pic, irep->code);
     pic_free(pic, irep->irep);
     pic_free(pic, irep->pool);
     pic_free(pic, irep->syms);
+    pic_free(pic, irep->lines);
     break;
   }
   case PIC_TT_DATA: {
@@ -672,6 +732,9 @@ gc_finalize_object(pic_state *pic, struct pic_object *obj)
   case PIC_TT_RECORD: {
     break;
   }
+  case PIC_TT_VAR: {
+    break;
+  }
   case PIC_TT_SYMBOL: {
     break;
   }
@@ -779,6 +842,21 @@ gc_sweep_phase(pic_state *pic)
     }
   } while (it != NULL);
 
+  /*
+   * Source locations do not keep the pairs alive. An entry of a dead
+   * pair is harmless, as it no longer matches a pair made at the same
+   * address, so the table is only swept once it has doubled.
+   */
+  if (xh_size(&pic->locs) >= pic->locs_limit) {
+    for (it = xh_begin(&pic->locs); it != NULL; it = next) {
+      next = xh_next(it);
+      if (! gc_obj_is_marked(xh_key(it, struct pic_object *))) {
+        xh_del_ptr(&pic->locs, xh_key(it, struct pic_object *));
+      }
+    }
+    pic->locs_limit = xh_size(&pic->locs) * 2;
+  }
+
   gc_sweep_symbols(pic);
 
   while (page) {
@@ -67,6 +67,7 @@ typedef struct pic_code pic_code;
 struct pic_winder {
   struct pic_proc *in;
   struct pic_proc *out;
+  struct pic_vector *binds;     /* parameters and the values to swap in, or NULL */
   int depth;
   struct pic_winder *prev;
 };
@@ -79,6 +80,7 @@ typedef struct {
   int regc;
   pic_value *regs;
   struct pic_env *up;
+  struct pic_irep *irep;        /* the code being run, NULL in a C function */
 } pic_callinfo;
 
 typedef void *(*pic_allocf)(void *, size_t);
@@ -96,6 +98,7 @@ typedef struct {
 
   pic_value *sp;
   pic_value *stbase, *stend;
+  xvect_t(pic_value *) stold;   /* blocks the stack has moved out of */
 
   pic_callinfo *ci;
   pic_callinfo *cibase, *ciend;
@@ -103,6 +106,9 @@ typedef struct {
   struct pic_proc **xp;
   struct pic_proc **xpbase, **xpend;
 
+  struct pic_escape **tp;       /* pic_try frames, one per NULL entry in xp */
+  struct pic_escape **tpbase, **tpend;
+
   pic_code *ip;
 
   struct pic_lib *lib, *prev_lib;
@@ -135,8 +141,17 @@ typedef struct {
   xhash syms;                   /* name to symbol */
   struct pic_dict *globals;
   struct pic_dict *macros;
+  struct pic_dict *inlinables;   /* top-level procedures known to the inliner */
+  struct pic_cache_entry *cache; /* recently compiled forms */
+  size_t cache_epoch;           /* bumped whenever the cache is invalidated */
+  size_t cache_hits, cache_misses;
+  xFILE *snapshot;              /* the boot being recorded */
+  bool tiering;                 /* compile unoptimized code and optimize it when hot */
+  bool jit_enable;              /* translate ireps to native code before running them */
   pic_value libs;
   xhash attrs;
+  xhash locs;                   /* source locations of pairs, see read.h */
+  size_t locs_limit;            /* size of locs at which gc sweeps it */
 
   struct pic_reader *reader;
 
@@ -154,6 +169,25 @@ typedef struct {
 
 typedef pic_value (*pic_func_t)(pic_state *);
 
+/* an argument unboxed according to a signature, see pic_defun_sig */
+typedef union {
+  pic_value o;
+  int i;
+  size_t k;
+  char c;
+  pic_str *s;
+  pic_sym *m;
+  pic_vec *v;
+  pic_blob *b;
+  struct pic_proc *l;
+  struct pic_port *p;
+  struct pic_dict *d;
+  struct pic_record *r;
+  struct pic_error *e;
+} pic_arg;
+
+typedef pic_value (*pic_sigfunc_t)(pic_state *, int, pic_arg *);
+
 void *pic_alloc(pic_state *, size_t);
 #define pic_malloc(pic,size) pic_alloc(pic,size) /* obsoleted */
 void *pic_realloc(pic_state *, void *, size_t);
@@ -175,6 +209,8 @@ void pic_gc_arena_restore(pic_state *, size_t);
   } while (0)
 
 pic_state *pic_open(pic_allocf, pic_abortf, size_t jmpbuf_size, int argc, char *argv[], char **envp, xFILE *xstdin, xFILE *xstdout, xFILE *stderr);
+pic_state *pic_open_from_snapshot(pic_allocf, pic_abortf, size_t jmpbuf_size, int argc, char *argv[], char **envp, xFILE *xstdin, xFILE *xstdout, xFILE *stderr, xFILE *snapshot);
+void pic_dump_snapshot(pic_allocf, pic_abortf, size_t jmpbuf_size, xFILE *);
 void pic_close(pic_state *);
 
 void pic_add_feature(pic_state *, const char *);
@@ -182,6 +218,7 @@ void pic_add_feature(pic_state *, const char *);
 void pic_define(pic_state *, const char *, pic_value);
 void pic_define_noexport(pic_state *, const char *, pic_value);
 void pic_defun(pic_state *, const char *, pic_func_t);
+void pic_defun_sig(pic_state *, const char *, pic_sigfunc_t, const char *);
 
 struct pic_proc *pic_make_var(pic_state *, pic_value, struct pic_proc *);
 void pic_defvar(pic_state *, const char *, pic_value, struct pic_proc *);
@@ -210,6 +247,7 @@ pic_value pic_ref(pic_state *, struct pic_lib *, const char *);
 void pic_set(pic_state *, struct pic_lib *, const char *, pic_value);
 
 pic_value pic_apply(pic_state *, struct pic_proc *, pic_value);
+pic_value pic_applyv(pic_state *, struct pic_proc *, size_t, pic_value *);
 pic_value pic_apply0(pic_state *, struct pic_proc *);
 pic_value pic_apply1(pic_state *, struct pic_proc *, pic_value);
 pic_value pic_apply2(pic_state *, struct pic_proc *, pic_value, pic_value);
@@ -217,6 +255,7 @@ pic_value pic_apply3(pic_state *, struct pic_proc *, pic_value, pic_value, pic_v
 pic_value pic_apply4(pic_state *, struct pic_proc *, pic_value, pic_value, pic_value, pic_value);
 pic_value pic_apply5(pic_state *, struct pic_proc *, pic_value, pic_value, pic_value, pic_value, pic_value);
 pic_value pic_apply_trampoline(pic_state *, struct pic_proc *, pic_value);
+pic_value pic_apply_trampolinev(pic_state *, struct pic_proc *, size_t, pic_value *);
 pic_value pic_eval(pic_state *, pic_value, struct pic_lib *);
 struct pic_proc *pic_compile(pic_state *, pic_value, struct pic_lib *);
 pic_value pic_macroexpand(pic_state *, pic_value, struct pic_lib *);
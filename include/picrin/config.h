@@ -43,6 +43,35 @@
 
 #define PIC_ISEQ_SIZE 32
 
+#define PIC_IR_PAGE_SIZE 4096
+
+/** the VM stacks grow up to this many entries, then raise an error */
+#define PIC_STACK_MAX (64 * 1024)
+
+/** inline procedures whose body is at most this many nodes (0 disables) */
+/* #define PIC_INLINE_SIZE 20 */
+
+/** also inline top-level procedures (they must never be redefined) */
+/* #define PIC_INLINE_GLOBAL 1 */
+
+/** lift lambdas with at most this many free variables (0 disables) */
+/* #define PIC_LIFT_FREE_VARS 4 */
+
+/** generate the code of inner lambdas on their first call */
+/* #define PIC_LAZY_CODEGEN 1 */
+
+/** remember the code compiled for this many forms (0 disables) */
+/* #define PIC_COMPILE_CACHE_SIZE 64 */
+
+/** experimental, slower so far: compile unoptimized, and optimize procedures called this many times (0 disables) */
+/* #define PIC_TIER_THRESHOLD 1000 */
+
+/** boot from the precompiled image in boot_image.c (make boot_image.c) */
+/* #define PIC_BOOT_IMAGE 1 */
+
+/** translate ireps to native code on x86-64 Linux hosts (see pic->jit_enable) */
+/* #define PIC_ENABLE_JIT 1 */
+
 /** enable all debug flags */
 /* #define DEBUG 1 */
 
@@ -51,6 +80,7 @@
 /* #define VM_DEBUG 1 */
 /* #define GC_DEBUG 1 */
 /* #define GC_DEBUG_DETAIL 1 */
+/* #define INLINE_DEBUG 1 */
 
 #ifndef PIC_DIRECT_THREADED_VM
 # if (defined(__GNUC__) || defined(__clang__)) && __STRICT_ANSI__ != 1
@@ -116,6 +146,10 @@
 # define PIC_STACK_SIZE 1024
 #endif
 
+#ifndef PIC_STACK_MAX
+# define PIC_STACK_MAX (1024 * 1024)
+#endif
+
 #ifndef PIC_RESCUE_SIZE
 # define PIC_RESCUE_SIZE 30
 #endif
@@ -140,9 +174,46 @@
 # define PIC_ISEQ_SIZE 1024
 #endif
 
+#ifndef PIC_IR_PAGE_SIZE
+# define PIC_IR_PAGE_SIZE (16 * 1024)
+#endif
+
+#ifndef PIC_INLINE_SIZE
+# define PIC_INLINE_SIZE 20
+#endif
+
+#ifndef PIC_INLINE_GLOBAL
+# define PIC_INLINE_GLOBAL 0
+#endif
+
+#ifndef PIC_LIFT_FREE_VARS
+# define PIC_LIFT_FREE_VARS 4
+#endif
+
+#ifndef PIC_LAZY_CODEGEN
+# define PIC_LAZY_CODEGEN 0
+#endif
+
+#ifndef PIC_COMPILE_CACHE_SIZE
+# define PIC_COMPILE_CACHE_SIZE 64
+#endif
+
+#ifndef PIC_TIER_THRESHOLD
+# define PIC_TIER_THRESHOLD 0
+#endif
+
+#ifndef PIC_BOOT_IMAGE
+# define PIC_BOOT_IMAGE 0
+#endif
+
+#ifndef PIC_ENABLE_JIT
+# define PIC_ENABLE_JIT 0
+#endif
+
 #if DEBUG
 # define GC_STRESS 0
 # define VM_DEBUG 1
 # define GC_DEBUG 0
 # define GC_DEBUG_DETAIL 0
+# define INLINE_DEBUG 1
 #endif
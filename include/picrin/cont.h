@@ -17,11 +17,13 @@ struct pic_escape {
   ptrdiff_t sp_offset;
   ptrdiff_t ci_offset;
   ptrdiff_t xp_offset;
+  ptrdiff_t tp_offset;
   size_t arena_idx;
 
   pic_code *ip;
 
-  pic_value results;
+  ptrdiff_t results_offset;     /* values passed to the escape, left on the stack */
+  size_t resultc;
 
   char jmp[1];
 };
@@ -29,10 +31,15 @@ struct pic_escape {
 void pic_save_point(pic_state *, struct pic_escape *);
 void pic_load_point(pic_state *, struct pic_escape *);
 
+void pic_vm_reserve(pic_state *, size_t);
+void pic_vm_release(pic_state *);
+void pic_vm_escape(pic_state *, ptrdiff_t, ptrdiff_t);
+
 struct pic_proc *pic_make_econt(pic_state *, struct pic_escape *);
 
 void pic_wind(pic_state *, struct pic_winder *, struct pic_winder *);
 pic_value pic_dynamic_wind(pic_state *, struct pic_proc *, struct pic_proc *, struct pic_proc *);
+pic_value pic_dynamic_bind(pic_state *, struct pic_vector *, struct pic_proc *); /* #(var val var val ...) */
 
 pic_value pic_values0(pic_state *);
 pic_value pic_values1(pic_state *, pic_value);
@@ -11,12 +11,19 @@ extern "C" {
 
 #include "picrin/cont.h"
 
+struct pic_trace {
+  struct pic_proc *proc;
+  int line;                     /* where the frame was, 0 if not known */
+};
+
 struct pic_error {
   PIC_OBJECT_HEADER
   pic_sym *type;
   pic_str *msg;
   pic_value irrs;
-  pic_str *stack;
+  struct pic_trace *trace;      /* frames on the stack when made, innermost first */
+  size_t tracec;
+  pic_str *stack;               /* trace as text, NULL until it is asked for */
 };
 
 #define pic_error_p(v) (pic_type(v) == PIC_TT_ERROR)
@@ -24,6 +31,9 @@ struct pic_error {
 
 struct pic_error *pic_make_error(pic_state *, pic_sym *, const char *, pic_list);
 
+struct pic_trace *pic_capture_backtrace(pic_state *, size_t *);
+pic_str *pic_error_backtrace(pic_state *, struct pic_error *);
+
 /* do not return from try block! */
 
 #define pic_try                                 \
@@ -32,10 +42,8 @@ struct pic_error *pic_make_error(pic_state *, pic_sym *, const char *, pic_list)
   pic_catch_(PIC_GENSYM(label))
 #define pic_try_(escape)                                                \
   do {                                                                  \
-  struct pic_escape *escape = pic_alloc(pic, sizeof(struct pic_escape) + pic->jmpbuf_size); \
-    pic_save_point(pic, escape);                                        \
+    struct pic_escape *escape = pic_push_try(pic);                      \
     if (PIC_SETJMP(pic, (void *)escape->jmp) == 0) {                    \
-      pic_push_try(pic, escape);                                        \
       do
 #define pic_catch_(label)                                 \
       while (0);                                          \
@@ -47,7 +55,7 @@ struct pic_error *pic_make_error(pic_state *, pic_sym *, const char *, pic_list)
   if (0)                                                  \
   label:
 
-void pic_push_try(pic_state *, struct pic_escape *);
+struct pic_escape *pic_push_try(pic_state *);
 void pic_pop_try(pic_state *);
 
 pic_value pic_raise_continuable(pic_state *, pic_value);
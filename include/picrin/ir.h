@@ -0,0 +1,154 @@
+/**
+ * See Copyright Notice in picrin.h
+ */
+
+#ifndef PICRIN_IR_H
+#define PICRIN_IR_H
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*
+ * Intermediate representation passed from the analyzer through the
+ * optimizer to codegen. Nodes are plain C structs allocated from an
+ * arena, which is released at once when the compilation is over.
+ */
+
+enum pic_ir_kind {
+  PIC_IR_QUOTE,
+  PIC_IR_GREF,
+  PIC_IR_LREF,
+  PIC_IR_CREF,
+  PIC_IR_SETBANG,
+  PIC_IR_LAMBDA,
+  PIC_IR_IF,
+  PIC_IR_BEGIN,
+  PIC_IR_CALL,
+  PIC_IR_TAILCALL,
+  PIC_IR_CALL_WITH_VALUES,
+  PIC_IR_TAILCALL_WITH_VALUES,
+  PIC_IR_RETURN,
+  /* primitive operations */
+  PIC_IR_CONS,
+  PIC_IR_CAR,
+  PIC_IR_CDR,
+  PIC_IR_NILP,
+  PIC_IR_SYMBOLP,
+  PIC_IR_PAIRP,
+  PIC_IR_ADD,
+  PIC_IR_SUB,
+  PIC_IR_MUL,
+  PIC_IR_DIV,
+  PIC_IR_MINUS,
+  PIC_IR_EQ,
+  PIC_IR_LT,
+  PIC_IR_LE,
+  PIC_IR_GT,
+  PIC_IR_GE,
+  PIC_IR_NOT,
+  PIC_IR_VECREF,
+  PIC_IR_VECSET,
+  PIC_IR_VECLEN,
+  PIC_IR_STRREF,
+  PIC_IR_BLOBREF,
+  PIC_IR_BLOBSET,
+  PIC_IR_EQP,
+  PIC_IR_EQVP,
+  PIC_IR_CHAREQ
+};
+
+typedef struct pic_ir pic_ir;
+
+typedef struct {
+  pic_sym **v;
+  size_t n;
+} pic_ir_vars;
+
+struct pic_ir_lambda {
+  pic_sym *name;                /* NULL if anonymous */
+  pic_ir_vars args, locals;     /* rest args variable is counted as a local */
+  pic_ir_vars captures;
+  bool varg;
+  pic_ir *body;
+  pic_value source;             /* the expanded lambda expression, or undef */
+};
+
+/*
+ * Subexpressions, in evaluation order unless noted:
+ *   setbang  var ref, value
+ *   if       test, then, else
+ *   call     procedure, args...
+ *   call-with-values  producer, consumer (the consumer is evaluated first)
+ *   gt, ge   left, right (the right operand is evaluated first)
+ */
+struct pic_ir {
+  enum pic_ir_kind kind;
+  bool unsafe;                  /* operands are known to have the right type */
+  int line;                     /* in the source, 0 if not known */
+  union {
+    pic_value quote;
+    struct {
+      pic_sym *sym;
+      int depth;                /* cref only */
+    } var;
+    struct {
+      pic_ir **v;
+      size_t n;
+    } elts;
+    struct pic_ir_lambda *lambda;
+  } u;
+};
+
+#define pic_ir_elt(ir, i) ((ir)->u.elts.v[i])
+#define pic_ir_len(ir) ((ir)->u.elts.n)
+#define pic_ir_sym(ir) ((ir)->u.var.sym)
+#define pic_ir_depth(ir) ((ir)->u.var.depth)
+#define pic_ir_lambda(ir) ((ir)->u.lambda)
+
+#define pic_ir_var_p(ir) ((ir)->kind == PIC_IR_LREF || (ir)->kind == PIC_IR_CREF)
+#define pic_ir_ref_p(ir) ((ir)->kind == PIC_IR_GREF || pic_ir_var_p(ir))
+
+typedef struct pic_ir_arena {
+  struct pic_ir_page *pages;
+  size_t used;                  /* bytes used in the first page */
+  xvect_t(pic_value) roots;     /* objects the nodes refer to that gc must keep */
+  pic_ir *root;                 /* the tree kept in a long-lived arena */
+  size_t pending;               /* lambdas in the tree still to be compiled */
+} pic_ir_arena;
+
+/* a lambda whose code is generated on its first call, from nodes kept in the arena */
+struct pic_ir_lazy {
+  struct pic_ir_lambda *lambda;
+  struct pic_ir_lambda **up;    /* enclosing lambdas, innermost first */
+  size_t depth;
+};
+
+/* the arena lives in a data object so that an aborted compilation is reclaimed by gc */
+struct pic_data *pic_ir_arena_new(pic_state *);
+void pic_ir_arena_release(pic_state *, pic_ir_arena *);
+#define pic_ir_arena_ptr(d) ((pic_ir_arena *)(d)->data)
+
+void *pic_ir_alloc(pic_state *, pic_ir_arena *, size_t);
+void pic_ir_protect(pic_state *, pic_ir_arena *, pic_value);
+
+pic_ir *pic_ir_node(pic_state *, pic_ir_arena *, enum pic_ir_kind, size_t);
+pic_ir *pic_ir_quote(pic_state *, pic_ir_arena *, pic_value);
+pic_ir *pic_ir_ref(pic_state *, pic_ir_arena *, enum pic_ir_kind, pic_sym *, int);
+pic_ir *pic_ir_make_lambda(pic_state *, pic_ir_arena *, pic_sym *, bool);
+pic_ir_vars pic_ir_make_vars(pic_state *, pic_ir_arena *, pic_sym **, size_t);
+void pic_ir_append_vars(pic_state *, pic_ir_arena *, pic_ir_vars *, pic_sym **, size_t);
+
+pic_ir *pic_ir_copy(pic_state *, pic_ir_arena *, pic_ir *);
+void pic_ir_keep(pic_state *, pic_ir_arena *, pic_ir *);
+pic_value pic_ir_to_list(pic_state *, pic_ir *);
+
+pic_ir *pic_analyze(pic_state *, pic_ir_arena *, pic_value);
+pic_ir *pic_optimize(pic_state *, pic_ir_arena *, pic_ir *);
+struct pic_irep *pic_codegen(pic_state *, pic_ir *, struct pic_data *, int); /* the arena of ir, or NULL to compile all at once */
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
@@ -26,6 +26,7 @@ enum pic_opcode {
   OP_CSET,
   OP_JMP,
   OP_JMPIF,
+  OP_JMPIFNOT,
   OP_NOT,
   OP_CALL,
   OP_TAILCALL,
@@ -37,6 +38,15 @@ enum pic_opcode {
   OP_NILP,
   OP_SYMBOLP,
   OP_PAIRP,
+  OP_VECREF,
+  OP_VECSET,
+  OP_VECLEN,
+  OP_STRREF,
+  OP_BLOBREF,
+  OP_BLOBSET,
+  OP_EQP,
+  OP_EQVP,
+  OP_CHAREQ,
   OP_ADD,
   OP_SUB,
   OP_MUL,
@@ -45,6 +55,14 @@ enum pic_opcode {
   OP_EQ,
   OP_LT,
   OP_LE,
+  OP_CAR_UNSAFE,
+  OP_CDR_UNSAFE,
+  OP_ADD_FX,
+  OP_SUB_FX,
+  OP_MUL_FX,
+  OP_EQ_FX,
+  OP_LT_FX,
+  OP_LE_FX,
   OP_STOP
 };
 
@@ -65,6 +83,11 @@ struct pic_code {
     code.u.i = ival;                            \
   } while (0)
 
+/* code from pc on, up to the next entry, comes from line (0 if not known) */
+struct pic_line {
+  int pc, line;
+};
+
 struct pic_irep {
   PIC_OBJECT_HEADER
   pic_sym *name;
@@ -75,10 +98,59 @@ struct pic_irep {
   pic_value *pool;
   pic_sym **syms;
   size_t clen, ilen, plen, slen;
+  struct pic_line *lines;       /* kept apart from the code, looked at only by backtraces */
+  size_t llen;
+#if PIC_LAZY_CODEGEN
+  struct pic_data *ir;          /* arena of a body not compiled yet, or NULL */
+  struct pic_ir_lazy *lazy;
+#endif
+  /* profile */
+  int tier;                     /* 0 when compiled unoptimized, 1 when optimized */
+  size_t calls, loops;          /* entries, and tail calls to itself */
+  pic_value source;             /* expanded lambda expression to optimize, or undef */
+  struct pic_irep *tiered;      /* the optimized code to run instead, or NULL */
+  /* native code */
+  struct pic_jit_code *jit;     /* or NULL */
+  bool jit_failed;              /* not to be translated again */
+};
+
+/* a slot of the compile cache, keyed by the structure of the form and its library */
+struct pic_cache_entry {
+  size_t hash;
+  pic_value form;               /* private copy of the form */
+  struct pic_lib *lib;
+  size_t nglobals;              /* number of globals when compiled */
+  struct pic_irep *irep;        /* NULL if the slot is empty */
 };
 
-pic_value pic_analyze(pic_state *, pic_value);
-struct pic_irep *pic_codegen(pic_state *, pic_value);
+void pic_cache_invalidate(pic_state *);
+
+int pic_irep_line(struct pic_irep *, pic_code *);
+
+void pic_tier_up(pic_state *, struct pic_irep *);
+
+pic_code *pic_jit_run(pic_state *, struct pic_irep *, pic_code *); /* where the VM goes on */
+void pic_jit_free(pic_state *, struct pic_irep *);
+
+#if PIC_LAZY_CODEGEN
+void pic_codegen_lazy(pic_state *, struct pic_irep *);
+
+/* fills in the code of a procedure compiled lazily, before it is run */
+#define pic_irep_prepare(pic, irep) do {        \
+    if ((irep)->ir != NULL) {                   \
+      pic_codegen_lazy(pic, irep);              \
+    }                                           \
+  } while (0)
+#endif
+
+void pic_dump_irep_file(pic_state *, struct pic_irep *, xFILE *);
+struct pic_irep *pic_load_irep_file(pic_state *, xFILE *); /* NULL at end of file */
+
+void pic_snapshot_start(pic_state *, xFILE *);
+void pic_snapshot_code(pic_state *, struct pic_irep *);
+void pic_snapshot_macro(pic_state *, struct pic_lib *, pic_sym *, struct pic_irep *);
+void pic_snapshot_export(pic_state *, struct pic_lib *, pic_sym *, pic_sym *);
+void pic_load_snapshot(pic_state *, xFILE *);
 
 #if DEBUG
 
@@ -135,6 +207,9 @@ pic_dump_code(pic_code c)
   case OP_JMPIF:
     printf("OP_JMPIF\t%x\n", c.u.i);
     break;
+  case OP_JMPIFNOT:
+    printf("OP_JMPIFNOT\t%x\n", c.u.i);
+    break;
   case OP_NOT:
     puts("OP_NOT");
     break;
@@ -165,6 +240,33 @@ pic_dump_code(pic_code c)
   case OP_PAIRP:
     puts("OP_PAIRP");
     break;
+  case OP_VECREF:
+    puts("OP_VECREF");
+    break;
+  case OP_VECSET:
+    puts("OP_VECSET");
+    break;
+  case OP_VECLEN:
+    puts("OP_VECLEN");
+    break;
+  case OP_STRREF:
+    puts("OP_STRREF");
+    break;
+  case OP_BLOBREF:
+    puts("OP_BLOBREF");
+    break;
+  case OP_BLOBSET:
+    puts("OP_BLOBSET");
+    break;
+  case OP_EQP:
+    puts("OP_EQP");
+    break;
+  case OP_EQVP:
+    puts("OP_EQVP");
+    break;
+  case OP_CHAREQ:
+    puts("OP_CHAREQ");
+    break;
   case OP_CDR:
     puts("OP_CDR");
     break;
@@ -192,6 +294,30 @@ pic_dump_code(pic_code c)
   case OP_LE:
     puts("OP_LE");
     break;
+  case OP_CAR_UNSAFE:
+    puts("OP_CAR_UNSAFE");
+    break;
+  case OP_CDR_UNSAFE:
+    puts("OP_CDR_UNSAFE");
+    break;
+  case OP_ADD_FX:
+    puts("OP_ADD_FX");
+    break;
+  case OP_SUB_FX:
+    puts("OP_SUB_FX");
+    break;
+  case OP_MUL_FX:
+    puts("OP_MUL_FX");
+    break;
+  case OP_EQ_FX:
+    puts("OP_EQ_FX");
+    break;
+  case OP_LT_FX:
+    puts("OP_LT_FX");
+    break;
+  case OP_LE_FX:
+    puts("OP_LE_FX");
+    break;
   case OP_STOP:
     puts("OP_STOP");
     break;
@@ -205,11 +331,17 @@ pic_dump_irep(struct pic_irep *irep)
 
   printf("## irep %p\n", (void *)irep);
   printf("[clen = %zd, argc = %d, localc = %d, capturec = %d]\n", irep->clen, irep->argc, irep->localc, irep->capturec);
+  printf("[tier = %d, calls = %zu, loops = %zu%s]\n", irep->tier, irep->calls, irep->loops, irep->tiered ? ", replaced" : "");
   for (i = 0; i < irep->clen; ++i) {
     printf("%02x ", i);
     pic_dump_code(irep->code[i]);
   }
 
+#if PIC_LAZY_CODEGEN
+  if (irep->ir != NULL) {
+    printf("(not compiled yet)\n");
+  }
+#endif
   for (i = 0; i < irep->ilen; ++i) {
     pic_dump_irep(irep->irep[i]);
   }
@@ -31,6 +31,7 @@ bool pic_find_rename(pic_state *, struct pic_senv *, pic_sym *, pic_sym ** /* =
 void pic_put_rename(pic_state *, struct pic_senv *, pic_sym *, pic_sym *);
 
 void pic_define_syntactic_keyword(pic_state *, struct pic_senv *, pic_sym *, pic_sym *);
+void pic_define_syntax(pic_state *, struct pic_senv *, pic_sym *, pic_sym *, pic_value);
 
 #if defined(__cplusplus)
 }
@@ -26,6 +26,7 @@ struct pic_port {
   xFILE *file;
   int flags;
   int status;
+  int line, column;             /* of the last character read */
 };
 
 #define pic_port_p(v) (pic_type(v) == PIC_TT_PORT)
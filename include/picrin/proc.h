@@ -9,10 +9,21 @@
 extern "C" {
 #endif
 
+#define PIC_SIG_MAX 8
+
+/* argument descriptor compiled from a pic_get_args format */
+struct pic_sig {
+  pic_sigfunc_t f;
+  int reqc, optc;
+  char types[PIC_SIG_MAX];
+};
+
 /* native C function */
 struct pic_func {
   pic_func_t f;
   pic_sym *name;
+  struct pic_sig *sig;          /* NULL unless defined by pic_defun_sig */
+  struct pic_var *var;          /* the state of a parameter object, or NULL */
 };
 
 struct pic_env {
@@ -46,6 +57,7 @@ struct pic_proc {
 #define pic_env_ptr(o) ((struct pic_env *)pic_ptr(o))
 
 struct pic_proc *pic_make_proc(pic_state *, pic_func_t, const char *);
+struct pic_proc *pic_make_proc_sig(pic_state *, pic_sigfunc_t, const char *, const char *);
 struct pic_proc *pic_make_proc_irep(pic_state *, struct pic_irep *, struct pic_env *);
 
 pic_sym *pic_proc_name(struct pic_proc *);
@@ -24,6 +24,24 @@ struct pic_reader {
 struct pic_reader *pic_reader_open(pic_state *);
 void pic_reader_close(pic_state *, struct pic_reader *);
 
+/*
+ * Where a list was read, kept in pic->locs and not on the pairs. The
+ * table does not keep the pairs alive, and the expander passes the
+ * location of a form on to what it expands into.
+ */
+struct pic_loc {
+  int line, column;
+};
+
+/* the contents of the pair tell it from a later one at the same address */
+struct pic_loc_entry {
+  pic_value car, cdr;
+  struct pic_loc loc;
+};
+
+struct pic_loc *pic_loc_ref(pic_state *, pic_value); /* NULL if not known */
+void pic_loc_copy(pic_state *, pic_value, pic_value);
+
 #if defined(__cplusplus)
 }
 #endif
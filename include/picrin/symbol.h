@@ -17,6 +17,8 @@ struct pic_symbol {
 #define pic_sym_p(v) (pic_type(v) == PIC_TT_SYMBOL)
 #define pic_sym_ptr(v) ((struct pic_symbol *)pic_ptr(v))
 
+pic_sym *pic_make_symbol(pic_state *, pic_str *); /* uninterned */
+
 #if defined(__cplusplus)
 }
 #endif
@@ -75,7 +75,7 @@ typedef unsigned long pic_value;
 
 #define pic_ptr(v) ((void *)(v))
 #define pic_init_value(v,vtype) do {            \
-    v = (vtype << 3) + 7;                       \
+    v = ((vtype) << 3) + 7;                     \
   } while (0)
 
 PIC_INLINE enum pic_vtype
@@ -161,7 +161,8 @@ enum pic_tt {
   PIC_TT_IREP,
   PIC_TT_DATA,
   PIC_TT_DICT,
-  PIC_TT_RECORD
+  PIC_TT_RECORD,
+  PIC_TT_VAR
 };
 
 #define PIC_OBJECT_HEADER			\
@@ -323,6 +324,8 @@ pic_type_repr(enum pic_tt tt)
     return "dict";
   case PIC_TT_RECORD:
     return "record";
+  case PIC_TT_VAR:
+    return "var";
   }
   PIC_UNREACHABLE();
 }
@@ -0,0 +1,30 @@
+/**
+ * See Copyright Notice in picrin.h
+ */
+
+#ifndef PICRIN_VAR_H
+#define PICRIN_VAR_H
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/*
+ * The state of a parameter object. Bindings are shallow: value is
+ * always the current one, and parameterize swaps the values it binds
+ * in and out of here as its winder is entered and left.
+ */
+struct pic_var {
+  PIC_OBJECT_HEADER
+  pic_value value;
+  struct pic_proc *conv;        /* NULL if there is no converter */
+};
+
+#define pic_var_p(v) (pic_type(v) == PIC_TT_VAR)
+#define pic_var_ptr(v) ((struct pic_var *)pic_ptr(v))
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif
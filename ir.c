@@ -0,0 +1,388 @@
+/**
+ * See Copyright Notice in picrin.h
+ */
+
+#include "picrin.h"
+#include "picrin/pair.h"
+#include "picrin/data.h"
+#include "picrin/ir.h"
+
+struct pic_ir_page {
+  struct pic_ir_page *next;
+  size_t size;
+};
+
+/* every allocation is rounded up to keep pointers and values aligned */
+typedef union {
+  void *p;
+  pic_value v;
+  double d;
+} ir_align;
+
+#define IR_ROUND(n) (((n) + sizeof(ir_align) - 1) / sizeof(ir_align) * sizeof(ir_align))
+#define IR_HEADER IR_ROUND(sizeof(struct pic_ir_page))
+
+/**
+ * arena
+ */
+
+static void
+free_pages(pic_state *pic, pic_ir_arena *arena)
+{
+  struct pic_ir_page *page, *next;
+
+  for (page = arena->pages; page != NULL; page = next) {
+    next = page->next;
+    pic_free(pic, page);
+  }
+  arena->pages = NULL;
+  arena->used = 0;
+}
+
+static void
+arena_dtor(pic_state *pic, void *data)
+{
+  pic_ir_arena *arena = data;
+
+  free_pages(pic, arena);
+  xv_destroy(arena->roots);
+  pic_free(pic, arena);
+}
+
+static void
+arena_mark(pic_state *pic, void *data, void (*mark)(pic_state *, pic_value))
+{
+  pic_ir_arena *arena = data;
+  size_t i;
+
+  for (i = 0; i < xv_size(arena->roots); ++i) {
+    mark(pic, xv_A(arena->roots, i));
+  }
+}
+
+static const pic_data_type arena_type = { "ir-arena", arena_dtor, arena_mark };
+
+struct pic_data *
+pic_ir_arena_new(pic_state *pic)
+{
+  pic_ir_arena *arena;
+
+  arena = pic_alloc(pic, sizeof(pic_ir_arena));
+  arena->pages = NULL;
+  arena->used = 0;
+  xv_init(arena->roots);
+  arena->root = NULL;
+  arena->pending = 0;
+
+  return pic_data_alloc(pic, &arena_type, arena);
+}
+
+/* give the memory back now rather than when the data object is collected */
+void
+pic_ir_arena_release(pic_state *pic, pic_ir_arena *arena)
+{
+  free_pages(pic, arena);
+  xv_destroy(arena->roots);
+  xv_init(arena->roots);
+  arena->root = NULL;
+}
+
+void *
+pic_ir_alloc(pic_state *pic, pic_ir_arena *arena, size_t size)
+{
+  struct pic_ir_page *page;
+  size_t capa;
+
+  size = IR_ROUND(size);
+
+  if (arena->pages == NULL || arena->used + size > arena->pages->size) {
+    capa = size > PIC_IR_PAGE_SIZE ? size : PIC_IR_PAGE_SIZE;
+    page = pic_alloc(pic, IR_HEADER + capa);
+    page->size = capa;
+    if (arena->pages != NULL && size > PIC_IR_PAGE_SIZE) {
+      /* keep filling the current page after a large request */
+      page->next = arena->pages->next;
+      arena->pages->next = page;
+      return (char *)page + IR_HEADER;
+    }
+    page->next = arena->pages;
+    arena->pages = page;
+    arena->used = 0;
+  }
+  page = arena->pages;
+  arena->used += size;
+  return (char *)page + IR_HEADER + arena->used - size;
+}
+
+void
+pic_ir_protect(pic_state *pic, pic_ir_arena *arena, pic_value obj)
+{
+  if (pic_obj_p(obj)) {
+    xv_push(pic_value, arena->roots, obj);
+  }
+}
+
+/**
+ * node construction
+ */
+
+pic_ir *
+pic_ir_node(pic_state *pic, pic_ir_arena *arena, enum pic_ir_kind kind, size_t n)
+{
+  pic_ir *ir;
+
+  ir = pic_ir_alloc(pic, arena, sizeof(pic_ir));
+  ir->kind = kind;
+  ir->unsafe = false;
+  ir->line = 0;
+  ir->u.elts.v = n == 0 ? NULL : pic_ir_alloc(pic, arena, sizeof(pic_ir *) * n);
+  ir->u.elts.n = n;
+  return ir;
+}
+
+pic_ir *
+pic_ir_quote(pic_state *pic, pic_ir_arena *arena, pic_value obj)
+{
+  pic_ir *ir;
+
+  ir = pic_ir_alloc(pic, arena, sizeof(pic_ir));
+  ir->kind = PIC_IR_QUOTE;
+  ir->unsafe = false;
+  ir->line = 0;
+  ir->u.quote = obj;
+  return ir;
+}
+
+pic_ir *
+pic_ir_ref(pic_state *pic, pic_ir_arena *arena, enum pic_ir_kind kind, pic_sym *sym, int depth)
+{
+  pic_ir *ir;
+
+  ir = pic_ir_alloc(pic, arena, sizeof(pic_ir));
+  ir->kind = kind;
+  ir->unsafe = false;
+  ir->line = 0;
+  ir->u.var.sym = sym;
+  ir->u.var.depth = depth;
+  return ir;
+}
+
+pic_ir *
+pic_ir_make_lambda(pic_state *pic, pic_ir_arena *arena, pic_sym *name, bool varg)
+{
+  struct pic_ir_lambda *lambda;
+  pic_ir *ir;
+
+  lambda = pic_ir_alloc(pic, arena, sizeof(struct pic_ir_lambda));
+  lambda->name = name;
+  lambda->args.v = lambda->locals.v = lambda->captures.v = NULL;
+  lambda->args.n = lambda->locals.n = lambda->captures.n = 0;
+  lambda->varg = varg;
+  lambda->body = NULL;
+  lambda->source = pic_undef_value();
+
+  ir = pic_ir_alloc(pic, arena, sizeof(pic_ir));
+  ir->kind = PIC_IR_LAMBDA;
+  ir->unsafe = false;
+  ir->line = 0;
+  ir->u.lambda = lambda;
+  return ir;
+}
+
+pic_ir_vars
+pic_ir_make_vars(pic_state *pic, pic_ir_arena *arena, pic_sym **syms, size_t n)
+{
+  pic_ir_vars vars;
+
+  vars.v = n == 0 ? NULL : pic_ir_alloc(pic, arena, sizeof(pic_sym *) * n);
+  vars.n = n;
+  if (n != 0) {
+    memcpy(vars.v, syms, sizeof(pic_sym *) * n);
+  }
+  return vars;
+}
+
+void
+pic_ir_append_vars(pic_state *pic, pic_ir_arena *arena, pic_ir_vars *vars, pic_sym **syms, size_t n)
+{
+  pic_sym **v;
+
+  if (n == 0) {
+    return;
+  }
+  v = pic_ir_alloc(pic, arena, sizeof(pic_sym *) * (vars->n + n));
+  if (vars->n != 0) {
+    memcpy(v, vars->v, sizeof(pic_sym *) * vars->n);
+  }
+  memcpy(v + vars->n, syms, sizeof(pic_sym *) * n);
+  vars->v = v;
+  vars->n += n;
+}
+
+static void
+protect_vars(pic_state *pic, pic_ir_arena *arena, pic_ir_vars vars)
+{
+  size_t i;
+
+  for (i = 0; i < vars.n; ++i) {
+    pic_ir_protect(pic, arena, pic_obj_value(vars.v[i]));
+  }
+}
+
+static pic_ir_vars
+copy_vars(pic_state *pic, pic_ir_arena *arena, pic_ir_vars vars)
+{
+  protect_vars(pic, arena, vars);
+  return pic_ir_make_vars(pic, arena, vars.v, vars.n);
+}
+
+/* deep copy into another arena, which keeps alive everything the copy refers to */
+pic_ir *
+pic_ir_copy(pic_state *pic, pic_ir_arena *arena, pic_ir *ir)
+{
+  struct pic_ir_lambda *from, *to;
+  pic_ir *res;
+  size_t i;
+
+  switch (ir->kind) {
+  case PIC_IR_QUOTE:
+    pic_ir_protect(pic, arena, ir->u.quote);
+    return pic_ir_quote(pic, arena, ir->u.quote);
+  case PIC_IR_GREF:
+  case PIC_IR_LREF:
+  case PIC_IR_CREF:
+    pic_ir_protect(pic, arena, pic_obj_value(pic_ir_sym(ir)));
+    return pic_ir_ref(pic, arena, ir->kind, pic_ir_sym(ir), pic_ir_depth(ir));
+  case PIC_IR_LAMBDA:
+    from = pic_ir_lambda(ir);
+    if (from->name != NULL) {
+      pic_ir_protect(pic, arena, pic_obj_value(from->name));
+    }
+    res = pic_ir_make_lambda(pic, arena, from->name, from->varg);
+    to = pic_ir_lambda(res);
+    to->args = copy_vars(pic, arena, from->args);
+    to->locals = copy_vars(pic, arena, from->locals);
+    to->captures = copy_vars(pic, arena, from->captures);
+    to->body = pic_ir_copy(pic, arena, from->body);
+    to->source = from->source;
+    pic_ir_protect(pic, arena, from->source);
+    return res;
+  default:
+    res = pic_ir_node(pic, arena, ir->kind, pic_ir_len(ir));
+    res->unsafe = ir->unsafe;
+    res->line = ir->line;
+    for (i = 0; i < pic_ir_len(ir); ++i) {
+      pic_ir_elt(res, i) = pic_ir_copy(pic, arena, pic_ir_elt(ir, i));
+    }
+    return res;
+  }
+}
+
+static void
+protect_tree(pic_state *pic, pic_ir_arena *arena, pic_ir *ir)
+{
+  struct pic_ir_lambda *lambda;
+  size_t i;
+
+  switch (ir->kind) {
+  case PIC_IR_QUOTE:
+    pic_ir_protect(pic, arena, ir->u.quote);
+    return;
+  case PIC_IR_GREF:
+  case PIC_IR_LREF:
+  case PIC_IR_CREF:
+    pic_ir_protect(pic, arena, pic_obj_value(pic_ir_sym(ir)));
+    return;
+  case PIC_IR_LAMBDA:
+    lambda = pic_ir_lambda(ir);
+    if (lambda->name != NULL) {
+      pic_ir_protect(pic, arena, pic_obj_value(lambda->name));
+    }
+    protect_vars(pic, arena, lambda->args);
+    protect_vars(pic, arena, lambda->locals);
+    protect_vars(pic, arena, lambda->captures);
+    pic_ir_protect(pic, arena, lambda->source);
+    protect_tree(pic, arena, lambda->body);
+    return;
+  default:
+    for (i = 0; i < pic_ir_len(ir); ++i) {
+      protect_tree(pic, arena, pic_ir_elt(ir, i));
+    }
+    return;
+  }
+}
+
+/* keeps the tree after the compilation, and only what it refers to */
+void
+pic_ir_keep(pic_state *pic, pic_ir_arena *arena, pic_ir *ir)
+{
+  xv_destroy(arena->roots);
+  xv_init(arena->roots);
+  protect_tree(pic, arena, ir);
+  arena->root = ir;
+}
+
+/**
+ * printing
+ */
+
+static const char *ir_names[] = {
+  "quote", "gref", "lref", "cref", "set!", "lambda", "if", "begin",
+  "call", "tail-call", "call-with-values", "tailcall-with-values", "return",
+  "cons", "car", "cdr", "null?", "symbol?", "pair?",
+  "+", "-", "*", "/", "minus", "=", "<", "<=", ">", ">=", "not",
+  "vector-ref", "vector-set!", "vector-length", "string-ref",
+  "bytevector-u8-ref", "bytevector-u8-set!", "eq?", "eqv?", "char=?"
+};
+
+static pic_value
+vars_to_list(pic_state *pic, pic_ir_vars vars)
+{
+  pic_value list = pic_nil_value();
+  size_t i;
+
+  for (i = vars.n; i > 0; --i) {
+    pic_push(pic, pic_obj_value(vars.v[i - 1]), list);
+  }
+  return list;
+}
+
+/* the tree written as the list it used to be, for debugging */
+pic_value
+pic_ir_to_list(pic_state *pic, pic_ir *ir)
+{
+  struct pic_ir_lambda *lambda;
+  pic_value tag, list;
+  size_t i;
+
+  tag = pic_obj_value(pic_intern_cstr(pic, ir_names[ir->kind]));
+
+  switch (ir->kind) {
+  case PIC_IR_QUOTE:
+    return pic_list2(pic, tag, ir->u.quote);
+  case PIC_IR_GREF:
+  case PIC_IR_LREF:
+    return pic_list2(pic, tag, pic_obj_value(pic_ir_sym(ir)));
+  case PIC_IR_CREF:
+    return pic_list3(pic, tag, pic_int_value(pic_ir_depth(ir)), pic_obj_value(pic_ir_sym(ir)));
+  case PIC_IR_LAMBDA:
+    lambda = pic_ir_lambda(ir);
+    return pic_list7(pic, tag,
+                     lambda->name ? pic_obj_value(lambda->name) : pic_false_value(),
+                     vars_to_list(pic, lambda->args),
+                     vars_to_list(pic, lambda->locals),
+                     pic_bool_value(lambda->varg),
+                     vars_to_list(pic, lambda->captures),
+                     pic_ir_to_list(pic, lambda->body));
+  default:
+    list = pic_nil_value();
+    for (i = pic_ir_len(ir); i > 0; --i) {
+      pic_push(pic, pic_ir_to_list(pic, pic_ir_elt(ir, i - 1)), list);
+    }
+    list = pic_cons(pic, tag, list);
+    if (ir->unsafe) {
+      list = pic_cons(pic, pic_obj_value(pic_intern_cstr(pic, "unsafe")), list);
+    }
+    return list;
+  }
+}
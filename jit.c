@@ -0,0 +1,1259 @@
+/**
+ * See Copyright Notice in picrin.h
+ */
+
+#include "picrin.h"
+#include "picrin/pair.h"
+#include "picrin/vector.h"
+#include "picrin/string.h"
+#include "picrin/blob.h"
+#include "picrin/irep.h"
+#include "picrin/dict.h"
+#include "picrin/proc.h"
+#include "picrin/symbol.h"
+
+#if PIC_ENABLE_JIT && defined(__x86_64__) && defined(__linux__)
+
+#include <sys/mman.h>
+
+/*
+ * Template JIT for x86-64 hosts. The code of an irep is translated
+ * instruction by instruction: each one becomes a call to a helper below
+ * that does what the VM does for it, and jumps become native jumps.
+ * Instructions that push or pop frames (calls, returns, closure
+ * creation) are left to the VM: the native code returns the index of
+ * such an instruction, the VM runs it, and comes back into the native
+ * code at the next call or return. So the native code of an irep can be
+ * entered at any instruction, through the table of their addresses.
+ * A tail call to the running procedure itself is done in place, so
+ * loops do not leave the native code.
+ */
+
+struct pic_jit_code {
+  unsigned char *text;
+  size_t size;
+  int (*enter)(pic_state *, unsigned char *);
+  size_t offsets[1];            /* of each instruction in text */
+};
+
+#define PUSH(v) (*pic->sp++ = (v))
+#define POP() (*--pic->sp)
+
+/**
+ * helpers
+ */
+
+static void
+jit_pop(pic_state *pic, int i, int j)
+{
+  PIC_UNUSED(i);
+  PIC_UNUSED(j);
+
+  (void)(POP());
+}
+
+static void
+jit_pushnil(pic_state *pic, int i, int j)
+{
+  PIC_UNUSED(i);
+  PIC_UNUSED(j);
+
+  PUSH(pic_nil_value());
+}
+
+static void
+jit_pushtrue(pic_state *pic, int i, int j)
+{
+  PIC_UNUSED(i);
+  PIC_UNUSED(j);
+
+  PUSH(pic_true_value());
+}
+
+static void
+jit_pushfalse(pic_state *pic, int i, int j)
+{
+  PIC_UNUSED(i);
+  PIC_UNUSED(j);
+
+  PUSH(pic_false_value());
+}
+
+static void
+jit_pushint(pic_state *pic, int i, int j)
+{
+  PIC_UNUSED(j);
+
+  PUSH(pic_int_value(i));
+}
+
+static void
+jit_pushchar(pic_state *pic, int i, int j)
+{
+  PIC_UNUSED(j);
+
+  PUSH(pic_char_value((char)i));
+}
+
+static void
+jit_pushconst(pic_state *pic, int i, int j)
+{
+  PIC_UNUSED(j);
+
+  PUSH(pic->ci->irep->pool[i]);
+}
+
+static void
+jit_gref(pic_state *pic, int i, int j)
+{
+  pic_sym *sym = pic->ci->irep->syms[i];
+
+  PIC_UNUSED(j);
+
+  if (! pic_dict_has(pic, pic->globals, sym)) {
+    pic_errorf(pic, "logic flaw; reference to uninitialized global variable: %s", pic_symbol_name(pic, sym));
+  }
+  PUSH(pic_dict_ref(pic, pic->globals, sym));
+}
+
+static void
+jit_gset(pic_state *pic, int i, int j)
+{
+  pic_sym *sym = pic->ci->irep->syms[i];
+  pic_value val;
+
+  PIC_UNUSED(j);
+
+  val = POP();
+  pic_dict_set(pic, pic->globals, sym, val);
+}
+
+static void
+jit_lref(pic_state *pic, int i, int j)
+{
+  pic_callinfo *ci = pic->ci;
+
+  PIC_UNUSED(j);
+
+  if (ci->env != NULL && ci->env->regs == ci->env->storage) {
+    if (i >= ci->irep->argc + ci->irep->localc) {
+      PUSH(ci->env->regs[i - (ci->regs - ci->fp)]);
+      return;
+    }
+  }
+  PUSH(ci->fp[i]);
+}
+
+static void
+jit_lset(pic_state *pic, int i, int j)
+{
+  pic_callinfo *ci = pic->ci;
+
+  PIC_UNUSED(j);
+
+  if (ci->env != NULL && ci->env->regs == ci->env->storage) {
+    if (i >= ci->irep->argc + ci->irep->localc) {
+      ci->env->regs[i - (ci->regs - ci->fp)] = POP();
+      return;
+    }
+  }
+  ci->fp[i] = POP();
+}
+
+static void
+jit_cref(pic_state *pic, int depth, int idx)
+{
+  struct pic_env *env;
+
+  env = pic->ci->up;
+  while (--depth) {
+    env = env->up;
+  }
+  PUSH(env->regs[idx]);
+}
+
+static void
+jit_cset(pic_state *pic, int depth, int idx)
+{
+  struct pic_env *env;
+
+  env = pic->ci->up;
+  while (--depth) {
+    env = env->up;
+  }
+  env->regs[idx] = POP();
+}
+
+/* pops the condition of a branch */
+static int
+jit_test(pic_state *pic)
+{
+  return ! pic_false_p(POP());
+}
+
+static void
+jit_not(pic_state *pic, int i, int j)
+{
+  pic_value v;
+
+  PIC_UNUSED(i);
+  PIC_UNUSED(j);
+
+  v = pic_false_p(POP()) ? pic_true_value() : pic_false_value();
+  PUSH(v);
+}
+
+static void
+jit_cons(pic_state *pic, int i, int j)
+{
+  pic_value a, b;
+  size_t ai = pic_gc_arena_preserve(pic);
+
+  PIC_UNUSED(i);
+  PIC_UNUSED(j);
+
+  pic_gc_protect(pic, b = POP());
+  pic_gc_protect(pic, a = POP());
+  PUSH(pic_cons(pic, a, b));
+  pic_gc_arena_restore(pic, ai);
+}
+
+static void
+jit_car(pic_state *pic, int i, int j)
+{
+  pic_value p;
+
+  PIC_UNUSED(i);
+  PIC_UNUSED(j);
+
+  p = POP();
+  PUSH(pic_car(pic, p));
+}
+
+static void
+jit_cdr(pic_state *pic, int i, int j)
+{
+  pic_value p;
+
+  PIC_UNUSED(i);
+  PIC_UNUSED(j);
+
+  p = POP();
+  PUSH(pic_cdr(pic, p));
+}
+
+static void
+jit_nilp(pic_state *pic, int i, int j)
+{
+  pic_value p;
+
+  PIC_UNUSED(i);
+  PIC_UNUSED(j);
+
+  p = POP();
+  PUSH(pic_bool_value(pic_nil_p(p)));
+}
+
+static void
+jit_symbolp(pic_state *pic, int i, int j)
+{
+  pic_value p;
+
+  PIC_UNUSED(i);
+  PIC_UNUSED(j);
+
+  p = POP();
+  PUSH(pic_bool_value(pic_sym_p(p)));
+}
+
+static void
+jit_pairp(pic_state *pic, int i, int j)
+{
+  pic_value p;
+
+  PIC_UNUSED(i);
+  PIC_UNUSED(j);
+
+  p = POP();
+  PUSH(pic_bool_value(pic_pair_p(p)));
+}
+
+static void
+jit_vecref(pic_state *pic, int i, int j)
+{
+  pic_value v, k;
+
+  PIC_UNUSED(i);
+  PIC_UNUSED(j);
+
+  k = POP();
+  v = POP();
+  if (! pic_vec_p(v)) {
+    pic_errorf(pic, "vector-ref: expected vector, but got ~s", v);
+  }
+  if (! (pic_int_p(k) && pic_int(k) >= 0 && (size_t)pic_int(k) < pic_vec_ptr(v)->len)) {
+    pic_errorf(pic, "vector-ref: index out of range");
+  }
+  PUSH(pic_vec_ptr(v)->data[pic_int(k)]);
+}
+
+static void
+jit_vecset(pic_state *pic, int i, int j)
+{
+  pic_value v, k, o;
+
+  PIC_UNUSED(i);
+  PIC_UNUSED(j);
+
+  o = POP();
+  k = POP();
+  v = POP();
+  if (! pic_vec_p(v)) {
+    pic_errorf(pic, "vector-set!: expected vector, but got ~s", v);
+  }
+  if (! (pic_int_p(k) && pic_int(k) >= 0 && (size_t)pic_int(k) < pic_vec_ptr(v)->len)) {
+    pic_errorf(pic, "vector-set!: index out of range");
+  }
+  pic_vec_ptr(v)->data[pic_int(k)] = o;
+  PUSH(pic_none_value());
+}
+
+static void
+jit_veclen(pic_state *pic, int i, int j)
+{
+  pic_value v;
+
+  PIC_UNUSED(i);
+  PIC_UNUSED(j);
+
+  v = POP();
+  if (! pic_vec_p(v)) {
+    pic_errorf(pic, "vector-length: expected vector, but got ~s", v);
+  }
+  PUSH(pic_size_value(pic_vec_ptr(v)->len));
+}
+
+static void
+jit_strref(pic_state *pic, int i, int j)
+{
+  pic_value s, k;
+
+  PIC_UNUSED(i);
+  PIC_UNUSED(j);
+
+  k = POP();
+  s = POP();
+  if (! pic_str_p(s)) {
+    pic_errorf(pic, "string-ref: expected string, but got ~s", s);
+  }
+  if (! (pic_int_p(k) && pic_int(k) >= 0)) {
+    pic_errorf(pic, "string-ref: index out of range");
+  }
+  PUSH(pic_char_value(pic_str_ref(pic, pic_str_ptr(s), (size_t)pic_int(k))));
+}
+
+static void
+jit_blobref(pic_state *pic, int i, int j)
+{
+  pic_value b, k;
+
+  PIC_UNUSED(i);
+  PIC_UNUSED(j);
+
+  k = POP();
+  b = POP();
+  if (! pic_blob_p(b)) {
+    pic_errorf(pic, "bytevector-u8-ref: expected bytevector, but got ~s", b);
+  }
+  if (! (pic_int_p(k) && pic_int(k) >= 0 && (size_t)pic_int(k) < pic_blob_ptr(b)->len)) {
+    pic_errorf(pic, "bytevector-u8-ref: index out of range");
+  }
+  PUSH(pic_int_value(pic_blob_ptr(b)->data[pic_int(k)]));
+}
+
+static void
+jit_blobset(pic_state *pic, int i, int j)
+{
+  pic_value b, k, n;
+
+  PIC_UNUSED(i);
+  PIC_UNUSED(j);
+
+  n = POP();
+  k = POP();
+  b = POP();
+  if (! pic_blob_p(b)) {
+    pic_errorf(pic, "bytevector-u8-set!: expected bytevector, but got ~s", b);
+  }
+  if (! (pic_int_p(k) && pic_int(k) >= 0 && (size_t)pic_int(k) < pic_blob_ptr(b)->len)) {
+    pic_errorf(pic, "bytevector-u8-set!: index out of range");
+  }
+  if (! (pic_int_p(n) && 0 <= pic_int(n) && pic_int(n) <= 255)) {
+    pic_errorf(pic, "byte out of range");
+  }
+  pic_blob_ptr(b)->data[pic_int(k)] = (unsigned char)pic_int(n);
+  PUSH(pic_none_value());
+}
+
+static void
+jit_eqp(pic_state *pic, int i, int j)
+{
+  pic_value a, b;
+
+  PIC_UNUSED(i);
+  PIC_UNUSED(j);
+
+  b = POP();
+  a = POP();
+  PUSH(pic_bool_value(pic_eq_p(a, b)));
+}
+
+static void
+jit_eqvp(pic_state *pic, int i, int j)
+{
+  pic_value a, b;
+
+  PIC_UNUSED(i);
+  PIC_UNUSED(j);
+
+  b = POP();
+  a = POP();
+  PUSH(pic_bool_value(pic_eqv_p(a, b)));
+}
+
+static void
+jit_chareq(pic_state *pic, int i, int j)
+{
+  pic_value a, b;
+
+  PIC_UNUSED(i);
+  PIC_UNUSED(j);
+
+  b = POP();
+  a = POP();
+  if (! (pic_char_p(a) && pic_char_p(b))) {
+    pic_errorf(pic, "char=?: expected char, but got ~s", pic_char_p(a) ? b : a);
+  }
+  PUSH(pic_bool_value(pic_char(a) == pic_char(b)));
+}
+
+#if PIC_ENABLE_FLOAT
+# define DEFINE_ARITH_OP(name, op, guard)                       \
+  static void                                                   \
+  name(pic_state *pic, int i, int j)                            \
+  {                                                             \
+    pic_value a, b;                                             \
+    PIC_UNUSED(i);                                              \
+    PIC_UNUSED(j);                                              \
+    b = POP();                                                  \
+    a = POP();                                                  \
+    if (pic_int_p(a) && pic_int_p(b)) {                         \
+      double f = (double)pic_int(a) op (double)pic_int(b);      \
+      if (INT_MIN <= f && f <= INT_MAX && (guard)) {            \
+        PUSH(pic_int_value((int)f));                            \
+      }                                                         \
+      else {                                                    \
+        PUSH(pic_float_value(f));                               \
+      }                                                         \
+    }                                                           \
+    else if (pic_float_p(a) && pic_float_p(b)) {                \
+      PUSH(pic_float_value(pic_float(a) op pic_float(b)));      \
+    }                                                           \
+    else if (pic_int_p(a) && pic_float_p(b)) {                  \
+      PUSH(pic_float_value(pic_int(a) op pic_float(b)));        \
+    }                                                           \
+    else if (pic_float_p(a) && pic_int_p(b)) {                  \
+      PUSH(pic_float_value(pic_float(a) op pic_int(b)));        \
+    }                                                           \
+    else {                                                      \
+      pic_errorf(pic, #op " got non-number operands");          \
+    }                                                           \
+  }
+
+# define DEFINE_COMP_OP(name, op)                               \
+  static void                                                   \
+  name(pic_state *pic, int i, int j)                            \
+  {                                                             \
+    pic_value a, b;                                             \
+    PIC_UNUSED(i);                                              \
+    PIC_UNUSED(j);                                              \
+    b = POP();                                                  \
+    a = POP();                                                  \
+    if (pic_int_p(a) && pic_int_p(b)) {                         \
+      PUSH(pic_bool_value(pic_int(a) op pic_int(b)));           \
+    }                                                           \
+    else if (pic_float_p(a) && pic_float_p(b)) {                \
+      PUSH(pic_bool_value(pic_float(a) op pic_float(b)));       \
+    }                                                           \
+    else if (pic_int_p(a) && pic_float_p(b)) {                  \
+      PUSH(pic_bool_value(pic_int(a) op pic_float(b)));         \
+    }                                                           \
+    else if (pic_float_p(a) && pic_int_p(b)) {                  \
+      PUSH(pic_bool_value(pic_float(a) op pic_int(b)));         \
+    }                                                           \
+    else {                                                      \
+      pic_errorf(pic, #op " got non-number operands");          \
+    }                                                           \
+  }
+
+# define DEFINE_ARITH_OP_FX(name, op)                           \
+  static void                                                   \
+  name(pic_state *pic, int i, int j)                            \
+  {                                                             \
+    pic_value a, b;                                             \
+    double f;                                                   \
+    PIC_UNUSED(i);                                              \
+    PIC_UNUSED(j);                                              \
+    b = POP();                                                  \
+    a = POP();                                                  \
+    f = (double)pic_int(a) op (double)pic_int(b);               \
+    if (INT_MIN <= f && f <= INT_MAX) {                         \
+      PUSH(pic_int_value((int)f));                              \
+    }                                                           \
+    else {                                                      \
+      PUSH(pic_float_value(f));                                 \
+    }                                                           \
+  }
+
+DEFINE_ARITH_OP(jit_add, +, true)
+DEFINE_ARITH_OP(jit_sub, -, true)
+DEFINE_ARITH_OP(jit_mul, *, true)
+DEFINE_ARITH_OP(jit_div, /, f == round(f))
+
+#else
+# define DEFINE_ARITH_OP(name, op)                              \
+  static void                                                   \
+  name(pic_state *pic, int i, int j)                            \
+  {                                                             \
+    pic_value a, b;                                             \
+    PIC_UNUSED(i);                                              \
+    PIC_UNUSED(j);                                              \
+    b = POP();                                                  \
+    a = POP();                                                  \
+    if (pic_int_p(a) && pic_int_p(b)) {                         \
+      PUSH(pic_int_value(pic_int(a) op pic_int(b)));            \
+    }                                                           \
+    else {                                                      \
+      pic_errorf(pic, #op " got non-number operands");          \
+    }                                                           \
+  }
+
+# define DEFINE_COMP_OP(name, op)                               \
+  static void                                                   \
+  name(pic_state *pic, int i, int j)                            \
+  {                                                             \
+    pic_value a, b;                                             \
+    PIC_UNUSED(i);                                              \
+    PIC_UNUSED(j);                                              \
+    b = POP();                                                  \
+    a = POP();                                                  \
+    if (pic_int_p(a) && pic_int_p(b)) {                         \
+      PUSH(pic_bool_value(pic_int(a) op pic_int(b)));           \
+    }                                                           \
+    else {                                                      \
+      pic_errorf(pic, #op " got non-number operands");          \
+    }                                                           \
+  }
+
+# define DEFINE_ARITH_OP_FX(name, op)                           \
+  static void                                                   \
+  name(pic_state *pic, int i, int j)                            \
+  {                                                             \
+    pic_value a, b;                                             \
+    PIC_UNUSED(i);                                              \
+    PIC_UNUSED(j);                                              \
+    b = POP();                                                  \
+    a = POP();                                                  \
+    PUSH(pic_int_value(pic_int(a) op pic_int(b)));              \
+  }
+
+DEFINE_ARITH_OP(jit_add, +)
+DEFINE_ARITH_OP(jit_sub, -)
+DEFINE_ARITH_OP(jit_mul, *)
+DEFINE_ARITH_OP(jit_div, /)
+
+#endif
+
+static void
+jit_minus(pic_state *pic, int i, int j)
+{
+  pic_value n;
+
+  PIC_UNUSED(i);
+  PIC_UNUSED(j);
+
+  n = POP();
+  if (pic_int_p(n)) {
+    PUSH(pic_int_value(-pic_int(n)));
+  }
+#if PIC_ENABLE_FLOAT
+  else if (pic_float_p(n)) {
+    PUSH(pic_float_value(-pic_float(n)));
+  }
+#endif
+  else {
+    pic_errorf(pic, "unary - got a non-number operand");
+  }
+}
+
+DEFINE_COMP_OP(jit_eq, ==)
+DEFINE_COMP_OP(jit_lt, <)
+DEFINE_COMP_OP(jit_le, <=)
+
+static void
+jit_car_unsafe(pic_state *pic, int i, int j)
+{
+  pic_value p;
+
+  PIC_UNUSED(i);
+  PIC_UNUSED(j);
+
+  p = POP();
+  PUSH(pic_pair_ptr(p)->car);
+}
+
+static void
+jit_cdr_unsafe(pic_state *pic, int i, int j)
+{
+  pic_value p;
+
+  PIC_UNUSED(i);
+  PIC_UNUSED(j);
+
+  p = POP();
+  PUSH(pic_pair_ptr(p)->cdr);
+}
+
+DEFINE_ARITH_OP_FX(jit_add_fx, +)
+DEFINE_ARITH_OP_FX(jit_sub_fx, -)
+DEFINE_ARITH_OP_FX(jit_mul_fx, *)
+
+#define DEFINE_COMP_OP_FX(name, op)                             \
+  static void                                                   \
+  name(pic_state *pic, int i, int j)                            \
+  {                                                             \
+    pic_value a, b;                                             \
+    PIC_UNUSED(i);                                              \
+    PIC_UNUSED(j);                                              \
+    b = POP();                                                  \
+    a = POP();                                                  \
+    PUSH(pic_bool_value(pic_int(a) op pic_int(b)));             \
+  }
+
+DEFINE_COMP_OP_FX(jit_eq_fx, ==)
+DEFINE_COMP_OP_FX(jit_lt_fx, <)
+DEFINE_COMP_OP_FX(jit_le_fx, <=)
+
+/* a loop written as a tail call to the running procedure stays in native code */
+static int
+jit_self_tailcall(pic_state *pic, int argc)
+{
+  pic_callinfo *ci = pic->ci;
+  struct pic_irep *irep = ci->irep;
+  pic_value *argv = pic->sp - argc;
+  struct pic_proc *proc;
+  int i;
+
+  /* the VM counts the calls for tiering, and tears off captured variables */
+  if (PIC_TIER_THRESHOLD > 0 || ci->env != NULL) {
+    return 0;
+  }
+  if (! pic_proc_p(argv[0]) || ! pic_proc_irep_p(pic_proc_ptr(argv[0]))) {
+    return 0;
+  }
+  proc = pic_proc_ptr(argv[0]);
+  if (proc->u.irep != irep || irep->varg || argc != irep->argc) {
+    return 0;
+  }
+
+  for (i = 0; i < argc; ++i) {
+    ci->fp[i] = argv[i];
+  }
+  pic->sp = ci->fp + argc;
+  for (i = 0; i < irep->localc; ++i) {
+    PUSH(pic_undef_value());
+  }
+  ci->argc = argc;
+  ci->retc = 1;
+  ci->up = proc->env;
+  return 1;
+}
+
+typedef void (*jit_helper)(pic_state *, int, int);
+
+/* NULL for the instructions left to the VM */
+static jit_helper
+jit_helper_of(enum pic_opcode insn)
+{
+  switch (insn) {
+  case OP_POP: return jit_pop;
+  case OP_PUSHNIL: return jit_pushnil;
+  case OP_PUSHTRUE: return jit_pushtrue;
+  case OP_PUSHFALSE: return jit_pushfalse;
+  case OP_PUSHINT: return jit_pushint;
+  case OP_PUSHCHAR: return jit_pushchar;
+  case OP_PUSHCONST: return jit_pushconst;
+  case OP_GREF: return jit_gref;
+  case OP_GSET: return jit_gset;
+  case OP_LREF: return jit_lref;
+  case OP_LSET: return jit_lset;
+  case OP_CREF: return jit_cref;
+  case OP_CSET: return jit_cset;
+  case OP_NOT: return jit_not;
+  case OP_CONS: return jit_cons;
+  case OP_CAR: return jit_car;
+  case OP_CDR: return jit_cdr;
+  case OP_NILP: return jit_nilp;
+  case OP_SYMBOLP: return jit_symbolp;
+  case OP_PAIRP: return jit_pairp;
+  case OP_VECREF: return jit_vecref;
+  case OP_VECSET: return jit_vecset;
+  case OP_VECLEN: return jit_veclen;
+  case OP_STRREF: return jit_strref;
+  case OP_BLOBREF: return jit_blobref;
+  case OP_BLOBSET: return jit_blobset;
+  case OP_EQP: return jit_eqp;
+  case OP_EQVP: return jit_eqvp;
+  case OP_CHAREQ: return jit_chareq;
+  case OP_ADD: return jit_add;
+  case OP_SUB: return jit_sub;
+  case OP_MUL: return jit_mul;
+  case OP_DIV: return jit_div;
+  case OP_MINUS: return jit_minus;
+  case OP_EQ: return jit_eq;
+  case OP_LT: return jit_lt;
+  case OP_LE: return jit_le;
+  case OP_CAR_UNSAFE: return jit_car_unsafe;
+  case OP_CDR_UNSAFE: return jit_cdr_unsafe;
+  case OP_ADD_FX: return jit_add_fx;
+  case OP_SUB_FX: return jit_sub_fx;
+  case OP_MUL_FX: return jit_mul_fx;
+  case OP_EQ_FX: return jit_eq_fx;
+  case OP_LT_FX: return jit_lt_fx;
+  case OP_LE_FX: return jit_le_fx;
+  default: return NULL;
+  }
+}
+
+/**
+ * emitter
+ */
+
+typedef struct {
+  size_t pos;                   /* of the rel32 to patch */
+  size_t target;                /* instruction jumped to */
+} jit_fixup;
+
+typedef struct {
+  pic_state *pic;
+  xvect_t(unsigned char) buf;
+  xvect_t(jit_fixup) fixups;
+  size_t epilogue;
+} jit_state;
+
+static void
+emit_byte(jit_state *state, int b)
+{
+  pic_state *pic = state->pic;
+  unsigned char c = (unsigned char)b;
+
+  xv_push(unsigned char, state->buf, c);
+}
+
+static void
+emit_bytes(jit_state *state, const char *bytes, size_t n)
+{
+  size_t i;
+
+  for (i = 0; i < n; ++i) {
+    emit_byte(state, bytes[i]);
+  }
+}
+
+static void
+emit_imm32(jit_state *state, int i)
+{
+  unsigned int u = (unsigned int)i;
+
+  emit_byte(state, u & 0xff);
+  emit_byte(state, (u >> 8) & 0xff);
+  emit_byte(state, (u >> 16) & 0xff);
+  emit_byte(state, (u >> 24) & 0xff);
+}
+
+static void
+emit_imm64(jit_state *state, unsigned long u)
+{
+  int i;
+
+  for (i = 0; i < 8; ++i) {
+    emit_byte(state, (u >> (i * 8)) & 0xff);
+  }
+}
+
+static void
+patch_imm32(jit_state *state, size_t pos, int i)
+{
+  unsigned int u = (unsigned int)i;
+
+  xv_A(state->buf, pos) = u & 0xff;
+  xv_A(state->buf, pos + 1) = (u >> 8) & 0xff;
+  xv_A(state->buf, pos + 2) = (u >> 16) & 0xff;
+  xv_A(state->buf, pos + 3) = (u >> 24) & 0xff;
+}
+
+/* helper(pic, i, j) */
+static void
+emit_call(jit_state *state, void (*f)(void), int i, int j)
+{
+  emit_bytes(state, "\x48\x89\xdf", 3); /* mov rdi, rbx */
+  emit_byte(state, 0xbe);               /* mov esi, i */
+  emit_imm32(state, i);
+  emit_byte(state, 0xba);               /* mov edx, j */
+  emit_imm32(state, j);
+  emit_bytes(state, "\x48\xb8", 2);     /* movabs rax, f */
+  emit_imm64(state, (unsigned long)f);
+  emit_bytes(state, "\xff\xd0", 2);     /* call rax */
+}
+
+/* jmp or jcc to the instruction target, patched at the end */
+static void
+emit_jump(jit_state *state, const char *opcode, size_t n, size_t target)
+{
+  pic_state *pic = state->pic;
+  jit_fixup fixup;
+
+  emit_bytes(state, opcode, n);
+  fixup.pos = xv_size(state->buf);
+  fixup.target = target;
+  xv_push(jit_fixup, state->fixups, fixup);
+  emit_imm32(state, 0);
+}
+
+/* a jump within a template, to be bound by emit_here */
+static size_t
+emit_forward(jit_state *state, const char *opcode, size_t n)
+{
+  emit_bytes(state, opcode, n);
+  emit_imm32(state, 0);
+  return xv_size(state->buf) - 4;
+}
+
+static void
+emit_here(jit_state *state, size_t pos)
+{
+  patch_imm32(state, pos, (int)(xv_size(state->buf) - (pos + 4)));
+}
+
+/* return the index of an instruction to the VM */
+static void
+emit_exit(jit_state *state, size_t pc)
+{
+  emit_byte(state, 0xb8);               /* mov eax, pc */
+  emit_imm32(state, (int)pc);
+  emit_byte(state, 0xe9);               /* jmp epilogue */
+  emit_imm32(state, (int)(state->epilogue - (xv_size(state->buf) + 4)));
+}
+
+#if PIC_WORD_BOXING
+
+/*
+ * With word boxing a value is a machine word, so the simplest
+ * instructions are done in place on the VM stack instead of calling
+ * their helper. rbx holds pic, and rax the stack pointer pic->sp.
+ */
+
+#define SP_OFFSET ((int)offsetof(pic_state, sp))
+#define CI_OFFSET ((int)offsetof(pic_state, ci))
+
+static void
+emit_load_sp(jit_state *state)
+{
+  emit_bytes(state, "\x48\x8b\x83", 3); /* mov rax, [rbx + sp] */
+  emit_imm32(state, SP_OFFSET);
+}
+
+static void
+emit_store_sp(jit_state *state)
+{
+  emit_bytes(state, "\x48\x89\x83", 3); /* mov [rbx + sp], rax */
+  emit_imm32(state, SP_OFFSET);
+}
+
+static void
+emit_push_value(jit_state *state, pic_value v)
+{
+  emit_load_sp(state);
+  emit_bytes(state, "\x48\xb9", 2);     /* movabs rcx, v */
+  emit_imm64(state, v);
+  emit_bytes(state, "\x48\x89\x08", 3); /* mov [rax], rcx */
+  emit_bytes(state, "\x48\x83\xc0\x08", 4); /* add rax, 8 */
+  emit_store_sp(state);
+}
+
+/* rdx = pic->ci->fp if the frame has no env, or jump to the returned fixup */
+static size_t
+emit_load_fp(jit_state *state)
+{
+  size_t slow;
+
+  emit_bytes(state, "\x48\x8b\x93", 3); /* mov rdx, [rbx + ci] */
+  emit_imm32(state, CI_OFFSET);
+  emit_bytes(state, "\x48\x83\xba", 3); /* cmp qword [rdx + env], 0 */
+  emit_imm32(state, (int)offsetof(pic_callinfo, env));
+  emit_byte(state, 0);
+  slow = emit_forward(state, "\x0f\x85", 2); /* jne slow */
+  emit_bytes(state, "\x48\x8b\x92", 3); /* mov rdx, [rdx + fp] */
+  emit_imm32(state, (int)offsetof(pic_callinfo, fp));
+  return slow;
+}
+
+/* rcx = pic_int(b), rdx = pic_int(a), rax = sp after popping b */
+static void
+emit_pop_ints(jit_state *state)
+{
+  emit_load_sp(state);
+  emit_bytes(state, "\x48\x8b\x48\xf8", 4); /* mov rcx, [rax - 8] */
+  emit_bytes(state, "\x48\x8b\x50\xf0", 4); /* mov rdx, [rax - 16] */
+  emit_bytes(state, "\x48\x83\xe8\x08", 4); /* sub rax, 8 */
+  emit_store_sp(state);
+  emit_bytes(state, "\x48\xc1\xe9\x02", 4); /* shr rcx, 2 */
+  emit_bytes(state, "\x48\xc1\xea\x02", 4); /* shr rdx, 2 */
+}
+
+/* [rax - 8] = pic_bool_value(cond), for the cmov opcode of cond */
+static void
+emit_set_bool(jit_state *state, const char *cmov)
+{
+  emit_bytes(state, "\x48\xbe", 2);     /* movabs rsi, #f */
+  emit_imm64(state, pic_false_value());
+  emit_bytes(state, "\x48\xbf", 2);     /* movabs rdi, #t */
+  emit_imm64(state, pic_true_value());
+  emit_bytes(state, "\x48\x0f", 2);     /* cmovcc rsi, rdi */
+  emit_bytes(state, cmov, 1);
+  emit_byte(state, 0xf7);
+  emit_bytes(state, "\x48\x89\x70\xf8", 4); /* mov [rax - 8], rsi */
+}
+
+static bool
+emit_inline(jit_state *state, struct pic_irep *irep, pic_code c)
+{
+  size_t slow, done;
+
+  switch (c.insn) {
+  case OP_POP:
+    emit_bytes(state, "\x48\x83\xab", 3); /* sub qword [rbx + sp], 8 */
+    emit_imm32(state, SP_OFFSET);
+    emit_byte(state, 8);
+    return true;
+  case OP_PUSHNIL:
+    emit_push_value(state, pic_nil_value());
+    return true;
+  case OP_PUSHTRUE:
+    emit_push_value(state, pic_true_value());
+    return true;
+  case OP_PUSHFALSE:
+    emit_push_value(state, pic_false_value());
+    return true;
+  case OP_PUSHINT:
+    emit_push_value(state, pic_int_value(c.u.i));
+    return true;
+  case OP_PUSHCHAR:
+    emit_push_value(state, pic_char_value(c.u.c));
+    return true;
+  case OP_PUSHCONST:
+    emit_push_value(state, irep->pool[c.u.i]);
+    return true;
+  case OP_LREF:
+    slow = emit_load_fp(state);
+    emit_bytes(state, "\x48\x8b\x8a", 3); /* mov rcx, [rdx + 8i] */
+    emit_imm32(state, c.u.i * 8);
+    emit_load_sp(state);
+    emit_bytes(state, "\x48\x89\x08", 3); /* mov [rax], rcx */
+    emit_bytes(state, "\x48\x83\xc0\x08", 4); /* add rax, 8 */
+    emit_store_sp(state);
+    done = emit_forward(state, "\xe9", 1);
+    emit_here(state, slow);
+    emit_call(state, (void (*)(void))jit_lref, c.u.i, 0);
+    emit_here(state, done);
+    return true;
+  case OP_LSET:
+    slow = emit_load_fp(state);
+    emit_load_sp(state);
+    emit_bytes(state, "\x48\x83\xe8\x08", 4); /* sub rax, 8 */
+    emit_store_sp(state);
+    emit_bytes(state, "\x48\x8b\x08", 3); /* mov rcx, [rax] */
+    emit_bytes(state, "\x48\x89\x8a", 3); /* mov [rdx + 8i], rcx */
+    emit_imm32(state, c.u.i * 8);
+    done = emit_forward(state, "\xe9", 1);
+    emit_here(state, slow);
+    emit_call(state, (void (*)(void))jit_lset, c.u.i, 0);
+    emit_here(state, done);
+    return true;
+  case OP_NOT:
+    emit_load_sp(state);
+    emit_bytes(state, "\x48\xb9", 2);   /* movabs rcx, #f */
+    emit_imm64(state, pic_false_value());
+    emit_bytes(state, "\x48\x39\x48\xf8", 4); /* cmp [rax - 8], rcx */
+    emit_set_bool(state, "\x44");        /* cmove */
+    return true;
+  case OP_CAR_UNSAFE:
+  case OP_CDR_UNSAFE:
+    emit_load_sp(state);
+    emit_bytes(state, "\x48\x8b\x48\xf8", 4); /* mov rcx, [rax - 8] */
+    emit_bytes(state, "\x48\x8b\x89", 3); /* mov rcx, [rcx + car/cdr] */
+    emit_imm32(state, (int)(c.insn == OP_CAR_UNSAFE ? offsetof(struct pic_pair, car) : offsetof(struct pic_pair, cdr)));
+    emit_bytes(state, "\x48\x89\x48\xf8", 4); /* mov [rax - 8], rcx */
+    return true;
+#if ! PIC_ENABLE_FLOAT
+  case OP_ADD_FX:
+  case OP_SUB_FX:
+  case OP_MUL_FX:
+    emit_pop_ints(state);
+    if (c.insn == OP_ADD_FX) {
+      emit_bytes(state, "\x01\xca", 2);  /* add edx, ecx */
+    } else if (c.insn == OP_SUB_FX) {
+      emit_bytes(state, "\x29\xca", 2);  /* sub edx, ecx */
+    } else {
+      emit_bytes(state, "\x0f\xaf\xd1", 3); /* imul edx, ecx */
+    }
+    emit_bytes(state, "\xc1\xe2\x02", 3); /* shl edx, 2 */
+    emit_bytes(state, "\x83\xc2\x01", 3); /* add edx, 1 */
+    emit_bytes(state, "\x48\x63\xd2", 3); /* movsxd rdx, edx */
+    emit_bytes(state, "\x48\x89\x50\xf8", 4); /* mov [rax - 8], rdx */
+    return true;
+#endif
+  case OP_EQ_FX:
+  case OP_LT_FX:
+  case OP_LE_FX:
+    emit_pop_ints(state);
+    emit_bytes(state, "\x39\xca", 2);    /* cmp edx, ecx */
+    emit_set_bool(state, c.insn == OP_EQ_FX ? "\x44" : c.insn == OP_LT_FX ? "\x4c" : "\x4e"); /* cmove, cmovl, cmovle */
+    return true;
+  default:
+    return false;
+  }
+}
+
+/* pop the condition and jump if it is (jcc = jne) or is not (jcc = je) true */
+static bool
+emit_branch(jit_state *state, const char *jcc, size_t target)
+{
+  emit_load_sp(state);
+  emit_bytes(state, "\x48\x83\xe8\x08", 4); /* sub rax, 8 */
+  emit_store_sp(state);
+  emit_bytes(state, "\x48\xb9", 2);     /* movabs rcx, #f */
+  emit_imm64(state, pic_false_value());
+  emit_bytes(state, "\x48\x39\x08", 3); /* cmp [rax], rcx */
+  emit_jump(state, jcc, 2, target);
+  return true;
+}
+
+#else
+
+static bool
+emit_inline(jit_state *state, struct pic_irep *irep, pic_code c)
+{
+  PIC_UNUSED(state);
+  PIC_UNUSED(irep);
+  PIC_UNUSED(c);
+
+  return false;
+}
+
+static bool
+emit_branch(jit_state *state, const char *jcc, size_t target)
+{
+  PIC_UNUSED(state);
+  PIC_UNUSED(jcc);
+  PIC_UNUSED(target);
+
+  return false;
+}
+
+#endif
+
+static bool
+jit_translate(jit_state *state, struct pic_irep *irep, size_t *offsets)
+{
+  pic_code c;
+  size_t pc, target;
+  jit_helper f;
+
+  /* prologue: keep pic in rbx, align the stack, and go to the entry */
+  emit_bytes(state, "\x53", 1);         /* push rbx */
+  emit_bytes(state, "\x41\x54", 2);     /* push r12 */
+  emit_bytes(state, "\x41\x55", 2);     /* push r13 */
+  emit_bytes(state, "\x48\x89\xfb", 3); /* mov rbx, rdi */
+  emit_bytes(state, "\xff\xe6", 2);     /* jmp rsi */
+
+  state->epilogue = xv_size(state->buf);
+  emit_bytes(state, "\x41\x5d", 2);     /* pop r13 */
+  emit_bytes(state, "\x41\x5c", 2);     /* pop r12 */
+  emit_bytes(state, "\x5b", 1);         /* pop rbx */
+  emit_bytes(state, "\xc3", 1);         /* ret */
+
+  for (pc = 0; pc < irep->clen; ++pc) {
+    c = irep->code[pc];
+    offsets[pc] = xv_size(state->buf);
+
+    switch (c.insn) {
+    case OP_NOP:
+      break;
+    case OP_JMP:
+    case OP_JMPIF:
+    case OP_JMPIFNOT:
+      target = pc + c.u.i;
+      if (c.u.i < 0 ? (size_t)-c.u.i > pc : target > irep->clen) {
+        return false;
+      }
+      if (c.insn == OP_JMP) {
+        emit_jump(state, "\xe9", 1, target);
+        break;
+      }
+      if (emit_branch(state, c.insn == OP_JMPIF ? "\x0f\x85" : "\x0f\x84", target)) {
+        break;
+      }
+      emit_call(state, (void (*)(void))jit_test, 0, 0);
+      emit_bytes(state, "\x85\xc0", 2); /* test eax, eax */
+      if (c.insn == OP_JMPIF) {
+        emit_jump(state, "\x0f\x85", 2, target); /* jnz */
+      } else {
+        emit_jump(state, "\x0f\x84", 2, target); /* jz */
+      }
+      break;
+    case OP_TAILCALL:
+      if (c.u.i != -1) {
+        emit_call(state, (void (*)(void))jit_self_tailcall, c.u.i, 0);
+        emit_bytes(state, "\x85\xc0", 2); /* test eax, eax */
+        emit_jump(state, "\x0f\x85", 2, 0); /* jnz to the start */
+      }
+      emit_exit(state, pc);
+      break;
+    default:
+      if (emit_inline(state, irep, c)) {
+        break;
+      }
+      if (c.insn == OP_CREF || c.insn == OP_CSET) {
+        emit_call(state, (void (*)(void))jit_helper_of(c.insn), c.u.r.depth, c.u.r.idx);
+      } else if (c.insn == OP_PUSHCHAR) {
+        emit_call(state, (void (*)(void))jit_pushchar, c.u.c, 0);
+      } else if ((f = jit_helper_of(c.insn)) != NULL) {
+        emit_call(state, (void (*)(void))f, c.u.i, 0);
+      } else {
+        emit_exit(state, pc);
+      }
+      break;
+    }
+  }
+  offsets[pc] = xv_size(state->buf);
+  emit_exit(state, pc);
+
+  return true;
+}
+
+static void
+jit_compile(pic_state *pic, struct pic_irep *irep)
+{
+  jit_state state;
+  struct pic_jit_code *jit;
+  jit_fixup fixup;
+  unsigned char *text;
+  size_t size, i;
+
+  irep->jit_failed = true;      /* unless it succeeds */
+
+  state.pic = pic;
+  xv_init(state.buf);
+  xv_init(state.fixups);
+
+  jit = pic_alloc(pic, sizeof(struct pic_jit_code) + sizeof(size_t) * irep->clen);
+
+  if (! jit_translate(&state, irep, jit->offsets)) {
+    goto fail;
+  }
+  for (i = 0; i < xv_size(state.fixups); ++i) {
+    fixup = xv_A(state.fixups, i);
+    patch_imm32(&state, fixup.pos, (int)(jit->offsets[fixup.target] - (fixup.pos + 4)));
+  }
+
+  size = xv_size(state.buf);
+  text = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (text == MAP_FAILED) {
+    goto fail;
+  }
+  for (i = 0; i < size; ++i) {
+    text[i] = xv_A(state.buf, i);
+  }
+  if (mprotect(text, size, PROT_READ | PROT_EXEC) != 0) {
+    munmap(text, size);
+    goto fail;
+  }
+
+  jit->text = text;
+  jit->size = size;
+  jit->enter = (int (*)(pic_state *, unsigned char *))(void *)text;
+  irep->jit = jit;
+  irep->jit_failed = false;
+
+  xv_destroy(state.buf);
+  xv_destroy(state.fixups);
+  return;
+
+ fail:
+  pic_free(pic, jit);
+  xv_destroy(state.buf);
+  xv_destroy(state.fixups);
+}
+
+pic_code *
+pic_jit_run(pic_state *pic, struct pic_irep *irep, pic_code *ip)
+{
+  struct pic_jit_code *jit;
+  int pc;
+
+  if (irep->jit == NULL) {
+    if (! pic->jit_enable || irep->jit_failed) {
+      return ip;
+    }
+    jit_compile(pic, irep);
+    if (irep->jit == NULL) {
+      return ip;
+    }
+  }
+  jit = irep->jit;
+  pc = jit->enter(pic, jit->text + jit->offsets[ip - irep->code]);
+  return irep->code + pc;
+}
+
+void
+pic_jit_free(pic_state *pic, struct pic_irep *irep)
+{
+  if (irep->jit != NULL) {
+    munmap(irep->jit->text, irep->jit->size);
+    pic_free(pic, irep->jit);
+    irep->jit = NULL;
+  }
+}
+
+#else
+
+/* no native code on this host: everything runs on the VM */
+
+pic_code *
+pic_jit_run(pic_state *pic, struct pic_irep *irep, pic_code *ip)
+{
+  PIC_UNUSED(pic);
+  PIC_UNUSED(irep);
+
+  return ip;
+}
+
+void
+pic_jit_free(pic_state *pic, struct pic_irep *irep)
+{
+  PIC_UNUSED(pic);
+  PIC_UNUSED(irep);
+}
+
+#endif
@@ -10,6 +10,7 @@
 #include "picrin/string.h"
 #include "picrin/proc.h"
 #include "picrin/dict.h"
+#include "picrin/irep.h"
 #include "picrin/symbol.h"
 
 struct pic_lib *
@@ -176,6 +177,10 @@ export(pic_state *pic, pic_value spec)
 
   pic_dict_set(pic, pic->lib->exports, pic_sym_ptr(b), pic_obj_value(rename));
 
+  if (pic->snapshot != NULL) {
+    pic_snapshot_export(pic, pic->lib, pic_sym_ptr(b), rename);
+  }
+
   return;
 
  fail:
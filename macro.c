@@ -12,6 +12,8 @@
 #include "picrin/dict.h"
 #include "picrin/cont.h"
 #include "picrin/symbol.h"
+#include "picrin/irep.h"
+#include "picrin/read.h"
 
 pic_sym *
 pic_add_rename(pic_state *pic, struct pic_senv *senv, pic_sym *sym)
@@ -27,6 +29,11 @@ void
 pic_put_rename(pic_state *pic, struct pic_senv *senv, pic_sym *sym, pic_sym *rename)
 {
   pic_dict_set(pic, senv->map, sym, pic_obj_value(rename));
+
+  /* a top-level binding changed, so compiled forms may refer to the wrong one */
+  if (senv->up == NULL) {
+    pic_cache_invalidate(pic);
+  }
 }
 
 bool
@@ -45,6 +52,8 @@ static void
 define_macro(pic_state *pic, pic_sym *rename, struct pic_proc *mac)
 {
   pic_dict_set(pic, pic->macros, rename, pic_obj_value(mac));
+
+  pic_cache_invalidate(pic);
 }
 
 static struct pic_proc *
@@ -135,6 +144,7 @@ macroexpand_deferred(pic_state *pic, struct pic_senv *senv)
     /* copy */
     pic_pair_ptr(dst)->car = pic_car(pic, val);
     pic_pair_ptr(dst)->cdr = pic_cdr(pic, val);
+    pic_loc_copy(pic, dst, src);
   }
 
   senv->defer = pic_nil_value();
@@ -211,6 +221,7 @@ macroexpand_defsyntax(pic_state *pic, pic_value expr, struct pic_senv *senv)
 {
   pic_value var, val;
   pic_sym *sym, *rename;
+  struct pic_proc *proc;
 
   if (pic_length(pic, expr) != 3) {
     pic_errorf(pic, "syntax error");
@@ -230,24 +241,38 @@ macroexpand_defsyntax(pic_state *pic, pic_value expr, struct pic_senv *senv)
   val = pic_cadr(pic, pic_cdr(pic, expr));
 
   pic_try {
-    val = pic_eval(pic, val, pic->lib);
+    proc = pic_compile(pic, val, pic->lib);
+
+    /* a toplevel definition is kept in the snapshot being recorded */
+    if (pic->snapshot != NULL && senv->up == NULL) {
+      pic_snapshot_macro(pic, pic->lib, sym, proc->u.irep);
+    }
+
+    val = pic_apply(pic, proc, pic_nil_value());
   } pic_catch {
     pic_errorf(pic, "macroexpand error while definition: %s", pic_errmsg(pic));
   }
 
+  pic_define_syntax(pic, senv, sym, rename, val);
+
+  return pic_none_value();
+}
+
+/* val is the value of the right hand side of define-syntax */
+void
+pic_define_syntax(pic_state *pic, struct pic_senv *senv, pic_sym *sym, pic_sym *rename, pic_value val)
+{
   if (! pic_proc_p(val)) {
-    pic_errorf(pic, "macro definition \"~s\" evaluates to non-procedure object", var);
+    pic_errorf(pic, "macro definition \"~s\" evaluates to non-procedure object", pic_obj_value(sym));
   }
 
   val = pic_apply1(pic, pic_proc_ptr(val), pic_obj_value(senv));
 
   if (! pic_proc_p(val)) {
-    pic_errorf(pic, "macro definition \"~s\" evaluates to non-procedure object", var);
+    pic_errorf(pic, "macro definition \"~s\" evaluates to non-procedure object", pic_obj_value(sym));
   }
 
   define_macro(pic, rename, pic_proc_ptr(val));
-
-  return pic_none_value();
 }
 
 static pic_value
@@ -336,6 +361,8 @@ macroexpand(pic_state *pic, pic_value expr, struct pic_senv *senv)
 
   v = macroexpand_node(pic, expr, senv);
 
+  pic_loc_copy(pic, v, expr);
+
   pic_gc_arena_restore(pic, ai);
   pic_gc_protect(pic, v);
   return v;
@@ -0,0 +1,1772 @@
+/**
+ * See Copyright Notice in picrin.h
+ */
+
+#include "picrin.h"
+#include "picrin/pair.h"
+#include "picrin/irep.h"
+#include "picrin/ir.h"
+#include "picrin/symbol.h"
+
+#include "picrin/dict.h"
+#include "picrin/data.h"
+
+/*
+ * The optimizer rewrites the tree built by pic_analyze in place. Every
+ * local variable in the tree is a fresh renamed symbol, so a variable
+ * can be identified by its symbol alone regardless of the depth it is
+ * referenced from.
+ */
+
+typedef struct inline_entry {
+  pic_sym *var;
+  pic_ir *lambda;
+  int depth;                    /* depth the lambda expression is evaluated at */
+  bool expanding;
+} inline_entry;
+
+typedef struct lift_info {
+  int sets, refs, calls;
+  int argc;                     /* argument count of the calls, -1 if they differ */
+  bool defined;                 /* assigned by an internal define */
+} lift_info;
+
+typedef struct lift_var {
+  pic_sym *var, *param;
+  int level;                    /* nesting level of the scope binding var */
+} lift_var;
+
+typedef xvect_t(lift_var) lift_vars;
+
+enum type {
+  TYPE_ANY,
+  TYPE_INT,
+  TYPE_PAIR
+};
+
+typedef struct type_fact {
+  pic_sym *var;
+  enum type type;
+} type_fact;
+
+typedef struct optimize_state {
+  pic_state *pic;
+  pic_ir_arena *arena;
+  xvect_t(pic_ir *) scopes;     /* enclosing lambda nodes, outermost first */
+  xvect_t(inline_entry) inlinables;
+  xhash vars;                   /* pic_sym * to lift_info */
+  xhash assigned;               /* variables that are target of set! */
+  xvect_t(type_fact) facts;     /* types known at the current point, newest last */
+} optimize_state;
+
+static pic_ir *
+make_quote(optimize_state *state, pic_value obj)
+{
+  return pic_ir_quote(state->pic, state->arena, obj);
+}
+
+static pic_ir *
+make_ref(optimize_state *state, pic_sym *var, int depth)
+{
+  if (depth == 0) {
+    return pic_ir_ref(state->pic, state->arena, PIC_IR_LREF, var, 0);
+  }
+  return pic_ir_ref(state->pic, state->arena, PIC_IR_CREF, var, depth);
+}
+
+static bool
+vars_memq(pic_ir_vars vars, pic_sym *var)
+{
+  size_t i;
+
+  for (i = 0; i < vars.n; ++i) {
+    if (vars.v[i] == var) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void
+remove_var(pic_ir_vars *vars, pic_sym *var)
+{
+  size_t i, j;
+
+  for (i = 0, j = 0; i < vars->n; ++i) {
+    if (vars->v[i] != var) {
+      vars->v[j++] = vars->v[i];
+    }
+  }
+  vars->n = j;
+}
+
+/**
+ * constant folding
+ */
+
+static bool
+fold_op1(optimize_state *state, enum pic_ir_kind op, pic_value a, pic_value *res)
+{
+  PIC_UNUSED(state);
+
+  /* car and cdr are not folded: a quoted list may still be changed by set-car! */
+  switch (op) {
+  case PIC_IR_NOT:
+    *res = pic_bool_value(pic_false_p(a));
+    return true;
+  case PIC_IR_NILP:
+    *res = pic_bool_value(pic_nil_p(a));
+    return true;
+  case PIC_IR_PAIRP:
+    *res = pic_bool_value(pic_pair_p(a));
+    return true;
+  case PIC_IR_SYMBOLP:
+    *res = pic_bool_value(pic_sym_p(a));
+    return true;
+  case PIC_IR_MINUS:
+    if (! (pic_int_p(a) && pic_int(a) != INT_MIN)) {
+      return false;
+    }
+    *res = pic_int_value(-pic_int(a));
+    return true;
+  default:
+    return false;
+  }
+}
+
+static bool
+fold_op2(optimize_state *state, enum pic_ir_kind op, pic_value a, pic_value b, pic_value *res)
+{
+  int x, y;
+
+  PIC_UNUSED(state);
+
+  /* anything else is left to the VM, which knows how to report errors */
+  if (! (pic_int_p(a) && pic_int_p(b))) {
+    return false;
+  }
+  x = pic_int(a);
+  y = pic_int(b);
+
+  switch (op) {
+  case PIC_IR_ADD:
+  case PIC_IR_SUB:
+  case PIC_IR_MUL:
+  case PIC_IR_DIV: {
+#if PIC_ENABLE_FLOAT
+    double f;
+
+    if (op == PIC_IR_ADD) {
+      f = (double)x + (double)y;
+    } else if (op == PIC_IR_SUB) {
+      f = (double)x - (double)y;
+    } else if (op == PIC_IR_MUL) {
+      f = (double)x * (double)y;
+    } else {
+      if (y == 0) {
+        return false;
+      }
+      f = (double)x / (double)y;
+      if (f != round(f)) {
+        return false;
+      }
+    }
+    if (! (INT_MIN <= f && f <= INT_MAX)) {
+      return false;
+    }
+    *res = pic_int_value((int)f);
+#else
+    if (op == PIC_IR_ADD) {
+      *res = pic_int_value((int)((unsigned)x + (unsigned)y));
+    } else if (op == PIC_IR_SUB) {
+      *res = pic_int_value((int)((unsigned)x - (unsigned)y));
+    } else if (op == PIC_IR_MUL) {
+      *res = pic_int_value((int)((unsigned)x * (unsigned)y));
+    } else {
+      if (y == 0 || (x == INT_MIN && y == -1)) {
+        return false;
+      }
+      *res = pic_int_value(x / y);
+    }
+#endif
+    return true;
+  }
+  case PIC_IR_EQ:
+    *res = pic_bool_value(x == y);
+    return true;
+  case PIC_IR_LT:
+    *res = pic_bool_value(x < y);
+    return true;
+  case PIC_IR_LE:
+    *res = pic_bool_value(x <= y);
+    return true;
+  case PIC_IR_GT:
+    *res = pic_bool_value(x > y);
+    return true;
+  case PIC_IR_GE:
+    *res = pic_bool_value(x >= y);
+    return true;
+  default:
+    return false;
+  }
+}
+
+static bool
+op1_p(enum pic_ir_kind kind)
+{
+  return kind == PIC_IR_CAR || kind == PIC_IR_CDR || kind == PIC_IR_NILP
+    || kind == PIC_IR_SYMBOLP || kind == PIC_IR_PAIRP || kind == PIC_IR_NOT
+    || kind == PIC_IR_MINUS;
+}
+
+static bool
+op2_p(enum pic_ir_kind kind)
+{
+  return kind == PIC_IR_ADD || kind == PIC_IR_SUB || kind == PIC_IR_MUL
+    || kind == PIC_IR_DIV || kind == PIC_IR_EQ || kind == PIC_IR_LT
+    || kind == PIC_IR_LE || kind == PIC_IR_GT || kind == PIC_IR_GE;
+}
+
+/* expressions that can be dropped when their value is not used */
+static bool
+pure_p(optimize_state *state, pic_ir *ir)
+{
+  switch (ir->kind) {
+  case PIC_IR_QUOTE: case PIC_IR_LREF: case PIC_IR_CREF: case PIC_IR_LAMBDA:
+    return true;
+  case PIC_IR_NOT: case PIC_IR_NILP: case PIC_IR_PAIRP: case PIC_IR_SYMBOLP:
+    return pure_p(state, pic_ir_elt(ir, 0));
+  case PIC_IR_EQP: case PIC_IR_EQVP:
+    return pure_p(state, pic_ir_elt(ir, 0)) && pure_p(state, pic_ir_elt(ir, 1));
+  default:
+    return false;
+  }
+}
+
+/**
+ * constant propagation
+ */
+
+static int
+count_sets(optimize_state *state, pic_ir *ir, pic_sym *var)
+{
+  int count = 0;
+  size_t i;
+
+  switch (ir->kind) {
+  case PIC_IR_QUOTE: case PIC_IR_GREF: case PIC_IR_LREF: case PIC_IR_CREF:
+    return 0;
+  case PIC_IR_LAMBDA:
+    return count_sets(state, pic_ir_lambda(ir)->body, var);
+  case PIC_IR_SETBANG:
+    if (pic_ir_sym(pic_ir_elt(ir, 0)) == var) {
+      count++;
+    }
+    return count + count_sets(state, pic_ir_elt(ir, 1), var);
+  default:
+    for (i = 0; i < pic_ir_len(ir); ++i) {
+      count += count_sets(state, pic_ir_elt(ir, i), var);
+    }
+    return count;
+  }
+}
+
+#define assigned_p(state, ir, var) (count_sets(state, ir, var) != 0)
+
+/* replace every reference to var in ir with (quote val) */
+static pic_ir *
+subst_var(optimize_state *state, pic_ir *ir, pic_sym *var, pic_value val)
+{
+  struct pic_ir_lambda *lambda;
+  size_t i;
+
+  switch (ir->kind) {
+  case PIC_IR_QUOTE: case PIC_IR_GREF:
+    return ir;
+  case PIC_IR_LREF: case PIC_IR_CREF:
+    if (pic_ir_sym(ir) == var) {
+      return make_quote(state, val);
+    }
+    return ir;
+  case PIC_IR_LAMBDA:
+    lambda = pic_ir_lambda(ir);
+    lambda->body = subst_var(state, lambda->body, var, val);
+    return ir;
+  case PIC_IR_SETBANG:
+    pic_ir_elt(ir, 1) = subst_var(state, pic_ir_elt(ir, 1), var, val);
+    return ir;
+  default:
+    for (i = 0; i < pic_ir_len(ir); ++i) {
+      pic_ir_elt(ir, i) = subst_var(state, pic_ir_elt(ir, i), var, val);
+    }
+    return ir;
+  }
+}
+
+/*
+ * ((lambda (x ...) body) (quote c) ...) where x is never assigned: every
+ * reference to x in body becomes (quote c). The argument is still passed,
+ * but x no longer occupies a slot in the closed environment.
+ */
+static void
+propagate_args(optimize_state *state, pic_ir *proc, pic_ir *call)
+{
+  struct pic_ir_lambda *lambda = pic_ir_lambda(proc);
+  size_t argc = pic_ir_len(call) - 1, i;
+  pic_sym *var;
+  pic_ir *arg;
+
+  if (argc < lambda->args.n) {
+    return;
+  }
+  if (! lambda->varg && argc != lambda->args.n) {
+    return;
+  }
+
+  for (i = 0; i < lambda->args.n; ++i) {
+    var = lambda->args.v[i];
+    arg = pic_ir_elt(call, i + 1);
+
+    if (arg->kind != PIC_IR_QUOTE) {
+      continue;
+    }
+    if (assigned_p(state, lambda->body, var)) {
+      continue;
+    }
+    lambda->body = subst_var(state, lambda->body, var, arg->u.quote);
+
+    remove_var(&lambda->captures, var);
+  }
+}
+
+/**
+ * procedure inlining
+ */
+
+static int
+node_size(optimize_state *state, pic_ir *ir)
+{
+  int size = 1;
+  size_t i;
+
+  switch (ir->kind) {
+  case PIC_IR_QUOTE: case PIC_IR_GREF: case PIC_IR_LREF: case PIC_IR_CREF:
+    return size;
+  case PIC_IR_LAMBDA:
+    return size + node_size(state, pic_ir_lambda(ir)->body);
+  default:
+    for (i = 0; i < pic_ir_len(ir); ++i) {
+      size += node_size(state, pic_ir_elt(ir, i));
+    }
+    return size;
+  }
+}
+
+/* number of references to and assignments of var */
+static int
+count_refs(optimize_state *state, pic_ir *ir, pic_sym *var)
+{
+  int count = 0;
+  size_t i;
+
+  switch (ir->kind) {
+  case PIC_IR_QUOTE:
+    return 0;
+  case PIC_IR_GREF: case PIC_IR_LREF: case PIC_IR_CREF:
+    return pic_ir_sym(ir) == var ? 1 : 0;
+  case PIC_IR_LAMBDA:
+    return count_refs(state, pic_ir_lambda(ir)->body, var);
+  default:
+    for (i = 0; i < pic_ir_len(ir); ++i) {
+      count += count_refs(state, pic_ir_elt(ir, i), var);
+    }
+    return count;
+  }
+}
+
+#if PIC_INLINE_GLOBAL
+
+/* does ir, nested n lambdas deep, refer to no local variable outside? */
+static bool
+closed_p(optimize_state *state, pic_ir *ir, int n)
+{
+  size_t i;
+
+  switch (ir->kind) {
+  case PIC_IR_QUOTE: case PIC_IR_GREF: case PIC_IR_LREF:
+    return true;
+  case PIC_IR_CREF:
+    return pic_ir_depth(ir) <= n;
+  case PIC_IR_LAMBDA:
+    return closed_p(state, pic_ir_lambda(ir)->body, n + 1);
+  default:
+    for (i = 0; i < pic_ir_len(ir); ++i) {
+      if (! closed_p(state, pic_ir_elt(ir, i), n)) {
+        return false;
+      }
+    }
+    return true;
+  }
+}
+
+#endif
+
+static bool
+inlinable_p(optimize_state *state, pic_ir *ir, pic_sym *var)
+{
+  struct pic_ir_lambda *lambda;
+
+  if (PIC_INLINE_SIZE <= 0 || ir->kind != PIC_IR_LAMBDA) {
+    return false;
+  }
+  lambda = pic_ir_lambda(ir);
+  if (lambda->varg) {
+    return false;
+  }
+  return node_size(state, lambda->body) <= PIC_INLINE_SIZE && count_refs(state, lambda->body, var) == 0;
+}
+
+static void
+push_inlinable(optimize_state *state, pic_sym *var, pic_ir *lambda, int depth)
+{
+  pic_state *pic = state->pic;
+  inline_entry e;
+
+  e.var = var;
+  e.lambda = lambda;
+  e.depth = depth;
+  e.expanding = false;
+  xv_push(inline_entry, state->inlinables, e);
+}
+
+static int
+find_inlinable(optimize_state *state, pic_sym *var)
+{
+  size_t i;
+
+  for (i = xv_size(state->inlinables); i > 0; --i) {
+    if (xv_A(state->inlinables, i - 1).var == var) {
+      return (int)i - 1;
+    }
+  }
+  return -1;
+}
+
+static pic_sym *
+rename_var(pic_sym *sym, xhash *renames)
+{
+  xh_entry *e;
+
+  if ((e = xh_get_ptr(renames, sym)) != NULL) {
+    return xh_val(e, pic_sym *);
+  }
+  return sym;
+}
+
+/* give fresh names to the variables bound by a copied lambda */
+static pic_ir_vars
+fresh_vars(optimize_state *state, pic_ir_vars vars, xhash *renames)
+{
+  pic_state *pic = state->pic;
+  pic_ir_vars res;
+  pic_sym *sym;
+  size_t i;
+
+  res = pic_ir_make_vars(pic, state->arena, vars.v, vars.n);
+  for (i = 0; i < vars.n; ++i) {
+    sym = pic_gensym(pic, vars.v[i]);
+    pic_ir_protect(pic, state->arena, pic_obj_value(sym));
+    xh_put_ptr(renames, vars.v[i], &sym);
+    res.v[i] = sym;
+  }
+  return res;
+}
+
+static pic_ir_vars
+rename_vars(optimize_state *state, pic_ir_vars vars, xhash *renames)
+{
+  pic_ir_vars res;
+  size_t i;
+
+  res = pic_ir_make_vars(state->pic, state->arena, vars.v, vars.n);
+  for (i = 0; i < vars.n; ++i) {
+    res.v[i] = rename_var(vars.v[i], renames);
+  }
+  return res;
+}
+
+/*
+ * Copy the body of an inlined lambda. ir is nested n lambdas deep in the
+ * callee, and free references reaching outside of it are moved by shift.
+ */
+static pic_ir *
+inline_copy(optimize_state *state, pic_ir *ir, int n, int shift, xhash *renames)
+{
+  pic_state *pic = state->pic;
+  struct pic_ir_lambda *from, *to;
+  pic_ir *res;
+  pic_sym *sym;
+  int depth;
+  size_t i;
+
+  switch (ir->kind) {
+  case PIC_IR_QUOTE:
+    return make_quote(state, ir->u.quote);
+  case PIC_IR_GREF:
+    return pic_ir_ref(pic, state->arena, PIC_IR_GREF, pic_ir_sym(ir), 0);
+  case PIC_IR_LREF:
+    return make_ref(state, rename_var(pic_ir_sym(ir), renames), 0);
+  case PIC_IR_CREF:
+    depth = pic_ir_depth(ir);
+    sym = rename_var(pic_ir_sym(ir), renames);
+    if (depth > n) {
+      depth += shift;
+    }
+    return make_ref(state, sym, depth);
+  case PIC_IR_LAMBDA:
+    from = pic_ir_lambda(ir);
+    res = pic_ir_make_lambda(pic, state->arena, from->name, from->varg);
+    to = pic_ir_lambda(res);
+    to->args = fresh_vars(state, from->args, renames);
+    to->locals = fresh_vars(state, from->locals, renames);
+    to->captures = rename_vars(state, from->captures, renames);
+    to->body = inline_copy(state, from->body, n + 1, shift, renames);
+    return res;
+  default:
+    /* the types an unsafe operation relied on may not hold at the call site */
+    res = pic_ir_node(pic, state->arena, ir->kind, pic_ir_len(ir));
+    res->line = ir->line;
+    for (i = 0; i < pic_ir_len(ir); ++i) {
+      pic_ir_elt(res, i) = inline_copy(state, pic_ir_elt(ir, i), n, shift, renames);
+    }
+    return res;
+  }
+}
+
+/* turn an expression in tail position into one that leaves its value on the stack */
+static bool
+untail(optimize_state *state, pic_ir **cell)
+{
+  pic_ir *ir = *cell;
+
+  switch (ir->kind) {
+  case PIC_IR_RETURN:
+    if (pic_ir_len(ir) != 1) {
+      return false;
+    }
+    *cell = pic_ir_elt(ir, 0);
+    return true;
+  case PIC_IR_TAILCALL:
+    ir->kind = PIC_IR_CALL;
+    return true;
+  case PIC_IR_TAILCALL_WITH_VALUES:
+    ir->kind = PIC_IR_CALL_WITH_VALUES;
+    return true;
+  case PIC_IR_IF:
+    return untail(state, &pic_ir_elt(ir, 1)) && untail(state, &pic_ir_elt(ir, 2));
+  case PIC_IR_BEGIN:
+    return untail(state, &pic_ir_elt(ir, pic_ir_len(ir) - 1));
+  default:
+    return false;
+  }
+}
+
+/*
+ * Replace (call f arg ...) by the body of f. Parameters bound to constants
+ * are substituted, the others become locals of the enclosing lambda.
+ * Returns NULL if the call cannot be inlined.
+ */
+static pic_ir *
+inline_call(optimize_state *state, pic_ir *call, pic_ir *proc, int depth)
+{
+  pic_state *pic = state->pic;
+  struct pic_ir_lambda *lambda = pic_ir_lambda(proc), *scope;
+  pic_ir_vars formals, locals, captures;
+  pic_ir *body, *arg, *seq;
+  xvect_t(pic_ir *) sets;
+  xhash renames;
+  pic_sym *var;
+  int shift;
+  size_t i;
+
+  if (pic_ir_len(call) - 1 != lambda->args.n) {
+    return NULL;
+  }
+  shift = (int)xv_size(state->scopes) - depth - 2;
+
+  xh_init_ptr(&renames, sizeof(pic_sym *));
+  formals = fresh_vars(state, lambda->args, &renames);
+  locals = fresh_vars(state, lambda->locals, &renames);
+  captures = rename_vars(state, lambda->captures, &renames);
+  body = inline_copy(state, lambda->body, 0, shift, &renames);
+  xh_destroy(&renames);
+
+  if (call->kind == PIC_IR_CALL && ! untail(state, &body)) {
+    return NULL;
+  }
+
+  xv_init(sets);
+  for (i = 0; i < formals.n; ++i) {
+    var = formals.v[i];
+    arg = pic_ir_elt(call, i + 1);
+
+    if (arg->kind == PIC_IR_QUOTE && ! assigned_p(state, body, var)) {
+      body = subst_var(state, body, var, arg->u.quote);
+      remove_var(&captures, var);
+    } else {
+      seq = pic_ir_node(pic, state->arena, PIC_IR_SETBANG, 2);
+      pic_ir_elt(seq, 0) = make_ref(state, var, 0);
+      pic_ir_elt(seq, 1) = arg;
+      xv_push(pic_ir *, sets, seq);
+      pic_ir_append_vars(pic, state->arena, &locals, &var, 1);
+    }
+  }
+
+  scope = pic_ir_lambda(xv_A(state->scopes, xv_size(state->scopes) - 1));
+  pic_ir_append_vars(pic, state->arena, &scope->locals, locals.v, locals.n);
+  pic_ir_append_vars(pic, state->arena, &scope->captures, captures.v, captures.n);
+
+  if (xv_size(sets) == 0) {
+    seq = body;
+  } else {
+    seq = pic_ir_node(pic, state->arena, PIC_IR_BEGIN, xv_size(sets) + 1);
+    for (i = 0; i < xv_size(sets); ++i) {
+      pic_ir_elt(seq, i) = xv_A(sets, i);
+    }
+    pic_ir_elt(seq, i) = body;
+  }
+  xv_destroy(sets);
+  return seq;
+}
+
+/**
+ * optimizer driver
+ */
+
+static pic_ir *optimize_node(optimize_state *, pic_ir *);
+
+static pic_ir *
+optimize(optimize_state *state, pic_ir *ir)
+{
+  pic_state *pic = state->pic;
+  size_t ai = pic_gc_arena_preserve(pic);
+  pic_ir *res;
+
+  /* fresh symbols are kept alive by the ir arena */
+  res = optimize_node(state, ir);
+
+  pic_gc_arena_restore(pic, ai);
+  return res;
+}
+
+static pic_ir *
+optimize_if(optimize_state *state, pic_ir *ir)
+{
+  pic_ir *cond;
+
+  cond = pic_ir_elt(ir, 0) = optimize(state, pic_ir_elt(ir, 0));
+  if (cond->kind == PIC_IR_QUOTE) {
+    if (pic_false_p(cond->u.quote)) {
+      return optimize(state, pic_ir_elt(ir, 2));
+    } else {
+      return optimize(state, pic_ir_elt(ir, 1));
+    }
+  }
+  if (cond->kind == PIC_IR_LAMBDA) {
+    return optimize(state, pic_ir_elt(ir, 1));
+  }
+
+  pic_ir_elt(ir, 1) = optimize(state, pic_ir_elt(ir, 1));
+  pic_ir_elt(ir, 2) = optimize(state, pic_ir_elt(ir, 2));
+  return ir;
+}
+
+static pic_ir *
+optimize_begin(optimize_state *state, pic_ir *ir)
+{
+  pic_state *pic = state->pic;
+  xvect_t(pic_ir *) seq;
+  pic_ir *elt, *res;
+  size_t i, j;
+
+  /* flatten nested begins and drop pure expressions whose value is unused */
+  xv_init(seq);
+  for (i = 0; i < pic_ir_len(ir); ++i) {
+    elt = optimize(state, pic_ir_elt(ir, i));
+    if (elt->kind == PIC_IR_BEGIN) {
+      for (j = 0; j < pic_ir_len(elt); ++j) {
+        xv_push(pic_ir *, seq, pic_ir_elt(elt, j));
+      }
+    } else {
+      xv_push(pic_ir *, seq, elt);
+    }
+  }
+
+  for (i = 0, j = 0; i < xv_size(seq); ++i) {
+    if (i + 1 == xv_size(seq) || ! pure_p(state, xv_A(seq, i))) {
+      xv_A(seq, j++) = xv_A(seq, i);
+    }
+  }
+
+  if (j == 1) {
+    res = xv_A(seq, 0);
+  } else {
+    res = pic_ir_node(pic, state->arena, PIC_IR_BEGIN, j);
+    for (i = 0; i < j; ++i) {
+      pic_ir_elt(res, i) = xv_A(seq, i);
+    }
+  }
+  xv_destroy(seq);
+  return res;
+}
+
+static void
+collect_defines(optimize_state *state, pic_ir *ir)
+{
+  struct pic_ir_lambda *lambda = pic_ir_lambda(ir);
+  pic_ir *body, *elt, *var, *val;
+  size_t i;
+
+  body = lambda->body;
+  if (body->kind != PIC_IR_BEGIN) {
+    return;
+  }
+  for (i = 0; i < pic_ir_len(body); ++i) {
+    elt = pic_ir_elt(body, i);
+    if (elt->kind != PIC_IR_SETBANG) {
+      continue;
+    }
+    var = pic_ir_elt(elt, 0);
+    val = pic_ir_elt(elt, 1);
+    if (var->kind != PIC_IR_LREF || ! vars_memq(lambda->locals, pic_ir_sym(var))) {
+      continue;
+    }
+    if (count_sets(state, body, pic_ir_sym(var)) == 1 && inlinable_p(state, val, pic_ir_sym(var))) {
+      push_inlinable(state, pic_ir_sym(var), val, (int)xv_size(state->scopes) - 1);
+    }
+  }
+}
+
+/* remove internal definitions whose every call has been inlined */
+static void
+drop_defines(optimize_state *state, pic_ir *ir, size_t from)
+{
+  struct pic_ir_lambda *lambda = pic_ir_lambda(ir);
+  pic_ir *body, *elt;
+  pic_sym *var;
+  size_t i, j;
+
+  body = lambda->body;
+  if (body->kind != PIC_IR_BEGIN) {
+    return;
+  }
+  for (i = from; i < xv_size(state->inlinables); ++i) {
+    var = xv_A(state->inlinables, i).var;
+    if (count_refs(state, body, var) != 1) {
+      continue;
+    }
+    for (j = 0; j < pic_ir_len(body); ++j) {
+      elt = pic_ir_elt(body, j);
+      if (elt->kind == PIC_IR_SETBANG && pic_ir_sym(pic_ir_elt(elt, 0)) == var) {
+        for (; j + 1 < pic_ir_len(body); ++j) {
+          pic_ir_elt(body, j) = pic_ir_elt(body, j + 1);
+        }
+        pic_ir_len(body)--;
+        break;
+      }
+    }
+    remove_var(&lambda->locals, var);
+    remove_var(&lambda->captures, var);
+  }
+}
+
+static pic_ir *
+optimize_lambda(optimize_state *state, pic_ir *ir)
+{
+  pic_state *pic = state->pic;
+  struct pic_ir_lambda *lambda = pic_ir_lambda(ir);
+  size_t n = xv_size(state->inlinables), i;
+  int self = -1;
+
+  /* a procedure is never inlined into itself, not even through another one */
+  for (i = 0; i < n; ++i) {
+    if (xv_A(state->inlinables, i).lambda == ir && ! xv_A(state->inlinables, i).expanding) {
+      xv_A(state->inlinables, i).expanding = true;
+      self = (int)i;
+    }
+  }
+
+  xv_push(pic_ir *, state->scopes, ir);
+
+  collect_defines(state, ir);
+
+  lambda->body = optimize(state, lambda->body);
+
+  drop_defines(state, ir, n);
+
+  state->inlinables.n = n;
+  (void)xv_pop(state->scopes);
+
+  if (self != -1) {
+    xv_A(state->inlinables, self).expanding = false;
+  }
+  return ir;
+}
+
+static void
+report_inline(optimize_state *state, pic_sym *var)
+{
+#if INLINE_DEBUG
+  pic_state *pic = state->pic;
+  pic_sym *name;
+
+  name = pic_ir_lambda(xv_A(state->scopes, xv_size(state->scopes) - 1))->name;
+  printf("inline: %s into %s\n", pic_symbol_name(pic, var),
+         name == NULL ? "(anonymous lambda)" : pic_symbol_name(pic, name));
+#else
+  PIC_UNUSED(state);
+  PIC_UNUSED(var);
+#endif
+}
+
+static pic_ir *
+optimize_let(optimize_state *state, pic_ir *ir)
+{
+  struct pic_ir_lambda *lambda;
+  size_t n = xv_size(state->inlinables), i;
+  pic_ir *proc, *arg;
+  pic_sym *var;
+  int k;
+
+  proc = pic_ir_elt(ir, 0);
+  lambda = pic_ir_lambda(proc);
+
+  propagate_args(state, proc, ir);
+
+  /* procedures bound by let */
+  for (i = 0; i < lambda->args.n && i + 1 < pic_ir_len(ir); ++i) {
+    var = lambda->args.v[i];
+    arg = pic_ir_elt(ir, i + 1);
+
+    if (inlinable_p(state, arg, var) && ! assigned_p(state, lambda->body, var)) {
+      push_inlinable(state, var, arg, (int)xv_size(state->scopes) - 1);
+    }
+  }
+
+  pic_ir_elt(ir, 0) = optimize(state, proc);
+
+  /* the closure is not created at all when every call has been inlined */
+  for (i = 0; i < lambda->args.n && i + 1 < pic_ir_len(ir); ++i) {
+    var = lambda->args.v[i];
+    k = find_inlinable(state, var);
+    if (k >= (int)n && count_refs(state, lambda->body, var) == 0) {
+      pic_ir_elt(ir, i + 1) = make_quote(state, pic_false_value());
+    }
+  }
+
+  state->inlinables.n = n;
+  return ir;
+}
+
+static pic_ir *
+optimize_call(optimize_state *state, pic_ir *ir)
+{
+  pic_ir *proc, *res;
+  pic_sym *var;
+  size_t i;
+  int k;
+
+  for (i = 1; i < pic_ir_len(ir); ++i) {
+    pic_ir_elt(ir, i) = optimize(state, pic_ir_elt(ir, i));
+  }
+
+  proc = pic_ir_elt(ir, 0);
+  if (proc->kind == PIC_IR_LAMBDA) {
+    return optimize_let(state, ir);
+  }
+
+  if (pic_ir_var_p(proc)) {
+    var = pic_ir_sym(proc);
+    k = find_inlinable(state, var);
+    if (k != -1 && ! xv_A(state->inlinables, k).expanding) {
+      res = inline_call(state, ir, xv_A(state->inlinables, k).lambda, xv_A(state->inlinables, k).depth);
+      if (res != NULL) {
+        report_inline(state, var);
+        xv_A(state->inlinables, k).expanding = true;
+        res = optimize(state, res);
+        xv_A(state->inlinables, k).expanding = false;
+        return res;
+      }
+    }
+  }
+#if PIC_INLINE_GLOBAL
+  else if (proc->kind == PIC_IR_GREF) {
+    pic_state *pic = state->pic;
+    pic_value data;
+    pic_ir *lambda;
+
+    var = pic_ir_sym(proc);
+    if (find_inlinable(state, var) == -1 && pic_dict_has(pic, pic->inlinables, var)) {
+      data = pic_dict_ref(pic, pic->inlinables, var);
+      lambda = pic_ir_arena_ptr(pic_data_ptr(data))->root;
+      res = inline_call(state, ir, lambda, -1);
+      if (res != NULL) {
+        /* the copy still refers to constants owned by the stored tree */
+        pic_ir_protect(pic, state->arena, data);
+        report_inline(state, var);
+        push_inlinable(state, var, lambda, -1);
+        xv_A(state->inlinables, xv_size(state->inlinables) - 1).expanding = true;
+        res = optimize(state, res);
+        xv_pop(state->inlinables);
+        return res;
+      }
+    }
+  }
+#endif
+
+  return ir;
+}
+
+static pic_ir *
+optimize_node(optimize_state *state, pic_ir *ir)
+{
+  pic_ir *a, *b;
+  pic_value v;
+  size_t i;
+
+  switch (ir->kind) {
+  case PIC_IR_QUOTE: case PIC_IR_GREF: case PIC_IR_LREF: case PIC_IR_CREF:
+    return ir;
+  case PIC_IR_LAMBDA:
+    return optimize_lambda(state, ir);
+  case PIC_IR_SETBANG:
+    pic_ir_elt(ir, 1) = optimize(state, pic_ir_elt(ir, 1));
+    return ir;
+  case PIC_IR_IF:
+    return optimize_if(state, ir);
+  case PIC_IR_BEGIN:
+    return optimize_begin(state, ir);
+  case PIC_IR_CALL: case PIC_IR_TAILCALL:
+    return optimize_call(state, ir);
+  default:
+    break;
+  }
+
+  for (i = 0; i < pic_ir_len(ir); ++i) {
+    pic_ir_elt(ir, i) = optimize(state, pic_ir_elt(ir, i));
+  }
+
+  if (op1_p(ir->kind)) {
+    a = pic_ir_elt(ir, 0);
+    if (a->kind == PIC_IR_QUOTE && fold_op1(state, ir->kind, a->u.quote, &v)) {
+      return make_quote(state, v);
+    }
+  }
+  else if (op2_p(ir->kind)) {
+    a = pic_ir_elt(ir, 0);
+    b = pic_ir_elt(ir, 1);
+    if (a->kind == PIC_IR_QUOTE && b->kind == PIC_IR_QUOTE
+        && fold_op2(state, ir->kind, a->u.quote, b->u.quote, &v)) {
+      return make_quote(state, v);
+    }
+  }
+  return ir;
+}
+
+/**
+ * lambda lifting
+ *
+ * A lambda whose free variables are all immutable and which is bound to a
+ * variable only ever used in operator position is rewritten to take those
+ * variables as extra arguments. It then has no free variables left, and
+ * codegen creates it once at compile time instead of on every evaluation.
+ */
+
+static lift_info *
+lift_info_of(optimize_state *state, pic_sym *var)
+{
+  xh_entry *e;
+  lift_info info;
+
+  if ((e = xh_get_ptr(&state->vars, var)) == NULL) {
+    info.sets = info.refs = info.calls = 0;
+    info.argc = 0;
+    info.defined = false;
+    e = xh_put_ptr(&state->vars, var, &info);
+  }
+  return &xh_val(e, lift_info);
+}
+
+static void
+lift_scan(optimize_state *state, pic_ir *ir)
+{
+  struct pic_ir_lambda *lambda;
+  pic_ir *elt, *var;
+  lift_info *info;
+  int argc;
+  size_t i;
+
+  switch (ir->kind) {
+  case PIC_IR_QUOTE: case PIC_IR_GREF:
+    return;
+  case PIC_IR_LREF: case PIC_IR_CREF:
+    lift_info_of(state, pic_ir_sym(ir))->refs++;
+    return;
+  case PIC_IR_LAMBDA:
+    lambda = pic_ir_lambda(ir);
+    if (lambda->body->kind == PIC_IR_BEGIN) {
+      for (i = 0; i < pic_ir_len(lambda->body); ++i) {
+        elt = pic_ir_elt(lambda->body, i);
+        if (elt->kind == PIC_IR_SETBANG && (var = pic_ir_elt(elt, 0))->kind == PIC_IR_LREF
+            && vars_memq(lambda->locals, pic_ir_sym(var))) {
+          lift_info_of(state, pic_ir_sym(var))->defined = true;
+        }
+      }
+    }
+    lift_scan(state, lambda->body);
+    return;
+  case PIC_IR_SETBANG:
+    lift_info_of(state, pic_ir_sym(pic_ir_elt(ir, 0)))->sets++;
+    lift_scan(state, pic_ir_elt(ir, 1));
+    return;
+  case PIC_IR_CALL: case PIC_IR_TAILCALL:
+    var = pic_ir_elt(ir, 0);
+    if (pic_ir_var_p(var)) {
+      info = lift_info_of(state, pic_ir_sym(var));
+      argc = (int)pic_ir_len(ir) - 1;
+      if (info->calls++ == 0) {
+        info->argc = argc;
+      } else if (info->argc != argc) {
+        info->argc = -1;
+      }
+    }
+    break;
+  default:
+    break;
+  }
+  for (i = 0; i < pic_ir_len(ir); ++i) {
+    lift_scan(state, pic_ir_elt(ir, i));
+  }
+}
+
+static bool
+immutable_p(optimize_state *state, pic_sym *var)
+{
+  lift_info *info = lift_info_of(state, var);
+
+  return info->sets == 0 || (info->sets == 1 && info->defined);
+}
+
+/* collect the variables ir refers to outside of the lambda being lifted */
+static bool
+lift_free_vars(optimize_state *state, pic_ir *ir, int n, int level, lift_vars *fv)
+{
+  pic_state *pic = state->pic;
+  pic_sym *var;
+  lift_var v;
+  size_t i;
+
+  switch (ir->kind) {
+  case PIC_IR_QUOTE: case PIC_IR_GREF: case PIC_IR_LREF:
+    return true;
+  case PIC_IR_CREF:
+    var = pic_ir_sym(ir);
+    if (pic_ir_depth(ir) <= n) {
+      return true;
+    }
+    for (i = 0; i < xv_size(*fv); ++i) {
+      if (xv_A(*fv, i).var == var) {
+        return true;
+      }
+    }
+    if (xv_size(*fv) >= PIC_LIFT_FREE_VARS || ! immutable_p(state, var)) {
+      return false;
+    }
+    v.var = var;
+    v.param = pic_gensym(pic, var);
+    v.level = level + n - pic_ir_depth(ir);
+    pic_ir_protect(pic, state->arena, pic_obj_value(v.param));
+    xv_push(lift_var, *fv, v);
+    return true;
+  case PIC_IR_LAMBDA:
+    return lift_free_vars(state, pic_ir_lambda(ir)->body, n + 1, level, fv);
+  default:
+    for (i = 0; i < pic_ir_len(ir); ++i) {
+      if (! lift_free_vars(state, pic_ir_elt(ir, i), n, level, fv)) {
+        return false;
+      }
+    }
+    return true;
+  }
+}
+
+/* pass the free variables of the lifted procedure at every call of var */
+static void
+lift_calls(optimize_state *state, pic_ir *ir, int level, pic_sym *var, lift_vars *fv)
+{
+  pic_state *pic = state->pic;
+  pic_ir *head, **elts;
+  size_t i, n;
+
+  switch (ir->kind) {
+  case PIC_IR_QUOTE: case PIC_IR_GREF: case PIC_IR_LREF: case PIC_IR_CREF:
+    return;
+  case PIC_IR_LAMBDA:
+    lift_calls(state, pic_ir_lambda(ir)->body, level + 1, var, fv);
+    return;
+  default:
+    break;
+  }
+  for (i = 0; i < pic_ir_len(ir); ++i) {
+    lift_calls(state, pic_ir_elt(ir, i), level, var, fv);
+  }
+  if (ir->kind == PIC_IR_CALL || ir->kind == PIC_IR_TAILCALL) {
+    head = pic_ir_elt(ir, 0);
+    if (pic_ir_var_p(head) && pic_ir_sym(head) == var) {
+      n = pic_ir_len(ir);
+      elts = pic_ir_alloc(pic, state->arena, sizeof(pic_ir *) * (n + xv_size(*fv)));
+      for (i = 0; i < n; ++i) {
+        elts[i] = pic_ir_elt(ir, i);
+      }
+      for (i = 0; i < xv_size(*fv); ++i) {
+        elts[n + i] = make_ref(state, xv_A(*fv, i).var, level - xv_A(*fv, i).level);
+        lift_info_of(state, xv_A(*fv, i).var)->refs++;
+      }
+      ir->u.elts.v = elts;
+      ir->u.elts.n = n + xv_size(*fv);
+    }
+  }
+}
+
+/* make the lifted procedure refer to its new parameters */
+static pic_ir *
+lift_subst(optimize_state *state, pic_ir *ir, int n, lift_vars *fv, bool *captured)
+{
+  struct pic_ir_lambda *lambda;
+  size_t i;
+
+  switch (ir->kind) {
+  case PIC_IR_QUOTE: case PIC_IR_GREF: case PIC_IR_LREF:
+    return ir;
+  case PIC_IR_CREF:
+    if (pic_ir_depth(ir) <= n) {
+      return ir;
+    }
+    for (i = 0; i < xv_size(*fv); ++i) {
+      if (xv_A(*fv, i).var == pic_ir_sym(ir)) {
+        if (n > 0) {
+          *captured = true;
+        }
+        return make_ref(state, xv_A(*fv, i).param, n);
+      }
+    }
+    return ir;
+  case PIC_IR_LAMBDA:
+    lambda = pic_ir_lambda(ir);
+    lambda->body = lift_subst(state, lambda->body, n + 1, fv, captured);
+    return ir;
+  default:
+    for (i = 0; i < pic_ir_len(ir); ++i) {
+      pic_ir_elt(ir, i) = lift_subst(state, pic_ir_elt(ir, i), n, fv, captured);
+    }
+    return ir;
+  }
+}
+
+/*
+ * var is bound to proc, which is evaluated at the given level. Every
+ * call of var is found in scope, whose body is at scope_level.
+ */
+static void
+lift_lambda(optimize_state *state, pic_sym *var, pic_ir *proc, int level, pic_ir *scope, int scope_level)
+{
+  pic_state *pic = state->pic;
+  struct pic_ir_lambda *lambda;
+  lift_vars fv;
+  lift_info *info;
+  bool captured = false;
+  size_t i;
+
+  info = lift_info_of(state, var);
+  if (proc->kind != PIC_IR_LAMBDA || pic_ir_lambda(proc)->varg) {
+    return;
+  }
+  lambda = pic_ir_lambda(proc);
+  if (info->calls == 0 || info->refs != info->calls || info->argc != (int)lambda->args.n) {
+    return;
+  }
+
+  xv_init(fv);
+  if (lift_free_vars(state, lambda->body, 0, level + 1, &fv) && xv_size(fv) > 0) {
+    lift_calls(state, pic_ir_lambda(scope)->body, scope_level, var, &fv);
+
+    lambda->body = lift_subst(state, lambda->body, 0, &fv, &captured);
+
+    for (i = 0; i < xv_size(fv); ++i) {
+      pic_ir_append_vars(pic, state->arena, &lambda->args, &xv_A(fv, i).param, 1);
+      if (captured) {
+        pic_ir_append_vars(pic, state->arena, &lambda->captures, &xv_A(fv, i).param, 1);
+      }
+    }
+    info->argc += (int)xv_size(fv);
+  }
+  xv_destroy(fv);
+}
+
+static void
+lift(optimize_state *state, pic_ir *ir, int level)
+{
+  struct pic_ir_lambda *lambda;
+  pic_ir *body, *elt, *var;
+  size_t i;
+
+  switch (ir->kind) {
+  case PIC_IR_QUOTE: case PIC_IR_GREF: case PIC_IR_LREF: case PIC_IR_CREF:
+    return;
+  case PIC_IR_LAMBDA:
+    body = pic_ir_lambda(ir)->body;
+    lift(state, body, level + 1);
+
+    /* internal defines */
+    if (body->kind == PIC_IR_BEGIN) {
+      for (i = 0; i < pic_ir_len(body); ++i) {
+        elt = pic_ir_elt(body, i);
+        if (elt->kind == PIC_IR_SETBANG && (var = pic_ir_elt(elt, 0))->kind == PIC_IR_LREF
+            && lift_info_of(state, pic_ir_sym(var))->defined
+            && lift_info_of(state, pic_ir_sym(var))->sets == 1) {
+          lift_lambda(state, pic_ir_sym(var), pic_ir_elt(elt, 1), level + 1, ir, level + 1);
+        }
+      }
+    }
+    return;
+  default:
+    break;
+  }
+  for (i = 0; i < pic_ir_len(ir); ++i) {
+    lift(state, pic_ir_elt(ir, i), level);
+  }
+
+  /* procedures bound by let */
+  if (ir->kind == PIC_IR_CALL || ir->kind == PIC_IR_TAILCALL) {
+    elt = pic_ir_elt(ir, 0);
+    if (elt->kind == PIC_IR_LAMBDA && ! pic_ir_lambda(elt)->varg) {
+      lambda = pic_ir_lambda(elt);
+      for (i = 0; i < lambda->args.n && i + 1 < pic_ir_len(ir); ++i) {
+        if (lift_info_of(state, lambda->args.v[i])->sets == 0) {
+          lift_lambda(state, lambda->args.v[i], pic_ir_elt(ir, i + 1), level, elt, level + 1);
+        }
+      }
+    }
+  }
+}
+
+static void
+collect_captured(optimize_state *state, pic_ir *ir, xhash *captured)
+{
+  int dummy = 0;
+  size_t i;
+
+  switch (ir->kind) {
+  case PIC_IR_QUOTE: case PIC_IR_GREF: case PIC_IR_LREF:
+    return;
+  case PIC_IR_CREF:
+    xh_put_ptr(captured, pic_ir_sym(ir), &dummy);
+    return;
+  case PIC_IR_LAMBDA:
+    collect_captured(state, pic_ir_lambda(ir)->body, captured);
+    return;
+  default:
+    for (i = 0; i < pic_ir_len(ir); ++i) {
+      collect_captured(state, pic_ir_elt(ir, i), captured);
+    }
+  }
+}
+
+/* drop the variables no closure refers to anymore from the capture lists */
+static void
+prune_captures(optimize_state *state, pic_ir *ir, xhash *captured)
+{
+  struct pic_ir_lambda *lambda;
+  size_t i, j;
+
+  switch (ir->kind) {
+  case PIC_IR_QUOTE: case PIC_IR_GREF: case PIC_IR_LREF: case PIC_IR_CREF:
+    return;
+  case PIC_IR_LAMBDA:
+    lambda = pic_ir_lambda(ir);
+    for (i = 0, j = 0; i < lambda->captures.n; ++i) {
+      if (xh_get_ptr(captured, lambda->captures.v[i]) != NULL) {
+        lambda->captures.v[j++] = lambda->captures.v[i];
+      }
+    }
+    lambda->captures.n = j;
+    prune_captures(state, lambda->body, captured);
+    return;
+  default:
+    for (i = 0; i < pic_ir_len(ir); ++i) {
+      prune_captures(state, pic_ir_elt(ir, i), captured);
+    }
+  }
+}
+
+static void
+lift_lambdas(optimize_state *state, pic_ir *ir)
+{
+  pic_state *pic = state->pic;
+  xhash captured;
+
+  xh_init_ptr(&state->vars, sizeof(lift_info));
+  lift_scan(state, ir);
+  lift(state, ir, -1);
+  xh_destroy(&state->vars);
+
+  xh_init_ptr(&captured, sizeof(int));
+  collect_captured(state, ir, &captured);
+  prune_captures(state, ir, &captured);
+  xh_destroy(&captured);
+}
+
+/**
+ * type inference
+ *
+ * Walks the tree in the order codegen evaluates it, keeping track of what
+ * is known about variables that are never assigned: the branches of pair?
+ * tests, and operands of primitives that have already been checked. A
+ * primitive whose operands are known to have the right type is marked
+ * unsafe and compiled to an unchecked instruction.
+ */
+
+static void
+collect_assigned(optimize_state *state, pic_ir *ir)
+{
+  int dummy = 0;
+  size_t i;
+
+  switch (ir->kind) {
+  case PIC_IR_QUOTE: case PIC_IR_GREF: case PIC_IR_LREF: case PIC_IR_CREF:
+    return;
+  case PIC_IR_LAMBDA:
+    collect_assigned(state, pic_ir_lambda(ir)->body);
+    return;
+  case PIC_IR_SETBANG:
+    xh_put_ptr(&state->assigned, pic_ir_sym(pic_ir_elt(ir, 0)), &dummy);
+    collect_assigned(state, pic_ir_elt(ir, 1));
+    return;
+  default:
+    for (i = 0; i < pic_ir_len(ir); ++i) {
+      collect_assigned(state, pic_ir_elt(ir, i));
+    }
+  }
+}
+
+static enum type
+lookup_type(optimize_state *state, pic_sym *var)
+{
+  size_t i;
+
+  for (i = xv_size(state->facts); i > 0; --i) {
+    if (xv_A(state->facts, i - 1).var == var) {
+      return xv_A(state->facts, i - 1).type;
+    }
+  }
+  return TYPE_ANY;
+}
+
+static void
+learn_type(optimize_state *state, pic_ir *ir, enum type type)
+{
+  pic_state *pic = state->pic;
+  type_fact fact;
+
+  if (! pic_ir_var_p(ir)) {
+    return;
+  }
+  fact.var = pic_ir_sym(ir);
+  fact.type = type;
+  if (xh_get_ptr(&state->assigned, fact.var) == NULL && lookup_type(state, fact.var) != type) {
+    xv_push(type_fact, state->facts, fact);
+  }
+}
+
+static void
+forget_types(optimize_state *state, size_t n)
+{
+  while (xv_size(state->facts) > n) {
+    (void)xv_pop(state->facts);
+  }
+}
+
+/* the variable a (pair? x) test is about */
+static pic_ir *
+pair_test(optimize_state *state, pic_ir *test)
+{
+  PIC_UNUSED(state);
+
+  if (test->kind == PIC_IR_PAIRP) {
+    return pic_ir_elt(test, 0);
+  }
+  return NULL;
+}
+
+static enum type infer(optimize_state *, pic_ir *);
+
+static enum type
+infer_if(optimize_state *state, pic_ir *ir)
+{
+  pic_state *pic = state->pic;
+  pic_ir *test;
+  xvect_t(type_fact) then_facts;
+  enum type then_type, else_type;
+  size_t n, i;
+
+  test = pic_ir_elt(ir, 0);
+  infer(state, test);
+  n = xv_size(state->facts);
+
+  if (pair_test(state, test) != NULL) {
+    learn_type(state, pair_test(state, test), TYPE_PAIR);
+  }
+  then_type = infer(state, pic_ir_elt(ir, 1));
+
+  xv_init(then_facts);
+  for (i = n; i < xv_size(state->facts); ++i) {
+    xv_push(type_fact, then_facts, xv_A(state->facts, i));
+  }
+  forget_types(state, n);
+
+  if (test->kind == PIC_IR_NOT && pair_test(state, pic_ir_elt(test, 0)) != NULL) {
+    learn_type(state, pair_test(state, pic_ir_elt(test, 0)), TYPE_PAIR);
+  }
+  else_type = infer(state, pic_ir_elt(ir, 2));
+
+  /* keep what both branches agree on */
+  for (i = 0; i < xv_size(then_facts); ++i) {
+    if (lookup_type(state, xv_A(then_facts, i).var) != xv_A(then_facts, i).type) {
+      xv_A(then_facts, i).var = NULL;
+    }
+  }
+  forget_types(state, n);
+  for (i = 0; i < xv_size(then_facts); ++i) {
+    if (xv_A(then_facts, i).var != NULL) {
+      xv_push(type_fact, state->facts, xv_A(then_facts, i));
+    }
+  }
+  xv_destroy(then_facts);
+
+  return then_type == else_type ? then_type : TYPE_ANY;
+}
+
+static enum type
+infer_op(optimize_state *state, pic_ir *ir)
+{
+  pic_ir *a, *b;
+  enum type ta, tb;
+
+  if (op1_p(ir->kind)) {
+    a = pic_ir_elt(ir, 0);
+    ta = infer(state, a);
+    if (ir->kind == PIC_IR_CAR || ir->kind == PIC_IR_CDR) {
+      if (ta == TYPE_PAIR) {
+        ir->unsafe = true;
+      }
+      learn_type(state, a, TYPE_PAIR);
+    }
+#if ! PIC_ENABLE_FLOAT
+    if (ir->kind == PIC_IR_MINUS) {
+      learn_type(state, a, TYPE_INT);
+      return TYPE_INT;
+    }
+#endif
+    return TYPE_ANY;
+  }
+
+  a = pic_ir_elt(ir, 0);
+  b = pic_ir_elt(ir, 1);
+  if (ir->kind == PIC_IR_GT || ir->kind == PIC_IR_GE) {
+    tb = infer(state, b);
+    ta = infer(state, a);
+  } else {
+    ta = infer(state, a);
+    tb = infer(state, b);
+  }
+  if (ir->kind == PIC_IR_CONS) {
+    return TYPE_PAIR;
+  }
+  if (ta == TYPE_INT && tb == TYPE_INT && ir->kind != PIC_IR_DIV) {
+    ir->unsafe = true;
+  }
+#if PIC_ENABLE_FLOAT
+  return TYPE_ANY;
+#else
+  /* without flonums a checked operation succeeds only on fixnums */
+  learn_type(state, a, TYPE_INT);
+  learn_type(state, b, TYPE_INT);
+  switch (ir->kind) {
+  case PIC_IR_ADD: case PIC_IR_SUB: case PIC_IR_MUL: case PIC_IR_DIV:
+    return TYPE_INT;
+  default:
+    return TYPE_ANY;
+  }
+#endif
+}
+
+/* accessors of vectors, strings and bytevectors, and eq?, eqv? and char=? */
+static enum type
+infer_access(optimize_state *state, pic_ir *ir)
+{
+  size_t i;
+
+  for (i = 0; i < pic_ir_len(ir); ++i) {
+    infer(state, pic_ir_elt(ir, i));
+  }
+
+  switch (ir->kind) {
+  case PIC_IR_VECLEN:
+    return TYPE_INT;
+  case PIC_IR_VECREF: case PIC_IR_VECSET: case PIC_IR_STRREF:
+  case PIC_IR_BLOBREF: case PIC_IR_BLOBSET:
+    /* an access that returned was given a fixnum index */
+    learn_type(state, pic_ir_elt(ir, 1), TYPE_INT);
+    return ir->kind == PIC_IR_BLOBREF ? TYPE_INT : TYPE_ANY;
+  default:
+    return TYPE_ANY;
+  }
+}
+
+static enum type
+infer_let(optimize_state *state, pic_ir *ir)
+{
+  pic_state *pic = state->pic;
+  struct pic_ir_lambda *lambda;
+  type_fact fact;
+  size_t n, i;
+
+  lambda = pic_ir_lambda(pic_ir_elt(ir, 0));
+  n = xv_size(state->facts);
+
+  /* the arguments are evaluated before the body runs */
+  for (i = 1; i < pic_ir_len(ir); ++i) {
+    fact.type = infer(state, pic_ir_elt(ir, i));
+    if (i > lambda->args.n) {
+      continue;
+    }
+    fact.var = lambda->args.v[i - 1];
+    if (fact.type != TYPE_ANY && xh_get_ptr(&state->assigned, fact.var) == NULL) {
+      xv_push(type_fact, state->facts, fact);
+    }
+  }
+  infer(state, lambda->body);
+  forget_types(state, n);
+  return TYPE_ANY;
+}
+
+static enum type
+infer(optimize_state *state, pic_ir *ir)
+{
+  enum type type = TYPE_ANY;
+  size_t n, i;
+
+  switch (ir->kind) {
+  case PIC_IR_QUOTE:
+    return pic_int_p(ir->u.quote) ? TYPE_INT : pic_pair_p(ir->u.quote) ? TYPE_PAIR : TYPE_ANY;
+  case PIC_IR_GREF:
+    return TYPE_ANY;
+  case PIC_IR_LREF: case PIC_IR_CREF:
+    return lookup_type(state, pic_ir_sym(ir));
+  case PIC_IR_LAMBDA:
+    /* facts learned in the body do not hold after the lambda expression */
+    n = xv_size(state->facts);
+    infer(state, pic_ir_lambda(ir)->body);
+    forget_types(state, n);
+    return TYPE_ANY;
+  case PIC_IR_IF:
+    return infer_if(state, ir);
+  case PIC_IR_SETBANG:
+    infer(state, pic_ir_elt(ir, 1));
+    return TYPE_ANY;
+  case PIC_IR_CALL_WITH_VALUES: case PIC_IR_TAILCALL_WITH_VALUES:
+    infer(state, pic_ir_elt(ir, 1));
+    infer(state, pic_ir_elt(ir, 0));
+    return TYPE_ANY;
+  case PIC_IR_CALL: case PIC_IR_TAILCALL:
+    if (pic_ir_elt(ir, 0)->kind == PIC_IR_LAMBDA && ! pic_ir_lambda(pic_ir_elt(ir, 0))->varg) {
+      return infer_let(state, ir);
+    }
+    break;
+  case PIC_IR_BEGIN: case PIC_IR_RETURN:
+    break;
+  case PIC_IR_VECREF: case PIC_IR_VECSET: case PIC_IR_VECLEN: case PIC_IR_STRREF:
+  case PIC_IR_BLOBREF: case PIC_IR_BLOBSET: case PIC_IR_EQP: case PIC_IR_EQVP:
+  case PIC_IR_CHAREQ:
+    return infer_access(state, ir);
+  default:
+    return infer_op(state, ir);
+  }
+  for (i = 0; i < pic_ir_len(ir); ++i) {
+    type = infer(state, pic_ir_elt(ir, i));
+  }
+  return ir->kind == PIC_IR_BEGIN ? type : TYPE_ANY;
+}
+
+static void
+infer_types(optimize_state *state, pic_ir *ir)
+{
+  pic_state *pic = state->pic;
+
+  xh_init_ptr(&state->assigned, sizeof(int));
+  xv_init(state->facts);
+
+  collect_assigned(state, ir);
+  infer(state, ir);
+
+  xv_destroy(state->facts);
+  xh_destroy(&state->assigned);
+}
+
+#if PIC_INLINE_GLOBAL
+
+typedef xvect_t(pic_ir *) ir_list;
+typedef xvect_t(pic_sym *) sym_list;
+
+static bool
+defs_memq(ir_list *defs, pic_ir *ir)
+{
+  size_t i;
+
+  for (i = 0; i < xv_size(*defs); ++i) {
+    if (xv_A(*defs, i) == ir) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool
+dirty_memq(sym_list *dirty, pic_sym *var)
+{
+  size_t i;
+
+  for (i = 0; i < xv_size(*dirty); ++i) {
+    if (xv_A(*dirty, i) == var) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void
+collect_global_sets(optimize_state *state, pic_ir *ir, ir_list *defs, sym_list *dirty)
+{
+  pic_state *pic = state->pic;
+  size_t i;
+
+  switch (ir->kind) {
+  case PIC_IR_QUOTE: case PIC_IR_GREF: case PIC_IR_LREF: case PIC_IR_CREF:
+    return;
+  case PIC_IR_LAMBDA:
+    collect_global_sets(state, pic_ir_lambda(ir)->body, defs, dirty);
+    return;
+  case PIC_IR_SETBANG:
+    if (pic_ir_elt(ir, 0)->kind == PIC_IR_GREF && ! defs_memq(defs, ir)) {
+      xv_push(pic_sym *, *dirty, pic_ir_sym(pic_ir_elt(ir, 0)));
+    }
+    collect_global_sets(state, pic_ir_elt(ir, 1), defs, dirty);
+    return;
+  default:
+    for (i = 0; i < pic_ir_len(ir); ++i) {
+      collect_global_sets(state, pic_ir_elt(ir, i), defs, dirty);
+    }
+  }
+}
+
+/*
+ * Remember the top-level procedures defined by this form so that later
+ * forms can inline them. Anything assigned to more than once is forgotten.
+ * The procedure is copied into an arena of its own, owned by the table.
+ */
+static void
+record_globals(optimize_state *state, pic_ir *ir)
+{
+  pic_state *pic = state->pic;
+  pic_ir *body, *elt, *lambda;
+  struct pic_data *data;
+  ir_list defs;
+  sym_list dirty;
+  pic_sym *var;
+  size_t i, n;
+
+  body = pic_ir_lambda(ir)->body;
+  n = body->kind == PIC_IR_BEGIN ? pic_ir_len(body) : 1;
+
+  xv_init(defs);
+  xv_init(dirty);
+  for (i = 0; i < n; ++i) {
+    elt = body->kind == PIC_IR_BEGIN ? pic_ir_elt(body, i) : body;
+    if (elt->kind == PIC_IR_RETURN && pic_ir_len(elt) == 1) {
+      elt = pic_ir_elt(elt, 0);
+    }
+    if (elt->kind == PIC_IR_SETBANG && pic_ir_elt(elt, 0)->kind == PIC_IR_GREF) {
+      xv_push(pic_ir *, defs, elt);
+    }
+  }
+  for (i = 0; i < xv_size(defs); ++i) {
+    var = pic_ir_sym(pic_ir_elt(xv_A(defs, i), 0));
+    if (count_sets(state, body, var) != 1) {
+      xv_push(pic_sym *, dirty, var);
+    }
+  }
+  collect_global_sets(state, body, &defs, &dirty);
+
+  for (i = 0; i < xv_size(defs); ++i) {
+    var = pic_ir_sym(pic_ir_elt(xv_A(defs, i), 0));
+    lambda = pic_ir_elt(xv_A(defs, i), 1);
+
+    if (! dirty_memq(&dirty, var)
+        && inlinable_p(state, lambda, var)
+        && closed_p(state, pic_ir_lambda(lambda)->body, 0)) {
+      data = pic_ir_arena_new(pic);
+      pic_ir_arena_ptr(data)->root = pic_ir_copy(pic, pic_ir_arena_ptr(data), lambda);
+      pic_dict_set(pic, pic->inlinables, var, pic_obj_value(data));
+    } else {
+      xv_push(pic_sym *, dirty, var);
+    }
+  }
+
+  for (i = 0; i < xv_size(dirty); ++i) {
+    if (pic_dict_has(pic, pic->inlinables, xv_A(dirty, i))) {
+      pic_dict_del(pic, pic->inlinables, xv_A(dirty, i));
+    }
+  }
+  xv_destroy(defs);
+  xv_destroy(dirty);
+}
+
+#endif
+
+pic_ir *
+pic_optimize(pic_state *pic, pic_ir_arena *arena, pic_ir *ir)
+{
+  optimize_state state;
+
+  state.pic = pic;
+  state.arena = arena;
+  xv_init(state.scopes);
+  xv_init(state.inlinables);
+
+  ir = optimize(&state, ir);
+
+  if (PIC_LIFT_FREE_VARS > 0) {
+    lift_lambdas(&state, ir);
+  }
+
+#if PIC_INLINE_GLOBAL
+  record_globals(&state, ir);
+#endif
+
+  infer_types(&state, ir);
+
+  xv_destroy(state.scopes);
+  xv_destroy(state.inlinables);
+
+  return ir;
+}
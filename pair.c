@@ -4,6 +4,7 @@
 
 #include "picrin.h"
 #include "picrin/pair.h"
+#include "picrin/vector.h"
 
 pic_value
 pic_cons(pic_state *pic, pic_value car, pic_value cdr)
@@ -405,117 +406,97 @@ pic_list_copy(pic_state *pic, pic_value obj)
 }
 
 static pic_value
-pic_pair_pair_p(pic_state *pic)
+pic_pair_pair_p(pic_state *pic, int argc, pic_arg *argv)
 {
-  pic_value v;
-
-  pic_get_args(pic, "o", &v);
+  PIC_UNUSED(pic);
+  PIC_UNUSED(argc);
 
-  return pic_bool_value(pic_pair_p(v));
+  return pic_bool_value(pic_pair_p(argv[0].o));
 }
 
 static pic_value
-pic_pair_cons(pic_state *pic)
+pic_pair_cons(pic_state *pic, int argc, pic_arg *argv)
 {
-  pic_value v,w;
+  PIC_UNUSED(argc);
 
-  pic_get_args(pic, "oo", &v, &w);
-
-  return pic_cons(pic, v, w);
+  return pic_cons(pic, argv[0].o, argv[1].o);
 }
 
 static pic_value
-pic_pair_car(pic_state *pic)
+pic_pair_car(pic_state *pic, int argc, pic_arg *argv)
 {
-  pic_value v;
+  PIC_UNUSED(argc);
 
-  pic_get_args(pic, "o", &v);
-
-  return pic_car(pic, v);
+  return pic_car(pic, argv[0].o);
 }
 
 static pic_value
-pic_pair_cdr(pic_state *pic)
+pic_pair_cdr(pic_state *pic, int argc, pic_arg *argv)
 {
-  pic_value v;
-
-  pic_get_args(pic, "o", &v);
+  PIC_UNUSED(argc);
 
-  return pic_cdr(pic, v);
+  return pic_cdr(pic, argv[0].o);
 }
 
 static pic_value
-pic_pair_caar(pic_state *pic)
+pic_pair_caar(pic_state *pic, int argc, pic_arg *argv)
 {
-  pic_value v;
-
-  pic_get_args(pic, "o", &v);
+  PIC_UNUSED(argc);
 
-  return pic_caar(pic, v);
+  return pic_caar(pic, argv[0].o);
 }
 
 static pic_value
-pic_pair_cadr(pic_state *pic)
+pic_pair_cadr(pic_state *pic, int argc, pic_arg *argv)
 {
-  pic_value v;
+  PIC_UNUSED(argc);
 
-  pic_get_args(pic, "o", &v);
-
-  return pic_cadr(pic, v);
+  return pic_cadr(pic, argv[0].o);
 }
 
 static pic_value
-pic_pair_cdar(pic_state *pic)
+pic_pair_cdar(pic_state *pic, int argc, pic_arg *argv)
 {
-  pic_value v;
-
-  pic_get_args(pic, "o", &v);
+  PIC_UNUSED(argc);
 
-  return pic_cdar(pic, v);
+  return pic_cdar(pic, argv[0].o);
 }
 
 static pic_value
-pic_pair_cddr(pic_state *pic)
+pic_pair_cddr(pic_state *pic, int argc, pic_arg *argv)
 {
-  pic_value v;
-
-  pic_get_args(pic, "o", &v);
+  PIC_UNUSED(argc);
 
-  return pic_cddr(pic, v);
+  return pic_cddr(pic, argv[0].o);
 }
 
 static pic_value
-pic_pair_set_car(pic_state *pic)
+pic_pair_set_car(pic_state *pic, int argc, pic_arg *argv)
 {
-  pic_value v,w;
+  PIC_UNUSED(argc);
 
-  pic_get_args(pic, "oo", &v, &w);
-
-  pic_set_car(pic, v, w);
+  pic_set_car(pic, argv[0].o, argv[1].o);
 
   return pic_none_value();
 }
 
 static pic_value
-pic_pair_set_cdr(pic_state *pic)
+pic_pair_set_cdr(pic_state *pic, int argc, pic_arg *argv)
 {
-  pic_value v,w;
-
-  pic_get_args(pic, "oo", &v, &w);
+  PIC_UNUSED(argc);
 
-  pic_set_cdr(pic, v, w);
+  pic_set_cdr(pic, argv[0].o, argv[1].o);
 
   return pic_none_value();
 }
 
 static pic_value
-pic_pair_null_p(pic_state *pic)
+pic_pair_null_p(pic_state *pic, int argc, pic_arg *argv)
 {
-  pic_value v;
-
-  pic_get_args(pic, "o", &v);
+  PIC_UNUSED(pic);
+  PIC_UNUSED(argc);
 
-  return pic_bool_value(pic_nil_p(v));
+  return pic_bool_value(pic_nil_p(argv[0].o));
 }
 
 static pic_value
@@ -639,54 +620,77 @@ static pic_value
 pic_pair_map(pic_state *pic)
 {
   struct pic_proc *proc;
-  size_t argc, i;
-  pic_value *args;
-  pic_value arg, ret;
+  size_t argc, i, ai;
+  pic_value *args, *vals;
+  pic_value ret, tail, cell;
 
   pic_get_args(pic, "l*", &proc, &argc, &args);
 
-  ret = pic_nil_value();
+  /* the stack may move under args while proc runs */
+  vals = pic_make_vec(pic, argc * 2)->data;
+  memcpy(vals + argc, args, argc * sizeof(pic_value));
+  args = vals + argc;
+
+  ai = pic_gc_arena_preserve(pic);
+
+  ret = tail = pic_nil_value();
   do {
-    arg = pic_nil_value();
     for (i = 0; i < argc; ++i) {
       if (! pic_pair_p(args[i])) {
         break;
       }
-      pic_push(pic, pic_car(pic, args[i]), arg);
+      vals[i] = pic_car(pic, args[i]);
       args[i] = pic_cdr(pic, args[i]);
     }
     if (i != argc) {
       break;
     }
-    pic_push(pic, pic_apply(pic, proc, pic_reverse(pic, arg)), ret);
+    cell = pic_cons(pic, pic_applyv(pic, proc, argc, vals), pic_nil_value());
+    if (pic_nil_p(ret)) {
+      ret = cell;
+    }
+    else {
+      pic_set_cdr(pic, tail, cell);
+    }
+    tail = cell;
+
+    pic_gc_arena_restore(pic, ai);
+    pic_gc_protect(pic, ret);
   } while (1);
 
-  return pic_reverse(pic, ret);
+  return ret;
 }
 
 static pic_value
 pic_pair_for_each(pic_state *pic)
 {
   struct pic_proc *proc;
-  size_t argc, i;
-  pic_value *args;
-  pic_value arg;
+  size_t argc, i, ai;
+  pic_value *args, *vals;
 
   pic_get_args(pic, "l*", &proc, &argc, &args);
 
+  /* the stack may move under args while proc runs */
+  vals = pic_make_vec(pic, argc * 2)->data;
+  memcpy(vals + argc, args, argc * sizeof(pic_value));
+  args = vals + argc;
+
+  ai = pic_gc_arena_preserve(pic);
+
   do {
-    arg = pic_nil_value();
     for (i = 0; i < argc; ++i) {
       if (! pic_pair_p(args[i])) {
         break;
       }
-      pic_push(pic, pic_car(pic, args[i]), arg);
+      vals[i] = pic_car(pic, args[i]);
       args[i] = pic_cdr(pic, args[i]);
     }
     if (i != argc) {
       break;
     }
-    pic_apply(pic, proc, pic_reverse(pic, arg));
+    pic_applyv(pic, proc, argc, vals);
+
+    pic_gc_arena_restore(pic, ai);
   } while (1);
 
   return pic_none_value();
@@ -757,18 +761,18 @@ pic_pair_assoc(pic_state *pic)
 void
 pic_init_pair(pic_state *pic)
 {
-  pic_defun(pic, "pair?", pic_pair_pair_p);
-  pic_defun(pic, "cons", pic_pair_cons);
-  pic_defun(pic, "car", pic_pair_car);
-  pic_defun(pic, "cdr", pic_pair_cdr);
-  pic_defun(pic, "set-car!", pic_pair_set_car);
-  pic_defun(pic, "set-cdr!", pic_pair_set_cdr);
-  pic_defun(pic, "null?", pic_pair_null_p);
-
-  pic_defun(pic, "caar", pic_pair_caar);
-  pic_defun(pic, "cadr", pic_pair_cadr);
-  pic_defun(pic, "cdar", pic_pair_cdar);
-  pic_defun(pic, "cddr", pic_pair_cddr);
+  pic_defun_sig(pic, "pair?", pic_pair_pair_p, "o");
+  pic_defun_sig(pic, "cons", pic_pair_cons, "oo");
+  pic_defun_sig(pic, "car", pic_pair_car, "o");
+  pic_defun_sig(pic, "cdr", pic_pair_cdr, "o");
+  pic_defun_sig(pic, "set-car!", pic_pair_set_car, "oo");
+  pic_defun_sig(pic, "set-cdr!", pic_pair_set_cdr, "oo");
+  pic_defun_sig(pic, "null?", pic_pair_null_p, "o");
+
+  pic_defun_sig(pic, "caar", pic_pair_caar, "o");
+  pic_defun_sig(pic, "cadr", pic_pair_cadr, "o");
+  pic_defun_sig(pic, "cdar", pic_pair_cdar, "o");
+  pic_defun_sig(pic, "cddr", pic_pair_cddr, "o");
   pic_defun(pic, "list?", pic_pair_list_p);
   pic_defun(pic, "make-list", pic_pair_make_list);
   pic_defun(pic, "list", pic_pair_list);
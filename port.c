@@ -58,6 +58,8 @@ pic_make_standard_port(pic_state *pic, xFILE *file, short dir)
   port->file = file;
   port->flags = dir | PIC_PORT_TEXT;
   port->status = PIC_PORT_OPEN;
+  port->line = 1;
+  port->column = 0;
   return port;
 }
 
@@ -160,10 +162,12 @@ pic_open_input_string(pic_state *pic, const char *str)
 {
   struct pic_port *port;
 
-  port = (struct pic_port *)pic_obj_alloc(pic, sizeof(struct pic_port *), PIC_TT_PORT);
+  port = (struct pic_port *)pic_obj_alloc(pic, sizeof(struct pic_port), PIC_TT_PORT);
   port->file = strfile_open(pic);
   port->flags = PIC_PORT_IN | PIC_PORT_TEXT;
   port->status = PIC_PORT_OPEN;
+  port->line = 1;
+  port->column = 0;
 
   xfputs(str, port->file);
   xfflush(port->file);
@@ -177,10 +181,12 @@ pic_open_output_string(pic_state *pic)
 {
   struct pic_port *port;
 
-  port = (struct pic_port *)pic_obj_alloc(pic, sizeof(struct pic_port *), PIC_TT_PORT);
+  port = (struct pic_port *)pic_obj_alloc(pic, sizeof(struct pic_port), PIC_TT_PORT);
   port->file = strfile_open(pic);
   port->flags = PIC_PORT_OUT | PIC_PORT_TEXT;
   port->status = PIC_PORT_OPEN;
+  port->line = 1;
+  port->column = 0;
 
   return port;
 }
@@ -416,10 +422,12 @@ pic_port_open_input_blob(pic_state *pic)
 
   pic_get_args(pic, "b", &blob);
 
-  port = (struct pic_port *)pic_obj_alloc(pic, sizeof(struct pic_port *), PIC_TT_PORT);
+  port = (struct pic_port *)pic_obj_alloc(pic, sizeof(struct pic_port), PIC_TT_PORT);
   port->file = strfile_open(pic);
   port->flags = PIC_PORT_IN | PIC_PORT_BINARY;
   port->status = PIC_PORT_OPEN;
+  port->line = 1;
+  port->column = 0;
 
   xfwrite(blob->data, 1, blob->len, port->file);
   xfflush(port->file);
@@ -435,10 +443,12 @@ pic_port_open_output_bytevector(pic_state *pic)
 
   pic_get_args(pic, "");
 
-  port = (struct pic_port *)pic_obj_alloc(pic, sizeof(struct pic_port *), PIC_TT_PORT);
+  port = (struct pic_port *)pic_obj_alloc(pic, sizeof(struct pic_port), PIC_TT_PORT);
   port->file = strfile_open(pic);
   port->flags = PIC_PORT_OUT | PIC_PORT_BINARY;
   port->status = PIC_PORT_OPEN;
+  port->line = 1;
+  port->column = 0;
 
   return pic_obj_value(port);
 }
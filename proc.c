@@ -21,6 +21,8 @@ pic_make_proc(pic_state *pic, pic_func_t func, const char *name)
   proc->kind = PIC_PROC_KIND_FUNC;
   proc->u.func.f = func;
   proc->u.func.name = sym;
+  proc->u.func.sig = NULL;
+  proc->u.func.var = NULL;
   proc->env = NULL;
   return proc;
 }
@@ -81,9 +83,29 @@ pic_proc_apply(pic_state *pic)
   return pic_apply_trampoline(pic, proc, arg_list);
 }
 
+/* (tier calls loops) of the code the procedure runs next, or #f for a native one */
+static pic_value
+pic_proc_procedure_profile(pic_state *pic)
+{
+  struct pic_proc *proc;
+  struct pic_irep *irep;
+
+  pic_get_args(pic, "l", &proc);
+
+  if (pic_proc_func_p(proc)) {
+    return pic_false_value();
+  }
+  irep = proc->u.irep;
+  if (irep->tiered != NULL) {
+    irep = irep->tiered;
+  }
+  return pic_list3(pic, pic_int_value(irep->tier), pic_int_value((int)irep->calls), pic_int_value((int)irep->loops));
+}
+
 void
 pic_init_proc(pic_state *pic)
 {
   pic_defun(pic, "procedure?", pic_proc_proc_p);
   pic_defun(pic, "apply", pic_proc_apply);
+  pic_defun(pic, "procedure-profile", pic_proc_procedure_profile);
 }
@@ -23,18 +23,27 @@ read_error(pic_state *pic, const char *msg)
 }
 
 static int
-skip(struct pic_port *port, int c)
+next(struct pic_port *port)
 {
-  while (isspace(c)) {
-    c = xfgetc(port->file);
+  int c;
+
+  c = xfgetc(port->file);
+  if (c == '\n') {
+    port->line++;
+    port->column = 0;
+  } else {
+    port->column++;
   }
   return c;
 }
 
 static int
-next(struct pic_port *port)
+skip(struct pic_port *port, int c)
 {
-  return xfgetc(port->file);
+  while (isspace(c)) {
+    c = next(port);
+  }
+  return c;
 }
 
 static int
@@ -621,6 +630,34 @@ read_pair(pic_state *pic, struct pic_port *port, int c)
   }
 }
 
+static void
+loc_set(pic_state *pic, pic_value pair, struct pic_loc loc)
+{
+  struct pic_loc_entry e;
+
+  e.car = pic_car(pic, pair);
+  e.cdr = pic_cdr(pic, pair);
+  e.loc = loc;
+  xh_put_ptr(&pic->locs, pic_ptr(pair), &e);
+}
+
+static pic_value
+read_list(pic_state *pic, struct pic_port *port, int c)
+{
+  struct pic_loc loc;
+  pic_value list;
+
+  loc.line = port->line;
+  loc.column = port->column;
+
+  list = read_pair(pic, port, c);
+
+  if (pic_pair_p(list)) {
+    loc_set(pic, list, loc);
+  }
+  return list;
+}
+
 static pic_value
 read_vector(pic_state *pic, struct pic_port *port, int c)
 {
@@ -800,7 +837,7 @@ reader_table_init(struct pic_reader *reader)
   reader->table['|'] = read_pipe;
   reader->table['+'] = read_plus;
   reader->table['-'] = read_minus;
-  reader->table['('] = read_pair;
+  reader->table['('] = read_list;
   reader->table['#'] = read_dispatch;
 
   /* read number */
@@ -854,6 +891,39 @@ pic_reader_close(pic_state *pic, struct pic_reader *reader)
   pic_free(pic, reader);
 }
 
+struct pic_loc *
+pic_loc_ref(pic_state *pic, pic_value obj)
+{
+  struct pic_loc_entry *e;
+  xh_entry *it;
+
+  if (! pic_pair_p(obj)) {
+    return NULL;
+  }
+  if ((it = xh_get_ptr(&pic->locs, pic_ptr(obj))) == NULL) {
+    return NULL;
+  }
+  e = &xh_val(it, struct pic_loc_entry);
+  if (! (pic_eq_p(e->car, pic_car(pic, obj)) && pic_eq_p(e->cdr, pic_cdr(pic, obj)))) {
+    return NULL;
+  }
+  return &e->loc;
+}
+
+/* a form made out of another one is where the other one was */
+void
+pic_loc_copy(pic_state *pic, pic_value to, pic_value from)
+{
+  struct pic_loc *loc;
+
+  if (! pic_pair_p(to) || (loc = pic_loc_ref(pic, from)) == NULL) {
+    return;
+  }
+  if (pic_loc_ref(pic, to) == NULL) {
+    loc_set(pic, to, *loc);
+  }
+}
+
 pic_value
 pic_read(pic_state *pic, struct pic_port *port)
 {
@@ -13,6 +13,7 @@
 #include "picrin/dict.h"
 #include "picrin/pair.h"
 #include "picrin/lib.h"
+#include "picrin/irep.h"
 
 void
 pic_add_feature(pic_state *pic, const char *feature)
@@ -44,6 +45,78 @@ void pic_init_attr(pic_state *);
 
 extern const char pic_boot[][80];
 
+#if PIC_BOOT_IMAGE
+
+extern const unsigned char pic_boot_image[];
+extern const size_t pic_boot_image_size;
+
+struct image {
+  const unsigned char *ptr, *end;
+};
+
+static int
+image_read(void *cookie, char *ptr, int size)
+{
+  struct image *image = cookie;
+  int i;
+
+  for (i = 0; i < size && image->ptr < image->end; ++i) {
+    *ptr++ = (char)*image->ptr++;
+  }
+  return i;
+}
+
+static int
+image_write(void *cookie, const char *ptr, int size)
+{
+  return -1;
+}
+
+static long
+image_seek(void *cookie, long pos, int whence)
+{
+  return -1;
+}
+
+static int
+image_flush(void *cookie)
+{
+  return 0;
+}
+
+static int
+image_close(void *cookie)
+{
+  return 0;
+}
+
+static void
+pic_load_boot_image(pic_state *pic)
+{
+  struct image image;
+  xFILE *file;
+
+  image.ptr = pic_boot_image;
+  image.end = pic_boot_image + pic_boot_image_size;
+
+  file = xfunopen(&image, image_read, image_write, image_seek, image_flush, image_close);
+  if (! file) {
+    pic_panic(pic, "cannot open the boot image");
+  }
+
+  pic_try {
+    pic_load_snapshot(pic, file);
+  }
+  pic_catch {
+    xfclose(file);
+    pic_raise(pic, pic->err);
+  }
+
+  xfclose(file);
+}
+
+#endif
+
 static void
 pic_init_features(pic_state *pic)
 {
@@ -102,7 +175,7 @@ pic_init_features(pic_state *pic)
 #define DONE pic_gc_arena_restore(pic, ai);
 
 static void
-pic_init_core(pic_state *pic)
+pic_init_core(pic_state *pic, xFILE *snapshot)
 {
   pic_init_features(pic);
 
@@ -139,14 +212,24 @@ pic_init_core(pic_state *pic)
     pic_init_lib(pic); DONE;
     pic_init_attr(pic); DONE;
 
-    pic_load_cstr(pic, &pic_boot[0][0]);
+    if (snapshot != NULL) {
+      pic_load_snapshot(pic, snapshot);
+    }
+#if PIC_BOOT_IMAGE
+    else if (pic->snapshot == NULL) {
+      pic_load_boot_image(pic);
+    }
+#endif
+    else {
+      pic_load_cstr(pic, &pic_boot[0][0]);
+    }
   }
 
   pic_import_library(pic, pic->PICRIN_BASE);
 }
 
-pic_state *
-pic_open(pic_allocf allocf, pic_abortf abortf, size_t jmpbuf_size, int argc, char *argv[], char **envp, xFILE *xstdin, xFILE *xstdout, xFILE *xstderr)
+static pic_state *
+open_state(pic_allocf allocf, pic_abortf abortf, size_t jmpbuf_size, int argc, char *argv[], char **envp, xFILE *xstdin, xFILE *xstdout, xFILE *xstderr, xFILE *snapshot_in, xFILE *snapshot_out)
 {
   struct pic_port *pic_make_standard_port(pic_state *, xFILE *, short);
   char t;
@@ -179,6 +262,7 @@ pic_open(pic_allocf allocf, pic_abortf abortf, size_t jmpbuf_size, int argc, cha
   /* prepare VM stack */
   pic->stbase = pic->sp = allocf(NULL, PIC_STACK_SIZE * sizeof(pic_value));
   pic->stend = pic->stbase + PIC_STACK_SIZE;
+  xv_init(pic->stold);
 
   if (! pic->sp) {
     goto EXIT_SP;
@@ -191,6 +275,7 @@ pic_open(pic_allocf allocf, pic_abortf abortf, size_t jmpbuf_size, int argc, cha
   if (! pic->ci) {
     goto EXIT_CI;
   }
+  pic->ci->irep = NULL;         /* the outermost caller is C */
 
   /* exception handler */
   pic->xpbase = pic->xp = allocf(NULL, PIC_RESCUE_SIZE * sizeof(struct pic_proc *));
@@ -200,6 +285,15 @@ pic_open(pic_allocf allocf, pic_abortf abortf, size_t jmpbuf_size, int argc, cha
     goto EXIT_XP;
   }
 
+  /* try frames */
+  pic->tpbase = pic->tp = allocf(NULL, PIC_RESCUE_SIZE * sizeof(struct pic_escape *));
+  pic->tpend = pic->tpbase + PIC_RESCUE_SIZE;
+
+  if (! pic->tp) {
+    goto EXIT_TP;
+  }
+  memset(pic->tpbase, 0, PIC_RESCUE_SIZE * sizeof(struct pic_escape *));
+
   /* GC arena */
   pic->arena = allocf(NULL, PIC_ARENA_SIZE * sizeof(struct pic_object **));
   pic->arena_size = PIC_ARENA_SIZE;
@@ -221,8 +315,27 @@ pic_open(pic_allocf allocf, pic_abortf abortf, size_t jmpbuf_size, int argc, cha
   /* macros */
   pic->macros = NULL;
 
+  /* inliner */
+  pic->inlinables = NULL;
+
+  /* compile cache */
+  pic->cache = NULL;
+  pic->cache_epoch = 0;
+  pic->cache_hits = pic->cache_misses = 0;
+
+  /* snapshot */
+  pic->snapshot = NULL;
+
+  /* tiered compilation */
+  pic->tiering = false;
+
+  /* native code */
+  pic->jit_enable = PIC_ENABLE_JIT;
+
   /* attributes */
   xh_init_ptr(&pic->attrs, sizeof(struct pic_dict *));
+  xh_init_ptr(&pic->locs, sizeof(struct pic_loc_entry));
+  pic->locs_limit = 0;
 
   /* features */
   pic->features = pic_nil_value();
@@ -318,12 +431,17 @@ pic_open(pic_allocf allocf, pic_abortf abortf, size_t jmpbuf_size, int argc, cha
   /* root tables */
   pic->globals = pic_make_dict(pic);
   pic->macros = pic_make_dict(pic);
+  pic->inlinables = pic_make_dict(pic);
+  if (PIC_COMPILE_CACHE_SIZE > 0) {
+    pic->cache = pic_calloc(pic, PIC_COMPILE_CACHE_SIZE, sizeof(struct pic_cache_entry));
+  }
 
   /* root block */
   pic->wind = pic_alloc(pic, sizeof(struct pic_winder));
   pic->wind->prev = NULL;
   pic->wind->depth = 0;
   pic->wind->in = pic->wind->out = NULL;
+  pic->wind->binds = NULL;
 
   /* reader */
   pic->reader = pic_reader_open(pic);
@@ -344,13 +462,24 @@ pic_open(pic_allocf allocf, pic_abortf abortf, size_t jmpbuf_size, int argc, cha
   /* turn on GC */
   pic->gc_enable = true;
 
-  pic_init_core(pic);
+  if (snapshot_out != NULL) {
+    pic_snapshot_start(pic, snapshot_out);
+  }
+
+  pic_init_core(pic, snapshot_in);
+
+  pic->snapshot = NULL;
+
+  /* the libraries are optimized up front, and only the program is tiered */
+  pic->tiering = PIC_TIER_THRESHOLD > 0;
 
   pic_gc_arena_restore(pic, ai);
 
   return pic;
 
  EXIT_ARENA:
+  allocf(pic->tp, 0);
+ EXIT_TP:
   allocf(pic->xp, 0);
  EXIT_XP:
   allocf(pic->ci, 0);
@@ -362,6 +491,29 @@ pic_open(pic_allocf allocf, pic_abortf abortf, size_t jmpbuf_size, int argc, cha
   return NULL;
 }
 
+pic_state *
+pic_open(pic_allocf allocf, pic_abortf abortf, size_t jmpbuf_size, int argc, char *argv[], char **envp, xFILE *xstdin, xFILE *xstdout, xFILE *xstderr)
+{
+  return open_state(allocf, abortf, jmpbuf_size, argc, argv, envp, xstdin, xstdout, xstderr, NULL, NULL);
+}
+
+pic_state *
+pic_open_from_snapshot(pic_allocf allocf, pic_abortf abortf, size_t jmpbuf_size, int argc, char *argv[], char **envp, xFILE *xstdin, xFILE *xstdout, xFILE *xstderr, xFILE *snapshot)
+{
+  return open_state(allocf, abortf, jmpbuf_size, argc, argv, envp, xstdin, xstdout, xstderr, snapshot, NULL);
+}
+
+void
+pic_dump_snapshot(pic_allocf allocf, pic_abortf abortf, size_t jmpbuf_size, xFILE *file)
+{
+  pic_state *pic;
+
+  pic = open_state(allocf, abortf, jmpbuf_size, 0, NULL, NULL, NULL, NULL, NULL, NULL, file);
+  if (pic != NULL) {
+    pic_close(pic);
+  }
+}
+
 void
 pic_close(pic_state *pic)
 {
@@ -385,12 +537,16 @@ pic_close(pic_state *pic)
   pic->sp = pic->stbase;
   pic->ci = pic->cibase;
   pic->xp = pic->xpbase;
+  pic->tp = pic->tpbase;
   pic->arena_idx = 0;
   pic->err = pic_undef_value();
   pic->globals = NULL;
   pic->macros = NULL;
+  pic->inlinables = NULL;
+  pic_cache_invalidate(pic);
   xh_clear(&pic->syms);
   xh_clear(&pic->attrs);
+  xh_clear(&pic->locs);
   pic->features = pic_nil_value();
   pic->libs = pic_nil_value();
 
@@ -404,13 +560,29 @@ pic_close(pic_state *pic)
   pic_reader_close(pic, pic->reader);
 
   /* free runtime context */
+  while (xv_size(pic->stold) > 0) {
+    allocf(xv_pop(pic->stold), 0);
+  }
+  xv_destroy(pic->stold);
   allocf(pic->stbase, 0);
   allocf(pic->cibase, 0);
   allocf(pic->xpbase, 0);
+  for (pic->tp = pic->tpbase; pic->tp != pic->tpend; ++pic->tp) {
+    if (*pic->tp) {
+      allocf(*pic->tp, 0);
+    }
+  }
+  allocf(pic->tpbase, 0);
 
   /* free global stacks */
   xh_destroy(&pic->syms);
   xh_destroy(&pic->attrs);
+  xh_destroy(&pic->locs);
+
+  /* free compile cache */
+  if (pic->cache) {
+    allocf(pic->cache, 0);
+  }
 
   /* free GC arena */
   allocf(pic->arena, 0);
@@ -5,6 +5,7 @@
 #include "picrin.h"
 #include "picrin/string.h"
 #include "picrin/pair.h"
+#include "picrin/vector.h"
 #include "picrin/port.h"
 #include "picrin/error.h"
 
@@ -490,24 +491,20 @@ pic_str_make_string(pic_state *pic)
 }
 
 static pic_value
-pic_str_string_length(pic_state *pic)
+pic_str_string_length(pic_state *pic, int argc, pic_arg *argv)
 {
-  pic_str *str;
-
-  pic_get_args(pic, "s", &str);
+  PIC_UNUSED(pic);
+  PIC_UNUSED(argc);
 
-  return pic_size_value(pic_str_len(str));
+  return pic_size_value(pic_str_len(argv[0].s));
 }
 
 static pic_value
-pic_str_string_ref(pic_state *pic)
+pic_str_string_ref(pic_state *pic, int argc, pic_arg *argv)
 {
-  pic_str *str;
-  size_t k;
-
-  pic_get_args(pic, "sk", &str, &k);
+  PIC_UNUSED(argc);
 
-  return pic_char_value(pic_str_ref(pic, str, k));
+  return pic_char_value(pic_str_ref(pic, argv[0].s, argv[1].k));
 }
 
 #define DEFINE_STRING_CMP(name, op)                                     \
@@ -582,8 +579,8 @@ static pic_value
 pic_str_string_map(pic_state *pic)
 {
   struct pic_proc *proc;
-  pic_value *argv, vals, val;
-  size_t argc, i, len, j;
+  pic_value *argv, *vals, val;
+  size_t argc, i, len, j, ai;
   pic_str *str;
   char *buf;
 
@@ -602,18 +599,22 @@ pic_str_string_map(pic_state *pic)
       ? len
       : pic_str_len(pic_str_ptr(argv[i]));
   }
+  vals = pic_make_vec(pic, argc)->data;
   buf = pic_malloc(pic, len);
 
+  ai = pic_gc_arena_preserve(pic);
+
   pic_try {
     for (i = 0; i < len; ++i) {
-      vals = pic_nil_value();
       for (j = 0; j < argc; ++j) {
-        pic_push(pic, pic_char_value(pic_str_ref(pic, pic_str_ptr(argv[j]), i)), vals);
+        vals[j] = pic_char_value(pic_str_ref(pic, pic_str_ptr(argv[j]), i));
       }
-      val = pic_apply(pic, proc, vals);
+      val = pic_applyv(pic, proc, argc, vals);
 
       pic_assert_type(pic, val, char);
       buf[i] = pic_char(val);
+
+      pic_gc_arena_restore(pic, ai);
     }
     str = pic_make_str(pic, buf, len);
   }
@@ -631,8 +632,8 @@ static pic_value
 pic_str_string_for_each(pic_state *pic)
 {
   struct pic_proc *proc;
-  size_t argc, len, i, j;
-  pic_value *argv, vals;
+  size_t argc, len, i, j, ai;
+  pic_value *argv, *vals;
 
   pic_get_args(pic, "l*", &proc, &argc, &argv);
 
@@ -650,12 +651,17 @@ pic_str_string_for_each(pic_state *pic)
       : pic_str_len(pic_str_ptr(argv[i]));
   }
 
+  vals = pic_make_vec(pic, argc)->data;
+
+  ai = pic_gc_arena_preserve(pic);
+
   for (i = 0; i < len; ++i) {
-    vals = pic_nil_value();
     for (j = 0; j < argc; ++j) {
-      pic_push(pic, pic_char_value(pic_str_ref(pic, pic_str_ptr(argv[j]), i)), vals);
+      vals[j] = pic_char_value(pic_str_ref(pic, pic_str_ptr(argv[j]), i));
     }
-    pic_apply(pic, proc, vals);
+    pic_applyv(pic, proc, argc, vals);
+
+    pic_gc_arena_restore(pic, ai);
   }
 
   return pic_none_value();
@@ -726,8 +732,8 @@ pic_init_str(pic_state *pic)
   pic_defun(pic, "string?", pic_str_string_p);
   pic_defun(pic, "string", pic_str_string);
   pic_defun(pic, "make-string", pic_str_make_string);
-  pic_defun(pic, "string-length", pic_str_string_length);
-  pic_defun(pic, "string-ref", pic_str_string_ref);
+  pic_defun_sig(pic, "string-length", pic_str_string_length, "s");
+  pic_defun_sig(pic, "string-ref", pic_str_string_ref, "sk");
   pic_defun(pic, "string-copy", pic_str_string_copy);
   pic_defun(pic, "string-append", pic_str_string_append);
   pic_defun(pic, "string-map", pic_str_string_map);
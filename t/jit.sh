@@ -0,0 +1,29 @@
+#!/bin/sh
+# Build the tree with and without the JIT and check that every program in
+# t/jit gives the same output and exit status on both. The JIT translates
+# only on x86-64 Linux; elsewhere both builds interpret and agree trivially.
+
+cc=${CC:-cc}
+dir=$(dirname "$0")
+src=$(ls "$dir"/../*.c | grep -v boot_image.c)
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+$cc -O2 -I"$dir/../include" -DPIC_ENABLE_JIT=0 -o "$tmp/interp" $src || exit 1
+$cc -O2 -I"$dir/../include" -DPIC_ENABLE_JIT=1 -o "$tmp/jit" $src || exit 1
+
+fail=0
+for f in "$dir"/jit/*.scm; do
+  "$tmp/interp" < "$f" > "$tmp/interp.out" 2>&1
+  echo "exit $?" >> "$tmp/interp.out"
+  "$tmp/jit" < "$f" > "$tmp/jit.out" 2>&1
+  echo "exit $?" >> "$tmp/jit.out"
+  if diff "$tmp/interp.out" "$tmp/jit.out" > "$tmp/diff"; then
+    echo "ok   $(basename "$f")"
+  else
+    echo "FAIL $(basename "$f")"
+    cat "$tmp/diff"
+    fail=1
+  fi
+done
+exit $fail
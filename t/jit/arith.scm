@@ -0,0 +1,28 @@
+(define (try thunk) (call/cc (lambda (k) (with-exception-handler (lambda (e) (k (list 'error (error-object-message e)))) thunk))))
+(define big 0)
+(set! big 536870911)
+(define small 0)
+(set! small -536870912)
+(define (add a b) (+ a b))
+(define (sub a b) (- a b))
+(define (mul a b) (* a b))
+(define (neg a) (- a))
+(write (try (lambda () (add big 1))))
+(write (try (lambda () (sub small 1))))
+(write (try (lambda () (mul big 2))))
+(write (try (lambda () (mul 65536 16384))))
+(write (try (lambda () (mul 23171 23171))))
+(write (try (lambda () (add big big))))
+(write (try (lambda () (sub small big))))
+(write (try (lambda () (neg small))))
+(write (try (lambda () (add big 'x))))
+(write (try (lambda () (< big 'x))))
+(write (list (< small big) (<= big big) (= big (add big 0)) (> small big) (>= small small)))
+(define (sum-to n acc) (if (= n 0) acc (sum-to (- n 1) (+ acc n))))
+(write (sum-to 100000 0))
+(define (fact n) (if (= n 0) 1 (* n (fact (- n 1)))))
+(write (map fact '(0 1 5 10 12 13 20)))
+(define (fib n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))
+(write (fib 20))
+(write (list (call-with-values (lambda () (floor/ -17 5)) list) (call-with-values (lambda () (truncate/ -17 5)) list)))
+(write (list (abs small) (expt 2 20) (number->string big)))
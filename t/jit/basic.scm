@@ -0,0 +1,35 @@
+(define (count-up n) (let loop ((i 0) (acc '())) (if (= i n) (reverse acc) (loop (+ i 1) (cons i acc)))))
+(write (count-up 10))
+(define (make-counter)
+  (let ((n 0))
+    (lambda () (set! n (+ n 1)) n)))
+(define c (make-counter))
+(c) (c)
+(write (c))
+(define (adder k) (lambda (x) (+ x k)))
+(write (map (adder 10) '(1 2 3)))
+(define (vsum v) (let loop ((i 0) (s 0)) (if (= i (vector-length v)) s (loop (+ i 1) (+ s (vector-ref v i))))))
+(write (vsum (list->vector (count-up 100))))
+(define v (make-vector 5 0))
+(let loop ((i 0)) (if (< i 5) (begin (vector-set! v i (* i i)) (loop (+ i 1)))))
+(write v)
+(define (scount s ch) (let loop ((i 0) (n 0)) (if (= i (string-length s)) n (loop (+ i 1) (if (char=? (string-ref s i) ch) (+ n 1) n)))))
+(write (scount "banana" #\a))
+(define b (bytevector 1 2 3))
+(bytevector-u8-set! b 1 200)
+(write (list (bytevector-u8-ref b 0) (bytevector-u8-ref b 1)))
+(define (classify x) (cond ((null? x) 'null) ((pair? x) 'pair) ((symbol? x) 'symbol) ((eq? x #t) 'true) ((eqv? x 1) 'one) (else 'other)))
+(write (map classify (list '() '(1) 'a #t 1 "s")))
+(define (rest-args a . r) (list a r))
+(write (list (rest-args 1) (rest-args 1 2 3)))
+(define (opt-not x) (not x))
+(write (list (opt-not #f) (opt-not 0)))
+(define (assq-test k) (let ((p (assq k '((a . 1) (b . 2))))) (if p (cdr p) 'none)))
+(write (list (assq-test 'b) (assq-test 'z)))
+(define (tree-insert tree x)
+  (cond ((null? tree) (list x '() '()))
+        ((< x (car tree)) (list (car tree) (tree-insert (cadr tree) x) (car (cddr tree))))
+        (else (list (car tree) (cadr tree) (tree-insert (car (cddr tree)) x)))))
+(define (tree-walk tree) (if (null? tree) '() (append (tree-walk (cadr tree)) (list (car tree)) (tree-walk (car (cddr tree))))))
+(define (insert-all tree xs) (if (null? xs) tree (insert-all (tree-insert tree (car xs)) (cdr xs))))
+(write (tree-walk (insert-all '() '(5 3 8 1 4 7 9 2 6))))
@@ -0,0 +1,27 @@
+(define (find-first pred l)
+  (call/cc
+   (lambda (return)
+     (for-each (lambda (x) (if (pred x) (return x))) l)
+     #f)))
+(write (list (find-first (lambda (x) (> x 3)) '(1 2 3 4 5)) (find-first (lambda (x) (> x 9)) '(1 2))))
+(define (deep n k) (if (= n 0) (k 'out) (+ 1 (deep (- n 1) k))))
+(write (call/cc (lambda (k) (deep 1000 k))))
+(define trace '())
+(define (note x) (set! trace (cons x trace)))
+(write (call/cc
+        (lambda (k)
+          (dynamic-wind
+           (lambda () (note 'in))
+           (lambda () (+ 1 (k 'escaped)))
+           (lambda () (note 'out))))))
+(write (reverse trace))
+(define (escape-from-map l)
+  (call/cc (lambda (k) (map (lambda (x) (if (symbol? x) (k x) (* x x))) l))))
+(write (list (escape-from-map '(1 2 3)) (escape-from-map '(1 a 3))))
+(define (nested n)
+  (call/cc (lambda (outer) (+ 1 (call/cc (lambda (inner) (if (= n 0) (outer 'outer) (inner n))))))))
+(write (list (nested 0) (nested 5)))
+(define (safe-ref v i)
+  (call/cc (lambda (k) (with-exception-handler (lambda (e) (k 'range-error)) (lambda () (+ 1 (vector-ref v i)))))))
+(write (list (safe-ref (vector 1 2) 1) (safe-ref (vector 1 2) 2)))
+(write (call-with-values (lambda () (call/cc (lambda (k) (k 1 2 3)))) list))
@@ -0,0 +1,23 @@
+(define (first l) (car l))
+(define (rest l) (cdr l))
+(define (plus a b) (+ a b))
+(define (null l) (null? l))
+(define (ref v i) (vector-ref v i))
+(write (list (first '(1 2)) (rest '(1 2)) (plus 1 2) (null '()) (ref (vector 4 5) 1)))
+(define saved-car car)
+(define saved-plus +)
+(set! car (lambda (x) (list 'car x)))
+(set! + (lambda args (cons '+ args)))
+(write (list (first '(1 2)) (plus 1 2)))
+(define (first2 l) (car l))
+(define (plus2 a b) (+ a b))
+(write (list (first2 '(1 2)) (plus2 1 2)))
+(set! car saved-car)
+(set! + saved-plus)
+(write (list (first '(1 2)) (plus 1 2) (first2 '(1 2)) (plus2 1 2)))
+(define (vector-ref v i) 'shadowed)
+(write (list (ref (vector 4 5) 1) (vector-ref (vector 4 5) 1)))
+(define (g) (eq? 'a 'a))
+(write (g))
+(define (eq? a b) 'never)
+(write (list (g) (eq? 1 1)))
@@ -0,0 +1,20 @@
+(define (d n) (if (= n 0) 0 (+ 1 (d (- n 1)))))
+(write (d 20000))
+(define (build n) (if (= n 0) '() (cons n (build (- n 1)))))
+(write (length (build 15000)))
+(define (sum l) (if (null? l) 0 (+ (car l) (sum (cdr l)))))
+(write (sum (build 15000)))
+(write (apply + (build 1000)))
+(write (call-with-values (lambda () (apply values (build 200))) (lambda args (length args))))
+(define (many a b c d e f g h i j k l m n o p) (list p o n m l k j i h g f e d c b a))
+(write (many 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16))
+(define (loop i acc) (if (= i 0) acc (loop (- i 1) (cons i acc))))
+(write (length (loop 50000 '())))
+(define mutual-odd? #f)
+(define (mutual-even? n) (if (= n 0) #t (mutual-odd? (- n 1))))
+(define (mutual-odd? n) (if (= n 0) #f (mutual-even? (- n 1))))
+(write (list (mutual-even? 100001) (mutual-odd? 7)))
+(define (deep-values n) (if (= n 0) (values 1 2) (call-with-values (lambda () (deep-values (- n 1))) (lambda (a b) (values b a)))))
+(write (call-with-values (lambda () (deep-values 5001)) list))
+(define (nest n) (if (= n 0) (vector 1 2) (let ((v (nest (- n 1)))) (vector-set! v 0 (+ (vector-ref v 0) 1)) v)))
+(write (nest 10000))
@@ -0,0 +1,26 @@
+#!/bin/sh
+# Build the tree and check that every program in t/optimize prints what
+# the .out file next to it says, so that the optimizer keeps what the
+# programs mean.
+
+cc=${CC:-cc}
+dir=$(dirname "$0")
+src=$(ls "$dir"/../*.c | grep -v boot_image.c)
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+$cc -O2 -I"$dir/../include" -o "$tmp/pic" $src || exit 1
+
+fail=0
+for f in "$dir"/optimize/*.scm; do
+  "$tmp/pic" < "$f" > "$tmp/out" 2>&1
+  echo "exit $?" >> "$tmp/out"
+  if diff "${f%.scm}.out" "$tmp/out" > "$tmp/diff"; then
+    echo "ok   $(basename "$f")"
+  else
+    echo "FAIL $(basename "$f")"
+    cat "$tmp/diff"
+    fail=1
+  fi
+done
+exit $fail
@@ -0,0 +1,13 @@
+(define (set-first) (let ((x '(1 2))) (set-car! x 9) (car x)))
+(write (set-first))
+(define (set-rest) (let ((x '(1 2))) (set-cdr! x '(7)) (cdr x)))
+(write (set-rest))
+(define lst '(1 2 3))
+(define (first-of-global) (car lst))
+(set-car! lst 5)
+(write (first-of-global))
+(write (car '(3 4)))
+(write (cdr '(3 4)))
+(write (pair? '(3 4)))
+(write (null? '()))
+(write (+ 1 2))
@@ -0,0 +1,122 @@
+/**
+ * See Copyright Notice in picrin.h
+ */
+
+/*
+ * Host tool that boots a state from the library source, records the
+ * boot (see pic_dump_snapshot) and prints it as boot_image.c. It has to
+ * be rerun whenever boot.c, the compiler or the instruction set changes.
+ */
+
+#include "picrin.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <setjmp.h>
+
+struct buffer {
+  unsigned char *data;
+  size_t size, capa;
+};
+
+static int
+buffer_read(void *cookie, char *ptr, int size)
+{
+  return -1;
+}
+
+static int
+buffer_write(void *cookie, const char *ptr, int size)
+{
+  struct buffer *buf = cookie;
+  int i;
+
+  if (buf->size + size > buf->capa) {
+    buf->capa = (buf->size + size) * 2;
+    buf->data = realloc(buf->data, buf->capa);
+    if (buf->data == NULL) {
+      return -1;
+    }
+  }
+  for (i = 0; i < size; ++i) {
+    buf->data[buf->size++] = (unsigned char)ptr[i];
+  }
+  return size;
+}
+
+static long
+buffer_seek(void *cookie, long pos, int whence)
+{
+  return -1;
+}
+
+static int
+buffer_flush(void *cookie)
+{
+  return 0;
+}
+
+static int
+buffer_close(void *cookie)
+{
+  return 0;
+}
+
+static void *
+mkbootimage_allocf(void *ptr, size_t size)
+{
+  if (size == 0) {
+    if (ptr) {
+      free(ptr);
+    }
+    return NULL;
+  }
+  if (ptr) {
+    return realloc(ptr, size);
+  } else {
+    return malloc(size);
+  }
+}
+
+static void
+mkbootimage_abortf()
+{
+  fprintf(stderr, "mkbootimage: failed to record the boot\n");
+  abort();
+}
+
+int
+main()
+{
+  struct buffer buf = { NULL, 0, 0 };
+  xFILE *file;
+  size_t i;
+
+  file = xfunopen(&buf, buffer_read, buffer_write, buffer_seek, buffer_flush, buffer_close);
+  if (! file) {
+    return 1;
+  }
+
+  pic_dump_snapshot(mkbootimage_allocf, mkbootimage_abortf, sizeof(jmp_buf), file);
+
+  if (xfclose(file) != 0 || buf.data == NULL) {
+    fprintf(stderr, "mkbootimage: write error\n");
+    return 1;
+  }
+
+  printf("/**\n * See Copyright Notice in picrin.h\n */\n\n");
+  printf("/* generated by tools/mkbootimage.c from boot.c; do not edit */\n\n");
+  printf("#include \"picrin.h\"\n\n");
+  printf("#if PIC_BOOT_IMAGE\n\n");
+  printf("const unsigned char pic_boot_image[] = {\n");
+  for (i = 0; i < buf.size; ++i) {
+    printf("%s0x%02x,%s", i % 12 == 0 ? "  " : " ", buf.data[i], i % 12 == 11 || i + 1 == buf.size ? "\n" : "");
+  }
+  printf("};\n\n");
+  printf("const size_t pic_boot_image_size = %lu;\n\n", (unsigned long)buf.size);
+  printf("#endif\n");
+
+  free(buf.data);
+
+  return 0;
+}
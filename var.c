@@ -5,87 +5,46 @@
 #include "picrin.h"
 #include "picrin/pair.h"
 #include "picrin/proc.h"
+#include "picrin/vector.h"
+#include "picrin/cont.h"
+#include "picrin/var.h"
 
 static pic_value
-var_lookup(pic_state *pic, pic_value var)
+var_convert(pic_state *pic, struct pic_var *var, pic_value val)
 {
-  pic_value val, env, binding;
-
-  val = pic_ref(pic, pic->PICRIN_BASE, "current-dynamic-environment");
-  if (pic_eq_p(val, var)) {
-    return pic_false_value();
-  }
-
-  env = pic_apply0(pic, pic_proc_ptr(val));
-  while (! pic_nil_p(env)) {
-    binding = pic_car(pic, env);
-
-    while (! pic_nil_p(binding)) {
-      if (pic_eq_p(pic_caar(pic, binding), var)) {
-        return pic_car(pic, binding);
-      }
-      binding = pic_cdr(pic, binding);
-    }
-    env = pic_cdr(pic, env);
+  if (var->conv != NULL) {
+    return pic_apply1(pic, var->conv, val);
   }
-
-  return pic_false_value();
+  return val;
 }
 
 static pic_value
-var_call(pic_state *pic)
+var_call(pic_state *pic, int argc, pic_arg *argv)
 {
-  struct pic_proc *self = pic_get_proc(pic);
-  pic_value val, tmp, box, conv;
-  int n;
+  struct pic_var *var = pic_get_proc(pic)->u.func.var;
 
-  n = pic_get_args(pic, "|oo", &val, &tmp);
-
-  box = var_lookup(pic, pic_obj_value(self));
-  if (! pic_test(box)) {
-    box = pic_attr_ref(pic, pic_obj_value(self), "@@box");
+  if (argc == 0) {
+    return var->value;
   }
+  var->value = var_convert(pic, var, argv[0].o);
 
-  switch (n) {
-  case 0:
-    return pic_cdr(pic, box);
-
-  case 1:
-    conv = pic_attr_ref(pic, pic_obj_value(self), "@@converter");
-    if (pic_test(conv)) {
-      pic_assert_type(pic, conv, proc);
-
-      val = pic_apply1(pic, pic_proc_ptr(conv), val);
-    }
-    pic_set_cdr(pic, box, val);
-
-    return pic_none_value();
-
-  case 2:
-    assert(pic_false_p(tmp));
-
-    conv = pic_attr_ref(pic, pic_obj_value(self), "@@converter");
-    if (pic_test(conv)) {
-      pic_assert_type(pic, conv, proc);
-
-      return pic_apply1(pic, pic_proc_ptr(conv), val);
-    } else {
-      return val;
-    }
-  }
-  PIC_UNREACHABLE();
+  return pic_none_value();
 }
 
 struct pic_proc *
 pic_make_var(pic_state *pic, pic_value init, struct pic_proc *conv)
 {
-  struct pic_proc *var;
+  struct pic_var *var;
+  struct pic_proc *proc;
 
-  var = pic_make_proc(pic, var_call, "<var-call>");
-  pic_attr_set(pic, pic_obj_value(var), "@@box", pic_cons(pic, pic_false_value(), init));
-  pic_attr_set(pic, pic_obj_value(var), "@@converter", conv ? pic_obj_value(conv) : pic_false_value());
+  var = (struct pic_var *)pic_obj_alloc(pic, sizeof(struct pic_var), PIC_TT_VAR);
+  var->value = init;
+  var->conv = conv;
 
-  return var;
+  proc = pic_make_proc_sig(pic, var_call, "<var-call>", "|o");
+  proc->u.func.var = var;
+
+  return proc;
 }
 
 static pic_value
@@ -99,12 +58,43 @@ pic_var_make_parameter(pic_state *pic)
   return pic_obj_value(pic_make_var(pic, init, conv));
 }
 
+static pic_value
+pic_var_dynamic_bind(pic_state *pic)
+{
+  pic_value params, vals, param, it;
+  struct pic_proc *body;
+  struct pic_vector *binds;
+  struct pic_var *var;
+  size_t n, i = 0;
+
+  pic_get_args(pic, "ool", &params, &vals, &body);
+
+  n = pic_length(pic, params);
+  if (pic_length(pic, vals) != n) {
+    pic_errorf(pic, "parameterize: wrong number of values");
+  }
+
+  binds = pic_make_vec(pic, n * 2);
+
+  pic_for_each (param, params, it) {
+    if (! (pic_proc_p(param) && pic_proc_func_p(pic_proc_ptr(param)) && pic_proc_ptr(param)->u.func.var != NULL)) {
+      pic_errorf(pic, "parameterize: expected parameter, but got ~s", param);
+    }
+    var = pic_proc_ptr(param)->u.func.var;
+
+    binds->data[i] = pic_obj_value(var);
+    binds->data[i + 1] = var_convert(pic, var, pic_car(pic, vals));
+    vals = pic_cdr(pic, vals);
+    i += 2;
+  }
+
+  return pic_dynamic_bind(pic, binds, body);
+}
+
 void
 pic_init_var(pic_state *pic)
 {
-  pic_define_noexport(pic, "current-dynamic-environment", pic_false_value());
+  pic_define_noexport(pic, "dynamic-bind", pic_obj_value(pic_make_proc(pic, pic_var_dynamic_bind, "dynamic-bind")));
 
   pic_defun(pic, "make-parameter", pic_var_make_parameter);
-
-  pic_set(pic, pic->PICRIN_BASE, "current-dynamic-environment", pic_obj_value(pic_make_var(pic, pic_nil_value(), NULL)));
 }
@@ -86,22 +86,21 @@ pic_vec_make_vector(pic_state *pic)
 }
 
 static pic_value
-pic_vec_vector_length(pic_state *pic)
+pic_vec_vector_length(pic_state *pic, int argc, pic_arg *argv)
 {
-  struct pic_vector *v;
+  PIC_UNUSED(pic);
+  PIC_UNUSED(argc);
 
-  pic_get_args(pic, "v", &v);
-
-  return pic_size_value(v->len);
+  return pic_size_value(argv[0].v->len);
 }
 
 static pic_value
-pic_vec_vector_ref(pic_state *pic)
+pic_vec_vector_ref(pic_state *pic, int argc, pic_arg *argv)
 {
-  struct pic_vector *v;
-  size_t k;
+  struct pic_vector *v = argv[0].v;
+  size_t k = argv[1].k;
 
-  pic_get_args(pic, "vk", &v, &k);
+  PIC_UNUSED(argc);
 
   if (v->len <= k) {
     pic_errorf(pic, "vector-ref: index out of range");
@@ -110,18 +109,17 @@ pic_vec_vector_ref(pic_state *pic)
 }
 
 static pic_value
-pic_vec_vector_set(pic_state *pic)
+pic_vec_vector_set(pic_state *pic, int argc, pic_arg *argv)
 {
-  struct pic_vector *v;
-  size_t k;
-  pic_value o;
+  struct pic_vector *v = argv[0].v;
+  size_t k = argv[1].k;
 
-  pic_get_args(pic, "vko", &v, &k, &o);
+  PIC_UNUSED(argc);
 
   if (v->len <= k) {
     pic_errorf(pic, "vector-set!: index out of range");
   }
-  v->data[k] = o;
+  v->data[k] = argv[2].o;
   return pic_none_value();
 }
 
@@ -241,8 +239,8 @@ static pic_value
 pic_vec_vector_map(pic_state *pic)
 {
   struct pic_proc *proc;
-  size_t argc, i, len, j;
-  pic_value *argv, vals;
+  size_t argc, i, len, j, ai;
+  pic_value *argv, *vals;
   pic_vec *vec;
 
   pic_get_args(pic, "l*", &proc, &argc, &argv);
@@ -257,13 +255,17 @@ pic_vec_vector_map(pic_state *pic)
   }
 
   vec = pic_make_vec(pic, len);
+  vals = pic_make_vec(pic, argc)->data;
+
+  ai = pic_gc_arena_preserve(pic);
 
   for (i = 0; i < len; ++i) {
-    vals = pic_nil_value();
     for (j = 0; j < argc; ++j) {
-      pic_push(pic, pic_vec_ptr(argv[j])->data[i], vals);
+      vals[j] = pic_vec_ptr(argv[j])->data[i];
     }
-    vec->data[i] = pic_apply(pic, proc, vals);
+    vec->data[i] = pic_applyv(pic, proc, argc, vals);
+
+    pic_gc_arena_restore(pic, ai);
   }
 
   return pic_obj_value(vec);
@@ -273,8 +275,8 @@ static pic_value
 pic_vec_vector_for_each(pic_state *pic)
 {
   struct pic_proc *proc;
-  size_t argc, i, len, j;
-  pic_value *argv, vals;
+  size_t argc, i, len, j, ai;
+  pic_value *argv, *vals;
 
   pic_get_args(pic, "l*", &proc, &argc, &argv);
 
@@ -287,12 +289,17 @@ pic_vec_vector_for_each(pic_state *pic)
       : pic_vec_ptr(argv[i])->len;
   }
 
+  vals = pic_make_vec(pic, argc)->data;
+
+  ai = pic_gc_arena_preserve(pic);
+
   for (i = 0; i < len; ++i) {
-    vals = pic_nil_value();
     for (j = 0; j < argc; ++j) {
-      pic_push(pic, pic_vec_ptr(argv[j])->data[i], vals);
+      vals[j] = pic_vec_ptr(argv[j])->data[i];
     }
-    pic_apply(pic, proc, vals);
+    pic_applyv(pic, proc, argc, vals);
+
+    pic_gc_arena_restore(pic, ai);
   }
 
   return pic_none_value();
@@ -413,9 +420,9 @@ pic_init_vector(pic_state *pic)
   pic_defun(pic, "vector?", pic_vec_vector_p);
   pic_defun(pic, "vector", pic_vec_vector);
   pic_defun(pic, "make-vector", pic_vec_make_vector);
-  pic_defun(pic, "vector-length", pic_vec_vector_length);
-  pic_defun(pic, "vector-ref", pic_vec_vector_ref);
-  pic_defun(pic, "vector-set!", pic_vec_vector_set);
+  pic_defun_sig(pic, "vector-length", pic_vec_vector_length, "v");
+  pic_defun_sig(pic, "vector-ref", pic_vec_vector_ref, "vk");
+  pic_defun_sig(pic, "vector-set!", pic_vec_vector_set, "vko");
   pic_defun(pic, "vector-copy!", pic_vec_vector_copy_i);
   pic_defun(pic, "vector-copy", pic_vec_vector_copy);
   pic_defun(pic, "vector-append", pic_vec_vector_append);
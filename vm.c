@@ -54,6 +54,126 @@ pic_get_proc(pic_state *pic)
  *  *   size_t *, pic_value **  variable length operator
  */
 
+/*
+ * Checks and unboxes an argument for one of the specifiers o, i, k, c,
+ * s, m, v, b, l, p, d, r and e, shared by pic_get_args and pic_defun_sig.
+ */
+static void
+vm_unbox_arg(pic_state *pic, char c, pic_value v, pic_arg *arg)
+{
+  switch (c) {
+  case 'o':
+    arg->o = v;
+    break;
+  case 'i':
+    switch (pic_type(v)) {
+#if PIC_ENABLE_FLOAT
+    case PIC_TT_FLOAT:
+      arg->i = (int)pic_float(v);
+      break;
+#endif
+    case PIC_TT_INT:
+      arg->i = pic_int(v);
+      break;
+    default:
+      pic_errorf(pic, "pic_get_args: expected int, but got ~s", v);
+    }
+    break;
+  case 'k': {
+    int x;
+    size_t s;
+
+    if (! pic_int_p(v)) {
+      pic_errorf(pic, "pic_get_args: expected int, but got ~s", v);
+    }
+    x = pic_int(v);
+    if (x < 0) {
+      pic_errorf(pic, "pic_get_args: expected non-negative int, but got ~s", v);
+    }
+    s = (size_t)x;
+    if (sizeof(unsigned) > sizeof(size_t)) {
+      if (x != (int)s) {
+        pic_errorf(pic, "pic_get_args: int unrepresentable with size_t ~s", v);
+      }
+    }
+    arg->k = s;
+    break;
+  }
+  case 'c':
+    if (! pic_char_p(v)) {
+      pic_errorf(pic, "pic_get_args: expected char, but got ~s", v);
+    }
+    arg->c = pic_char(v);
+    break;
+  case 's':
+    if (! pic_str_p(v)) {
+      pic_errorf(pic, "pic_get_args: expected string, but got ~s", v);
+    }
+    arg->s = pic_str_ptr(v);
+    break;
+  case 'm':
+    if (! pic_sym_p(v)) {
+      pic_errorf(pic, "pic_get_args: expected symbol, but got ~s", v);
+    }
+    arg->m = pic_sym_ptr(v);
+    break;
+  case 'v':
+    if (! pic_vec_p(v)) {
+      pic_errorf(pic, "pic_get_args: expected vector, but got ~s", v);
+    }
+    arg->v = pic_vec_ptr(v);
+    break;
+  case 'b':
+    if (! pic_blob_p(v)) {
+      pic_errorf(pic, "pic_get_args: expected bytevector, but got ~s", v);
+    }
+    arg->b = pic_blob_ptr(v);
+    break;
+  case 'l':
+    if (! pic_proc_p(v)) {
+      pic_errorf(pic, "pic_get_args, expected procedure, but got ~s", v);
+    }
+    arg->l = pic_proc_ptr(v);
+    break;
+  case 'p':
+    if (! pic_port_p(v)) {
+      pic_errorf(pic, "pic_get_args, expected port, but got ~s", v);
+    }
+    arg->p = pic_port_ptr(v);
+    break;
+  case 'd':
+    if (! pic_dict_p(v)) {
+      pic_errorf(pic, "pic_get_args, expected dictionary, but got ~s", v);
+    }
+    arg->d = pic_dict_ptr(v);
+    break;
+  case 'r':
+    if (! pic_record_p(v)) {
+      pic_errorf(pic, "pic_get_args: expected record, but got ~s", v);
+    }
+    arg->r = pic_record_ptr(v);
+    break;
+  case 'e':
+    if (! pic_error_p(v)) {
+      pic_errorf(pic, "pic_get_args, expected error");
+    }
+    arg->e = pic_error_ptr(v);
+    break;
+  default:
+    pic_errorf(pic, "pic_get_args: invalid argument specifier '%c' given", c);
+  }
+}
+
+/* stores the next argument, if any, through a pointer of type taken from ap */
+#define GET_ARG(type, field) do {                       \
+    type *p = va_arg(ap, type *);                       \
+    if (i < argc) {                                     \
+      vm_unbox_arg(pic, c, GET_OPERAND(pic, i), &arg);  \
+      *p = arg.field;                                   \
+      i++;                                              \
+    }                                                   \
+  } while (0)
+
 int
 pic_get_args(pic_state *pic, const char *format, ...)
 {
@@ -61,6 +181,7 @@ pic_get_args(pic_state *pic, const char *format, ...)
   int i = 1, argc = pic->ci->argc;
   va_list ap;
   bool opt = false;
+  pic_arg arg;
 
   va_start(ap, format);
   while ((c = *format++)) {
@@ -87,16 +208,6 @@ pic_get_args(pic_state *pic, const char *format, ...)
     case '|':
       opt = true;
       break;
-    case 'o': {
-      pic_value *p;
-
-      p = va_arg(ap, pic_value*);
-      if (i < argc) {
-        *p = GET_OPERAND(pic,i);
-        i++;
-      }
-      break;
-    }
 #if PIC_ENABLE_FLOAT
     case 'f': {
       double *f;
@@ -173,246 +284,30 @@ pic_get_args(pic_state *pic, const char *format, ...)
       break;
     }
 #endif
-    case 'i': {
-      int *k;
-
-      k = va_arg(ap, int *);
-      if (i < argc) {
-        pic_value v;
-
-        v = GET_OPERAND(pic, i);
-        switch (pic_type(v)) {
-#if PIC_ENABLE_FLOAT
-        case PIC_TT_FLOAT:
-          *k = (int)pic_float(v);
-          break;
-#endif
-        case PIC_TT_INT:
-          *k = pic_int(v);
-          break;
-        default:
-          pic_errorf(pic, "pic_get_args: expected int, but got ~s", v);
-        }
-        i++;
-      }
-      break;
-    }
-    case 'k': {
-      size_t *k;
-
-      k = va_arg(ap, size_t *);
-      if (i < argc) {
-        pic_value v;
-        int x;
-        size_t s;
-
-        v = GET_OPERAND(pic, i);
-        switch (pic_type(v)) {
-        case PIC_TT_INT:
-          x = pic_int(v);
-          if (x < 0) {
-            pic_errorf(pic, "pic_get_args: expected non-negative int, but got ~s", v);
-          }
-          s = (size_t)x;
-          if (sizeof(unsigned) > sizeof(size_t)) {
-            if (x != (int)s) {
-              pic_errorf(pic, "pic_get_args: int unrepresentable with size_t ~s", v);
-            }
-          }
-          *k = (size_t)x;
-          break;
-        default:
-          pic_errorf(pic, "pic_get_args: expected int, but got ~s", v);
-        }
-        i++;
-      }
-      break;
-    }
-    case 's': {
-      pic_str **str;
-      pic_value v;
-
-      str = va_arg(ap, pic_str **);
-      if (i < argc) {
-        v = GET_OPERAND(pic,i);
-        if (pic_str_p(v)) {
-          *str = pic_str_ptr(v);
-        }
-        else {
-          pic_errorf(pic, "pic_get_args: expected string, but got ~s", v);
-        }
-        i++;
-      }
-      break;
-    }
     case 'z': {
       const char **cstr;
-      pic_value v;
 
       cstr = va_arg(ap, const char **);
       if (i < argc) {
-        v = GET_OPERAND(pic,i);
-        if (! pic_str_p(v)) {
-          pic_errorf(pic, "pic_get_args: expected string, but got ~s", v);
-        }
-        *cstr = pic_str_cstr(pic, pic_str_ptr(v));
-        i++;
-      }
-      break;
-    }
-    case 'm': {
-      pic_sym **m;
-      pic_value v;
-
-      m = va_arg(ap, pic_sym **);
-      if (i < argc) {
-        v = GET_OPERAND(pic,i);
-        if (pic_sym_p(v)) {
-          *m = pic_sym_ptr(v);
-        }
-        else {
-          pic_errorf(pic, "pic_get_args: expected symbol, but got ~s", v);
-        }
-        i++;
-      }
-      break;
-    }
-    case 'v': {
-      struct pic_vector **vec;
-      pic_value v;
-
-      vec = va_arg(ap, struct pic_vector **);
-      if (i < argc) {
-        v = GET_OPERAND(pic,i);
-        if (pic_vec_p(v)) {
-          *vec = pic_vec_ptr(v);
-        }
-        else {
-          pic_errorf(pic, "pic_get_args: expected vector, but got ~s", v);
-        }
-        i++;
-      }
-      break;
-    }
-    case 'b': {
-      struct pic_blob **b;
-      pic_value v;
-
-      b = va_arg(ap, struct pic_blob **);
-      if (i < argc) {
-        v = GET_OPERAND(pic,i);
-        if (pic_blob_p(v)) {
-          *b = pic_blob_ptr(v);
-        }
-        else {
-          pic_errorf(pic, "pic_get_args: expected bytevector, but got ~s", v);
-        }
-        i++;
-      }
-      break;
-    }
-    case 'c': {
-      char *k;
-      pic_value v;
-
-      k = va_arg(ap, char *);
-      if (i < argc) {
-        v = GET_OPERAND(pic,i);
-        if (pic_char_p(v)) {
-          *k = pic_char(v);
-        }
-        else {
-          pic_errorf(pic, "pic_get_args: expected char, but got ~s", v);
-        }
-        i++;
-      }
-      break;
-    }
-    case 'l': {
-      struct pic_proc **l;
-      pic_value v;
-
-      l = va_arg(ap, struct pic_proc **);
-      if (i < argc) {
-        v = GET_OPERAND(pic,i);
-        if (pic_proc_p(v)) {
-          *l = pic_proc_ptr(v);
-        }
-        else {
-          pic_errorf(pic, "pic_get_args, expected procedure, but got ~s", v);
-        }
-        i++;
-      }
-      break;
-    }
-    case 'p': {
-      struct pic_port **p;
-      pic_value v;
-
-      p = va_arg(ap, struct pic_port **);
-      if (i < argc) {
-        v = GET_OPERAND(pic,i);
-        if (pic_port_p(v)) {
-          *p = pic_port_ptr(v);
-        }
-        else {
-          pic_errorf(pic, "pic_get_args, expected port, but got ~s", v);
-        }
-        i++;
-      }
-      break;
-    }
-    case 'd': {
-      struct pic_dict **d;
-      pic_value v;
-
-      d = va_arg(ap, struct pic_dict **);
-      if (i < argc) {
-        v = GET_OPERAND(pic,i);
-        if (pic_dict_p(v)) {
-          *d = pic_dict_ptr(v);
-        }
-        else {
-          pic_errorf(pic, "pic_get_args, expected dictionary, but got ~s", v);
-        }
-        i++;
-      }
-      break;
-    }
-    case 'r': {
-      struct pic_record **r;
-      pic_value v;
-
-      r = va_arg(ap, struct pic_record **);
-      if (i < argc) {
-        v = GET_OPERAND(pic,i);
-        if (pic_record_p(v)) {
-          *r = pic_record_ptr(v);
-        }
-        else {
-          pic_errorf(pic, "pic_get_args: expected record, but got ~s", v);
-        }
-        i++;
-      }
-      break;
-    }
-    case 'e': {
-      struct pic_error **e;
-      pic_value v;
-
-      e = va_arg(ap, struct pic_error **);
-      if (i < argc) {
-        v = GET_OPERAND(pic,i);
-        if (pic_error_p(v)) {
-          *e = pic_error_ptr(v);
-        }
-        else {
-          pic_errorf(pic, "pic_get_args, expected error");
-        }
+        vm_unbox_arg(pic, 's', GET_OPERAND(pic, i), &arg);
+        *cstr = pic_str_cstr(pic, arg.s);
         i++;
       }
       break;
     }
+    case 'o': GET_ARG(pic_value, o); break;
+    case 'i': GET_ARG(int, i); break;
+    case 'k': GET_ARG(size_t, k); break;
+    case 'c': GET_ARG(char, c); break;
+    case 's': GET_ARG(pic_str *, s); break;
+    case 'm': GET_ARG(pic_sym *, m); break;
+    case 'v': GET_ARG(struct pic_vector *, v); break;
+    case 'b': GET_ARG(struct pic_blob *, b); break;
+    case 'l': GET_ARG(struct pic_proc *, l); break;
+    case 'p': GET_ARG(struct pic_port *, p); break;
+    case 'd': GET_ARG(struct pic_dict *, d); break;
+    case 'r': GET_ARG(struct pic_record *, r); break;
+    case 'e': GET_ARG(struct pic_error *, e); break;
     default:
       pic_errorf(pic, "pic_get_args: invalid argument specifier '%c' given", c);
     }
@@ -436,6 +331,38 @@ pic_get_args(pic_state *pic, const char *format, ...)
   return i - 1;
 }
 
+#undef GET_ARG
+
+/**
+ * A function defined by pic_defun_sig gets its arguments already checked
+ * and unboxed, as if by pic_get_args with the format it was defined
+ * with. Only the specifiers o, i, k, c, s, m, v, b, l, p, d, r, e and |
+ * are allowed there, since their unboxed values fit in a pic_arg.
+ */
+
+static pic_value
+vm_call_sig(pic_state *pic, struct pic_sig *sig)
+{
+  pic_arg argv[PIC_SIG_MAX];
+  int argc = pic->ci->argc - 1, i;
+
+  if (argc < sig->reqc || argc > sig->reqc + sig->optc) {
+    pic_errorf(pic, "wrong number of arguments");
+  }
+
+  for (i = 0; i < argc; ++i) {
+    vm_unbox_arg(pic, sig->types[i], GET_OPERAND(pic, i + 1), &argv[i]);
+  }
+
+  return sig->f(pic, argc, argv);
+}
+
+static pic_value
+vm_sig_func(pic_state *pic)
+{
+  return vm_call_sig(pic, pic_get_proc(pic)->u.func.sig);
+}
+
 void
 pic_define_noexport(pic_state *pic, const char *name, pic_value val)
 {
@@ -509,6 +436,51 @@ pic_defun(pic_state *pic, const char *name, pic_func_t cfunc)
   pic_define(pic, name, pic_obj_value(proc));
 }
 
+struct pic_proc *
+pic_make_proc_sig(pic_state *pic, pic_sigfunc_t cfunc, const char *name, const char *format)
+{
+  struct pic_proc *proc;
+  struct pic_sig sig;
+  const char *p;
+  bool opt = false;
+
+  sig.f = cfunc;
+  sig.reqc = sig.optc = 0;
+
+  for (p = format; *p != '\0'; ++p) {
+    switch (*p) {
+    case '|':
+      opt = true;
+      continue;
+    case 'o': case 'i': case 'k': case 'c': case 's': case 'm': case 'v':
+    case 'b': case 'l': case 'p': case 'd': case 'r': case 'e':
+      break;
+    default:
+      pic_errorf(pic, "pic_make_proc_sig: invalid argument specifier '%c' given", *p);
+    }
+    if (sig.reqc + sig.optc == PIC_SIG_MAX) {
+      pic_errorf(pic, "pic_make_proc_sig: too many arguments");
+    }
+    sig.types[sig.reqc + sig.optc] = *p;
+    if (opt) {
+      sig.optc++;
+    } else {
+      sig.reqc++;
+    }
+  }
+
+  proc = pic_make_proc(pic, vm_sig_func, name);
+  proc->u.func.sig = pic_alloc(pic, sizeof(struct pic_sig));
+  *proc->u.func.sig = sig;
+  return proc;
+}
+
+void
+pic_defun_sig(pic_state *pic, const char *name, pic_sigfunc_t cfunc, const char *format)
+{
+  pic_define(pic, name, pic_obj_value(pic_make_proc_sig(pic, cfunc, name, format)));
+}
+
 void
 pic_defvar(pic_state *pic, const char *name, pic_value init, struct pic_proc *conv)
 {
@@ -545,69 +517,228 @@ vm_tear_off(pic_callinfo *ci)
   env->regs = env->storage;
 }
 
+/**
+ * The value stack and the callinfo stack start with PIC_STACK_SIZE
+ * entries and double when full, up to PIC_STACK_MAX. Going past that
+ * raises an error, and the stack gets PIC_STACK_SIZE more entries for
+ * the handlers to run in, until the next escape takes them back.
+ *
+ * The value stack moves when it grows. Frames and captured variables
+ * are relocated, but C functions may hold arguments got by pic_get_args
+ * with "*", so the old block is only freed by pic_close.
+ */
+
+/* a stack that has reached its limit keeps the room for the handlers */
+#define VM_STACK_CAPACITY(len) ((len) < PIC_STACK_MAX ? (len) : PIC_STACK_MAX + PIC_STACK_SIZE)
+
+static size_t
+vm_stack_length(pic_state *pic, size_t len, size_t need, bool *overflow)
+{
+  *overflow = false;
+
+  if (need < PIC_STACK_MAX) {
+    while (len <= need) {
+      len *= 2;
+    }
+    return len < PIC_STACK_MAX ? len : PIC_STACK_MAX;
+  }
+  if (len <= PIC_STACK_MAX && need < PIC_STACK_MAX + PIC_STACK_SIZE) {
+    *overflow = true;
+    return PIC_STACK_MAX + PIC_STACK_SIZE;
+  }
+  pic_panic(pic, "VM stack overflow");
+}
+
 void
-pic_vm_tear_off(pic_state *pic)
+pic_vm_reserve(pic_state *pic, size_t n)
 {
+  size_t len, used, newlen;
+  pic_value *stbase;
   pic_callinfo *ci;
+  bool overflow;
+
+  if (pic->sp + n < pic->stend) {
+    return;
+  }
+
+  len = (size_t)(pic->stend - pic->stbase);
+  used = (size_t)(pic->sp - pic->stbase);
+  newlen = vm_stack_length(pic, len, used + n, &overflow);
+
+  if (VM_STACK_CAPACITY(newlen) != VM_STACK_CAPACITY(len)) {
+    stbase = pic_alloc(pic, VM_STACK_CAPACITY(newlen) * sizeof(pic_value));
+    memcpy(stbase, pic->stbase, used * sizeof(pic_value));
+
+    for (ci = pic->ci; ci > pic->cibase; --ci) {
+      if (ci->env != NULL && ci->env->regs != ci->env->storage) {
+        ci->env->regs = stbase + (ci->env->regs - pic->stbase);
+      }
+      ci->fp = stbase + (ci->fp - pic->stbase);
+      if (ci->irep != NULL) {
+        ci->regs = stbase + (ci->regs - pic->stbase);
+      }
+    }
+    xv_push(pic_value *, pic->stold, pic->stbase);
+
+    pic->stbase = stbase;
+    pic->sp = stbase + used;
+  }
+  pic->stend = pic->stbase + newlen;
+
+  if (overflow) {
+    pic_errorf(pic, "VM stack overflow");
+  }
+}
+
+/*
+ * Blocks the stack has moved out of stay allocated while a C function
+ * called from the VM may still hold argv pointing into them. None is
+ * left once control is back at the outermost level.
+ */
+void
+pic_vm_release(pic_state *pic)
+{
+  if (pic->ci != pic->cibase) {
+    return;
+  }
+  while (xv_size(pic->stold) > 0) {
+    pic_free(pic, xv_pop(pic->stold));
+  }
+}
+
+static void
+vm_reserve_callinfo(pic_state *pic)
+{
+  size_t len, used, newlen;
+  bool overflow;
+
+  len = (size_t)(pic->ciend - pic->cibase);
+  used = (size_t)(pic->ci - pic->cibase);
+  newlen = vm_stack_length(pic, len, used + 1, &overflow);
+
+  if (VM_STACK_CAPACITY(newlen) != VM_STACK_CAPACITY(len)) {
+    pic->cibase = pic_realloc(pic, pic->cibase, VM_STACK_CAPACITY(newlen) * sizeof(pic_callinfo));
+    pic->ci = pic->cibase + used;
+  }
+  pic->ciend = pic->cibase + newlen;
+
+  if (overflow) {
+    pic_errorf(pic, "VM stack overflow");
+  }
+}
 
-  for (ci = pic->ci; ci > pic->cibase; ci--) {
+void
+pic_vm_escape(pic_state *pic, ptrdiff_t sp_offset, ptrdiff_t ci_offset)
+{
+  pic_callinfo *ci;
+
+  /* the frames left behind may have lent their variables to closures */
+  for (ci = pic->ci; ci > pic->cibase + ci_offset; --ci) {
     if (ci->env != NULL) {
       vm_tear_off(ci);
     }
   }
+  pic->sp = pic->stbase + sp_offset;
+  pic->ci = pic->cibase + ci_offset;
+
+  /* take back the room given to the handlers of a stack overflow */
+  if (pic->stend - pic->stbase > PIC_STACK_MAX && pic->sp - pic->stbase < PIC_STACK_MAX) {
+    pic->stend = pic->stbase + PIC_STACK_MAX;
+  }
+  if (pic->ciend - pic->cibase > PIC_STACK_MAX && pic->ci - pic->cibase < PIC_STACK_MAX) {
+    pic->ciend = pic->cibase + PIC_STACK_MAX;
+  }
 }
 
+/* the code of the running procedure, which may be older than the one it now has */
 static struct pic_irep *
 vm_get_irep(pic_state *pic)
 {
-  pic_value self;
   struct pic_irep *irep;
 
-  self = pic->ci->fp[0];
-  if (! pic_proc_p(self)) {
-    pic_errorf(pic, "logic flaw");
-  }
-  irep = pic_proc_ptr(self)->u.irep;
-  if (! pic_proc_irep_p(pic_proc_ptr(self))) {
+  irep = pic->ci->irep;
+  if (irep == NULL) {
     pic_errorf(pic, "logic flaw");
   }
   return irep;
 }
 
+pic_value
+pic_apply(pic_state *pic, struct pic_proc *proc, pic_value args)
+{
+  pic_value v, it, *argv;
+  size_t argc;
+
+  if (! pic_list_p(args)) {
+    pic_errorf(pic, "argv must be a proper list");
+  }
+  argc = pic_length(pic, args);
+  pic_vm_reserve(pic, argc + 1);
+
+  /* spread the list one slot above the stack, right where pic_applyv pushes it */
+  argv = pic->sp + 1;
+  pic_for_each (v, args, it) {
+    *argv++ = v;
+  }
+  return pic_applyv(pic, proc, argc, pic->sp + 1);
+}
+
 pic_value
 pic_apply0(pic_state *pic, struct pic_proc *proc)
 {
-  return pic_apply(pic, proc, pic_nil_value());
+  return pic_applyv(pic, proc, 0, NULL);
 }
 
 pic_value
 pic_apply1(pic_state *pic, struct pic_proc *proc, pic_value arg1)
 {
-  return pic_apply(pic, proc, pic_list1(pic, arg1));
+  return pic_applyv(pic, proc, 1, &arg1);
 }
 
 pic_value
 pic_apply2(pic_state *pic, struct pic_proc *proc, pic_value arg1, pic_value arg2)
 {
-  return pic_apply(pic, proc, pic_list2(pic, arg1, arg2));
+  pic_value argv[2];
+
+  argv[0] = arg1;
+  argv[1] = arg2;
+  return pic_applyv(pic, proc, 2, argv);
 }
 
 pic_value
 pic_apply3(pic_state *pic, struct pic_proc *proc, pic_value arg1, pic_value arg2, pic_value arg3)
 {
-  return pic_apply(pic, proc, pic_list3(pic, arg1, arg2, arg3));
+  pic_value argv[3];
+
+  argv[0] = arg1;
+  argv[1] = arg2;
+  argv[2] = arg3;
+  return pic_applyv(pic, proc, 3, argv);
 }
 
 pic_value
 pic_apply4(pic_state *pic, struct pic_proc *proc, pic_value arg1, pic_value arg2, pic_value arg3, pic_value arg4)
 {
-  return pic_apply(pic, proc, pic_list4(pic, arg1, arg2, arg3, arg4));
+  pic_value argv[4];
+
+  argv[0] = arg1;
+  argv[1] = arg2;
+  argv[2] = arg3;
+  argv[3] = arg4;
+  return pic_applyv(pic, proc, 4, argv);
 }
 
 pic_value
 pic_apply5(pic_state *pic, struct pic_proc *proc, pic_value arg1, pic_value arg2, pic_value arg3, pic_value arg4, pic_value arg5)
 {
-  return pic_apply(pic, proc, pic_list5(pic, arg1, arg2, arg3, arg4, arg5));
+  pic_value argv[5];
+
+  argv[0] = arg1;
+  argv[1] = arg2;
+  argv[2] = arg3;
+  argv[3] = arg4;
+  argv[4] = arg5;
+  return pic_applyv(pic, proc, 5, argv);
 }
 
 #if VM_DEBUG
@@ -700,7 +831,7 @@ pic_apply5(pic_state *pic, struct pic_proc *proc, pic_value arg1, pic_value arg2
 #endif
 
 pic_value
-pic_apply(pic_state *pic, struct pic_proc *proc, pic_value args)
+pic_applyv(pic_state *pic, struct pic_proc *proc, size_t argc, pic_value *argv)
 {
   pic_code c;
   size_t ai = pic_gc_arena_preserve(pic);
@@ -711,11 +842,15 @@ pic_apply(pic_state *pic, struct pic_proc *proc, pic_value args)
     &&L_OP_NOP, &&L_OP_POP, &&L_OP_PUSHNIL, &&L_OP_PUSHTRUE, &&L_OP_PUSHFALSE,
     &&L_OP_PUSHINT, &&L_OP_PUSHCHAR, &&L_OP_PUSHCONST,
     &&L_OP_GREF, &&L_OP_GSET, &&L_OP_LREF, &&L_OP_LSET, &&L_OP_CREF, &&L_OP_CSET,
-    &&L_OP_JMP, &&L_OP_JMPIF, &&L_OP_NOT, &&L_OP_CALL, &&L_OP_TAILCALL, &&L_OP_RET,
+    &&L_OP_JMP, &&L_OP_JMPIF, &&L_OP_JMPIFNOT, &&L_OP_NOT, &&L_OP_CALL, &&L_OP_TAILCALL, &&L_OP_RET,
     &&L_OP_LAMBDA, &&L_OP_CONS, &&L_OP_CAR, &&L_OP_CDR, &&L_OP_NILP,
     &&L_OP_SYMBOLP, &&L_OP_PAIRP,
+    &&L_OP_VECREF, &&L_OP_VECSET, &&L_OP_VECLEN, &&L_OP_STRREF, &&L_OP_BLOBREF, &&L_OP_BLOBSET,
+    &&L_OP_EQP, &&L_OP_EQVP, &&L_OP_CHAREQ,
     &&L_OP_ADD, &&L_OP_SUB, &&L_OP_MUL, &&L_OP_DIV, &&L_OP_MINUS,
-    &&L_OP_EQ, &&L_OP_LT, &&L_OP_LE, &&L_OP_STOP
+    &&L_OP_EQ, &&L_OP_LT, &&L_OP_LE,
+    &&L_OP_CAR_UNSAFE, &&L_OP_CDR_UNSAFE, &&L_OP_ADD_FX, &&L_OP_SUB_FX, &&L_OP_MUL_FX,
+    &&L_OP_EQ_FX, &&L_OP_LT_FX, &&L_OP_LE_FX, &&L_OP_STOP
   };
 #endif
 
@@ -724,25 +859,20 @@ pic_apply(pic_state *pic, struct pic_proc *proc, pic_value args)
   pic_callinfo *cibase;
 #endif
 
-  if (! pic_list_p(args)) {
-    pic_errorf(pic, "argv must be a proper list");
-  }
-  else {
-    int argc, i;
-
-    argc = (int)pic_length(pic, args) + 1;
+  pic_vm_reserve(pic, argc + 1);
+  {
+    size_t i;
 
     VM_BOOT_PRINT;
 
     PUSH(pic_obj_value(proc));
-    for (i = 1; i < argc; ++i) {
-      PUSH(pic_car(pic, args));
-      args = pic_cdr(pic, args);
+    for (i = 0; i < argc; ++i) {
+      PUSH(argv[i]);
     }
 
     /* boot! */
     boot[0].insn = OP_CALL;
-    boot[0].u.i = argc;
+    boot[0].u.i = (int)argc + 1;
     boot[1].insn = OP_STOP;
     pic->ip = boot;
   }
@@ -808,7 +938,7 @@ pic_apply(pic_state *pic, struct pic_proc *proc, pic_value args)
       struct pic_irep *irep;
 
       if (ci->env != NULL && ci->env->regs == ci->env->storage) {
-        irep = pic_get_proc(pic)->u.irep;
+        irep = ci->irep;
         if (c.u.i >= irep->argc + irep->localc) {
           PUSH(ci->env->regs[c.u.i - (ci->regs - ci->fp)]);
           NEXT;
@@ -822,7 +952,7 @@ pic_apply(pic_state *pic, struct pic_proc *proc, pic_value args)
       struct pic_irep *irep;
 
       if (ci->env != NULL && ci->env->regs == ci->env->storage) {
-        irep = pic_get_proc(pic)->u.irep;
+        irep = ci->irep;
         if (c.u.i >= irep->argc + irep->localc) {
           ci->env->regs[c.u.i - (ci->regs - ci->fp)] = POP();
           NEXT;
@@ -867,6 +997,16 @@ pic_apply(pic_state *pic, struct pic_proc *proc, pic_value args)
       }
       NEXT;
     }
+    CASE(OP_JMPIFNOT) {
+      pic_value v;
+
+      v = POP();
+      if (pic_false_p(v)) {
+	pic->ip += c.u.i;
+	JUMP;
+      }
+      NEXT;
+    }
     CASE(OP_NOT) {
       pic_value v;
 
@@ -893,7 +1033,10 @@ pic_apply(pic_state *pic, struct pic_proc *proc, pic_value args)
       VM_CALL_PRINT;
 
       if (pic->sp >= pic->stend) {
-        pic_panic(pic, "VM stack overflow");
+        pic_vm_reserve(pic, 1);
+      }
+      if (pic->ci + 1 >= pic->ciend) {
+        vm_reserve_callinfo(pic);
       }
 
       ci = PUSHCI();
@@ -902,10 +1045,15 @@ pic_apply(pic_state *pic, struct pic_proc *proc, pic_value args)
       ci->ip = pic->ip;
       ci->fp = pic->sp - c.u.i;
       ci->env = NULL;
+      ci->irep = NULL;
       if (pic_proc_func_p(pic_proc_ptr(x))) {
 
         /* invoke! */
-        v = proc->u.func.f(pic);
+        if (proc->u.func.sig != NULL) {
+          v = vm_call_sig(pic, proc->u.func.sig);
+        } else {
+          v = proc->u.func.f(pic);
+        }
         pic->sp[0] = v;
         pic->sp += pic->ci->retc;
 
@@ -917,6 +1065,27 @@ pic_apply(pic_state *pic, struct pic_proc *proc, pic_value args)
 	int i;
 	pic_value rest;
 
+#if PIC_TIER_THRESHOLD
+        /* count the call, and switch to the optimized code once it is hot */
+        if (irep->tiered == NULL && ++irep->calls + irep->loops >= PIC_TIER_THRESHOLD && ! pic_undef_p(irep->source)) {
+          pic_tier_up(pic, irep);
+        }
+        if (irep->tiered != NULL) {
+          irep = proc->u.irep = irep->tiered;
+          ++irep->calls;
+        }
+#endif
+
+#if PIC_LAZY_CODEGEN
+	pic_irep_prepare(pic, irep);
+#endif
+
+        /* each instruction pushes at most one value */
+        if (pic->sp + irep->localc + irep->clen >= pic->stend) {
+          pic_vm_reserve(pic, (size_t)irep->localc + irep->clen);
+        }
+        ci = pic->ci;
+
 	if (ci->argc != irep->argc) {
 	  if (! (irep->varg && ci->argc >= irep->argc)) {
             pic_errorf(pic, "wrong number of arguments (%d for %d%s)", ci->argc - 1, irep->argc - 1, (irep->varg ? "+" : ""));
@@ -947,8 +1116,12 @@ pic_apply(pic_state *pic, struct pic_proc *proc, pic_value args)
         ci->regc = irep->capturec;
         ci->regs = ci->fp + irep->argc + irep->localc;
 
+        ci->irep = irep;
 	pic->ip = irep->code;
 	pic_gc_arena_restore(pic, ai);
+#if PIC_ENABLE_JIT
+        pic->ip = pic_jit_run(pic, irep, pic->ip);
+#endif
 	JUMP;
       }
     }
@@ -968,6 +1141,12 @@ pic_apply(pic_state *pic, struct pic_proc *proc, pic_value args)
 
       argc = c.u.i;
       argv = pic->sp - argc;
+#if PIC_TIER_THRESHOLD
+      /* a loop written as a self tail call counts as much as a call */
+      if (pic->ci->irep != NULL && pic_proc_p(argv[0]) && pic_proc_irep_p(pic_proc_ptr(argv[0])) && pic_proc_ptr(argv[0])->u.irep == pic->ci->irep) {
+        pic->ci->irep->loops++;
+      }
+#endif
       for (i = 0; i < argc; ++i) {
 	pic->ci->fp[i] = argv[i];
       }
@@ -1002,20 +1181,17 @@ pic_apply(pic_state *pic, struct pic_proc *proc, pic_value args)
       pic->sp = ci->fp + 1;     /* advance only one! */
       pic->ip = ci->ip;
 
+#if PIC_ENABLE_JIT
+      /* back into the native code of the caller, after its call */
+      if (pic->ci->irep != NULL) {
+        pic->ip = pic_jit_run(pic, pic->ci->irep, pic->ip + 1);
+        JUMP;
+      }
+#endif
       NEXT;
     }
     CASE(OP_LAMBDA) {
-      pic_value self;
-      struct pic_irep *irep;
-
-      self = pic->ci->fp[0];
-      if (! pic_proc_p(self)) {
-        pic_errorf(pic, "logic flaw");
-      }
-      irep = pic_proc_ptr(self)->u.irep;
-      if (! pic_proc_irep_p(pic_proc_ptr(self))) {
-        pic_errorf(pic, "logic flaw");
-      }
+      struct pic_irep *irep = vm_get_irep(pic);
 
       if (pic->ci->env == NULL) {
         vm_push_env(pic);
@@ -1067,6 +1243,112 @@ pic_apply(pic_state *pic, struct pic_proc *proc, pic_value args)
       NEXT;
     }
 
+    CASE(OP_VECREF) {
+      pic_value v, k;
+      k = POP();
+      v = POP();
+      if (! pic_vec_p(v)) {
+        pic_errorf(pic, "vector-ref: expected vector, but got ~s", v);
+      }
+      if (! (pic_int_p(k) && pic_int(k) >= 0 && (size_t)pic_int(k) < pic_vec_ptr(v)->len)) {
+        pic_errorf(pic, "vector-ref: index out of range");
+      }
+      PUSH(pic_vec_ptr(v)->data[pic_int(k)]);
+      NEXT;
+    }
+    CASE(OP_VECSET) {
+      pic_value v, k, o;
+      o = POP();
+      k = POP();
+      v = POP();
+      if (! pic_vec_p(v)) {
+        pic_errorf(pic, "vector-set!: expected vector, but got ~s", v);
+      }
+      if (! (pic_int_p(k) && pic_int(k) >= 0 && (size_t)pic_int(k) < pic_vec_ptr(v)->len)) {
+        pic_errorf(pic, "vector-set!: index out of range");
+      }
+      pic_vec_ptr(v)->data[pic_int(k)] = o;
+      PUSH(pic_none_value());
+      NEXT;
+    }
+    CASE(OP_VECLEN) {
+      pic_value v;
+      v = POP();
+      if (! pic_vec_p(v)) {
+        pic_errorf(pic, "vector-length: expected vector, but got ~s", v);
+      }
+      PUSH(pic_size_value(pic_vec_ptr(v)->len));
+      NEXT;
+    }
+    CASE(OP_STRREF) {
+      pic_value s, k;
+      k = POP();
+      s = POP();
+      if (! pic_str_p(s)) {
+        pic_errorf(pic, "string-ref: expected string, but got ~s", s);
+      }
+      if (! (pic_int_p(k) && pic_int(k) >= 0)) {
+        pic_errorf(pic, "string-ref: index out of range");
+      }
+      PUSH(pic_char_value(pic_str_ref(pic, pic_str_ptr(s), (size_t)pic_int(k))));
+      NEXT;
+    }
+    CASE(OP_BLOBREF) {
+      pic_value b, k;
+      k = POP();
+      b = POP();
+      if (! pic_blob_p(b)) {
+        pic_errorf(pic, "bytevector-u8-ref: expected bytevector, but got ~s", b);
+      }
+      if (! (pic_int_p(k) && pic_int(k) >= 0 && (size_t)pic_int(k) < pic_blob_ptr(b)->len)) {
+        pic_errorf(pic, "bytevector-u8-ref: index out of range");
+      }
+      PUSH(pic_int_value(pic_blob_ptr(b)->data[pic_int(k)]));
+      NEXT;
+    }
+    CASE(OP_BLOBSET) {
+      pic_value b, k, n;
+      n = POP();
+      k = POP();
+      b = POP();
+      if (! pic_blob_p(b)) {
+        pic_errorf(pic, "bytevector-u8-set!: expected bytevector, but got ~s", b);
+      }
+      if (! (pic_int_p(k) && pic_int(k) >= 0 && (size_t)pic_int(k) < pic_blob_ptr(b)->len)) {
+        pic_errorf(pic, "bytevector-u8-set!: index out of range");
+      }
+      if (! (pic_int_p(n) && 0 <= pic_int(n) && pic_int(n) <= 255)) {
+        pic_errorf(pic, "byte out of range");
+      }
+      pic_blob_ptr(b)->data[pic_int(k)] = (unsigned char)pic_int(n);
+      PUSH(pic_none_value());
+      NEXT;
+    }
+    CASE(OP_EQP) {
+      pic_value a, b;
+      b = POP();
+      a = POP();
+      PUSH(pic_bool_value(pic_eq_p(a, b)));
+      NEXT;
+    }
+    CASE(OP_EQVP) {
+      pic_value a, b;
+      b = POP();
+      a = POP();
+      PUSH(pic_bool_value(pic_eqv_p(a, b)));
+      NEXT;
+    }
+    CASE(OP_CHAREQ) {
+      pic_value a, b;
+      b = POP();
+      a = POP();
+      if (! (pic_char_p(a) && pic_char_p(b))) {
+        pic_errorf(pic, "char=?: expected char, but got ~s", pic_char_p(a) ? b : a);
+      }
+      PUSH(pic_bool_value(pic_char(a) == pic_char(b)));
+      NEXT;
+    }
+
 #define DEFINE_ARITH_OP(opcode, op, guard)			\
     CASE(opcode) {						\
       pic_value a, b;						\
@@ -1186,10 +1468,72 @@ pic_apply(pic_state *pic, struct pic_proc *proc, pic_value args)
     DEFINE_COMP_OP2(OP_LE, <=);
 #endif
 
+    /* the compiler proved the operands have the right type */
+
+    CASE(OP_CAR_UNSAFE) {
+      pic_value p;
+      p = POP();
+      PUSH(pic_pair_ptr(p)->car);
+      NEXT;
+    }
+    CASE(OP_CDR_UNSAFE) {
+      pic_value p;
+      p = POP();
+      PUSH(pic_pair_ptr(p)->cdr);
+      NEXT;
+    }
+
+#if PIC_ENABLE_FLOAT
+# define DEFINE_ARITH_OP_FX(opcode, op)                         \
+    CASE(opcode) {						\
+      pic_value a, b;						\
+      double f;                                                 \
+      b = POP();						\
+      a = POP();						\
+      f = (double)pic_int(a) op (double)pic_int(b);             \
+      if (INT_MIN <= f && f <= INT_MAX) {                       \
+        PUSH(pic_int_value((int)f));                            \
+      }                                                         \
+      else {                                                    \
+        PUSH(pic_float_value(f));                               \
+      }                                                         \
+      NEXT;							\
+    }
+#else
+# define DEFINE_ARITH_OP_FX(opcode, op)                         \
+    CASE(opcode) {						\
+      pic_value a, b;						\
+      b = POP();						\
+      a = POP();						\
+      PUSH(pic_int_value(pic_int(a) op pic_int(b)));            \
+      NEXT;							\
+    }
+#endif
+
+    DEFINE_ARITH_OP_FX(OP_ADD_FX, +);
+    DEFINE_ARITH_OP_FX(OP_SUB_FX, -);
+    DEFINE_ARITH_OP_FX(OP_MUL_FX, *);
+
+#define DEFINE_COMP_OP_FX(opcode, op)				\
+    CASE(opcode) {						\
+      pic_value a, b;						\
+      b = POP();						\
+      a = POP();						\
+      PUSH(pic_bool_value(pic_int(a) op pic_int(b)));		\
+      NEXT;							\
+    }
+
+    DEFINE_COMP_OP_FX(OP_EQ_FX, ==);
+    DEFINE_COMP_OP_FX(OP_LT_FX, <);
+    DEFINE_COMP_OP_FX(OP_LE_FX, <=);
+
     CASE(OP_STOP) {
 
       VM_END_PRINT;
 
+      if (xv_size(pic->stold) > 0) {
+        pic_vm_release(pic);
+      }
       return pic_gc_protect(pic, POP());
     }
   } VM_LOOP_END;
@@ -1197,30 +1541,53 @@ pic_apply(pic_state *pic, struct pic_proc *proc, pic_value args)
 
 pic_value
 pic_apply_trampoline(pic_state *pic, struct pic_proc *proc, pic_value args)
+{
+  pic_value v, it, *argv;
+  size_t argc;
+
+  argc = pic_length(pic, args);
+  pic_vm_reserve(pic, argc + 1);
+
+  /* spread the list right where pic_apply_trampolinev moves it */
+  argv = pic->sp + 1;
+  pic_for_each (v, args, it) {
+    *argv++ = v;
+  }
+  return pic_apply_trampolinev(pic, proc, argc, pic->sp + 1);
+}
+
+pic_value
+pic_apply_trampolinev(pic_state *pic, struct pic_proc *proc, size_t argc, pic_value *argv)
 {
   static pic_code iseq[2];
 
-  pic_value v, it, *sp;
   pic_callinfo *ci;
+  size_t i;
 
   PIC_INIT_CODE_I(iseq[0], OP_NOP, 0);
   PIC_INIT_CODE_I(iseq[1], OP_TAILCALL, -1);
 
-  *pic->sp++ = pic_obj_value(proc);
+  pic_vm_reserve(pic, argc + 1);
+  if (pic->ci + 1 >= pic->ciend) {
+    vm_reserve_callinfo(pic);
+  }
 
-  sp = pic->sp;
-  pic_for_each (v, args, it) {
-    *sp++ = v;
+  /* argv may start right at the top of the stack, so copy from the end */
+  for (i = argc; i-- > 0;) {
+    pic->sp[i + 1] = argv[i];
   }
+  *pic->sp++ = pic_obj_value(proc);
 
   ci = PUSHCI();
   ci->ip = (pic_code *)iseq;
   ci->fp = pic->sp;
-  ci->retc = (int)pic_length(pic, args);
+  ci->env = NULL;
+  ci->irep = NULL;
+  ci->retc = (int)argc;
 
-  if (ci->retc == 0) {
+  if (argc == 0) {
     return pic_none_value();
   } else {
-    return pic_car(pic, args);
+    return pic->sp[0];
   }
 }